@@ -1,6 +1,22 @@
 #include "unity.h"
 
+#include "cached-geometry.h"
+#include "cluster-tree.h"
+#include "dissipation.h"
+#include "fdtd.h"
+#include "fft.h"
+#include "frame-cache.h"
 #include "geometry.h"
+#include "image-file.h"
+#include "oscillator-store.h"
+#include "scene.h"
+#include "spatial-index.h"
+#include "thread-pool.h"
+#include "universe.h"
+#include "video-capture.h"
+
+// Defined in second-unit.c.
+double sin_of_distance_in_second_unit(const CachedGeometry * const geometry, int x, int y);
 
 void test_minimum_works_as_expected() {
     TEST_ASSERT(minimum(-1.0, -1.0) == -1.0);
@@ -30,9 +46,685 @@ void test_maximum_works_as_expected() {
     TEST_ASSERT(maximum(1.0, 1.0) == 1.0);
 }
 
+void test_oscillator_store_grows_as_needed() {
+    OscillatorStore *store = create_oscillator_store();
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT(add_oscillator(store, i, -i, 1.0, 50.0) == (size_t) i);
+    }
+    TEST_ASSERT(store->count == 1000);
+    TEST_ASSERT(store->capacity >= 1000);
+    TEST_ASSERT(store->center_x[999] == 999);
+    TEST_ASSERT(store->center_y[999] == -999);
+    delete_oscillator_store(store);
+}
+
+void test_oscillator_store_removal_swaps_the_last_oscillator_in() {
+    OscillatorStore *store = create_oscillator_store();
+    add_oscillator(store, 0, 0, 1.0, 50.0);
+    add_oscillator(store, 1, 1, 1.5, 60.0);
+    add_oscillator(store, 2, 2, 2.0, 70.0);
+    remove_oscillator(store, 0);
+    TEST_ASSERT(store->count == 2);
+    TEST_ASSERT(store->center_x[0] == 2);
+    TEST_ASSERT(store->amplitude[0] == 2.0);
+    TEST_ASSERT(store->wavelength[0] == 70.0);
+    TEST_ASSERT(store->center_x[1] == 1);
+    remove_oscillator(store, 1);
+    TEST_ASSERT(store->count == 1);
+    TEST_ASSERT(store->center_x[0] == 2);
+    delete_oscillator_store(store);
+}
+
+void test_cutoff_radius_bounds_the_attenuation() {
+    for (int model = INVERSE_LINEAR_DISSIPATION; model < NUMBER_OF_DISSIPATION_MODELS; model++) {
+        const double radius = cutoff_radius(model, 0.001);
+        TEST_ASSERT(attenuation(model, radius) <= 0.001);
+        TEST_ASSERT(attenuation(model, radius - 1.0) > 0.001);
+    }
+    TEST_ASSERT(isinf(cutoff_radius(NO_DISSIPATION, 0.001)));
+    TEST_ASSERT(isinf(cutoff_radius(INVERSE_SQUARE_DISSIPATION, 0.0)));
+}
+
+void test_cutoff_changes_the_image_by_at_most_its_error() {
+    Universe *universes[2];
+    for (int i = 0; i < 2; i++) {
+        universes[i] = create_universe(160, 120, NULL);
+        universes[i]->layer_cache_budget = 0;
+        universes[i]->dissipation_model = GAUSSIAN_DISSIPATION;
+        universes[i]->cutoff_enabled = i;
+        // A few Oscillators in view and a ring around it, added after the first update so that they outgrow the share.
+        for (int j = 0; j < 64; j++) {
+            const double distance = j < 8 ? 10.0 * j : 560.0 + j;
+            universe_add_oscillator(universes[i], distance * cos(j), distance * sin(j) * 0.75, 1.0, DEFAULT_WAVELENGTH);
+            if (j == 8) {
+                update_universe_value_matrix(universes[i]);
+            }
+        }
+        update_universe_value_matrix(universes[i]);
+    }
+    TEST_ASSERT(universes[1]->cutoff_share_count == 64);
+    // The wave of the last Oscillator is cut off in view, as every pixel is within 100 pixels of the center of the view.
+    TEST_ASSERT(universes[1]->layers[63].cutoff_radius < 560.0 + 63.0 + 100.0);
+    double maximum_intensity = 0.0;
+    double maximum_difference = 0.0;
+    for (int y = 0; y < 120; y++) {
+        for (int x = 0; x < 160; x++) {
+            maximum_intensity = maximum(maximum_intensity, universes[0]->value_matrix[y][x]);
+            maximum_difference = maximum(maximum_difference, fabs(universes[1]->value_matrix[y][x] - universes[0]->value_matrix[y][x]));
+        }
+    }
+    // Together, the waves cut off at a pixel change it by at most the error.
+    TEST_ASSERT(maximum_difference * 255.0 / maximum_intensity <= DEFAULT_CUTOFF_ERROR);
+    delete_universe(universes[0]);
+    delete_universe(universes[1]);
+}
+
+void test_attenuation_rate_bounds_the_derivatives() {
+    const double h = 0.25;
+    for (int model = 0; model < NUMBER_OF_DISSIPATION_MODELS; model++) {
+        for (double r = 2.0 * DISSIPATION_START; r < 600.0; r += 7.3) {
+            const double f = attenuation(model, r);
+            const double rate = attenuation_rate(model, r);
+            const double first = (attenuation(model, r + h) - attenuation(model, r - h)) / (2.0 * h);
+            const double second = (attenuation(model, r + h) - 2.0 * f + attenuation(model, r - h)) / (h * h);
+            const double third = (attenuation(model, r + 2.0 * h) - 2.0 * attenuation(model, r + h) +
+                                  2.0 * attenuation(model, r - h) - attenuation(model, r - 2.0 * h)) / (2.0 * h * h * h);
+            TEST_ASSERT(fabs(first) <= 1.01 * f * rate + 1e-9);
+            TEST_ASSERT(fabs(second) <= 1.01 * f * rate * rate + 1e-9);
+            TEST_ASSERT(fabs(third) <= 1.01 * f * rate * rate * rate + 1e-6);
+        }
+    }
+}
+
+void test_spatial_index_maps_tiles_to_intersecting_disks() {
+    // A 4 by 4 grid of 10 pixel tiles covering [0, 40) x [0, 40).
+    SpatialIndex *index = create_spatial_index(0, 0, 40, 40, 10);
+    const double x[] = {5.0, 35.0, 100.0};
+    const double y[] = {5.0, 35.0, 100.0};
+    const double radius[] = {3.0, 10.0, INFINITY};
+    TEST_ASSERT(build_spatial_index(index, x, y, radius, 3) == 0);
+    // The first tile has the small disk and the unbounded one.
+    TEST_ASSERT(index->offsets[1] - index->offsets[0] == 2);
+    TEST_ASSERT(index->entries[index->offsets[0]] == 0);
+    TEST_ASSERT(index->entries[index->offsets[0] + 1] == 2);
+    // The last tile has the big disk and the unbounded one.
+    TEST_ASSERT(index->offsets[16] - index->offsets[15] == 2);
+    TEST_ASSERT(index->entries[index->offsets[15]] == 1);
+    // Every tile has the unbounded disk.
+    TEST_ASSERT(index->offsets[16] >= 16);
+    delete_spatial_index(index);
+}
+
+void test_fft_matches_the_discrete_fourier_transform() {
+    // 60 uses all preferred radices and 14 needs the generic butterfly.
+    const size_t sizes[] = {1, 14, 60};
+    for (size_t t = 0; t < 3; t++) {
+        const size_t size = sizes[t];
+        FFTPlan *plan = create_fft_plan(size);
+        double complex input[60];
+        double complex output[60];
+        double complex restored[60];
+        for (size_t i = 0; i < size; i++) {
+            input[i] = sin(i * 1.3) + I * cos(i * 0.7);
+        }
+        fft(plan, output, input, 0);
+        for (size_t k = 0; k < size; k++) {
+            double complex expected = 0.0;
+            for (size_t j = 0; j < size; j++) {
+                expected += input[j] * cexp(-I * TAU * ((j * k) % size) / size);
+            }
+            TEST_ASSERT(cabs(output[k] - expected) < 1e-9);
+        }
+        fft(plan, restored, output, 1);
+        for (size_t i = 0; i < size; i++) {
+            TEST_ASSERT(cabs(restored[i] / size - input[i]) < 1e-9);
+        }
+        delete_fft_plan(plan);
+    }
+}
+
+void test_convolution_reproduces_direct_evaluation() {
+    // Oscillators centered on pixels and between them, in view and out of it, all with the same wavelength.
+    const double centers[][2] = {{0.0, 0.0}, {-20.0, 11.0}, {17.0, -15.0}, {9.5, 3.25}, {-4.75, -12.5}, {70.0, 5.0}};
+    const size_t count = sizeof(centers) / sizeof(centers[0]);
+    for (int model = 0; model < NUMBER_OF_DISSIPATION_MODELS; model++) {
+        Universe *universes[2];
+        const EvaluationMode modes[2] = {DIRECT_EVALUATION, CONVOLUTION_EVALUATION};
+        for (int i = 0; i < 2; i++) {
+            universes[i] = create_universe(61, 47, NULL);
+            // Without cached Layers, every Oscillator is evaluated according to the mode.
+            universes[i]->layer_cache_budget = 0;
+            universes[i]->evaluation_mode = modes[i];
+            universes[i]->dissipation_model = (DissipationModel) model;
+            for (size_t j = 0; j < count; j++) {
+                universe_add_oscillator(universes[i], centers[j][0], centers[j][1], 1.0 + j, DEFAULT_WAVELENGTH);
+            }
+            update_universe_value_matrix(universes[i]);
+        }
+        double maximum_intensity = 0.0;
+        double maximum_difference = 0.0;
+        for (int y = 0; y < 47; y++) {
+            for (int x = 0; x < 61; x++) {
+                maximum_intensity = maximum(maximum_intensity, universes[0]->value_matrix[y][x]);
+                maximum_difference = maximum(maximum_difference, fabs(universes[1]->value_matrix[y][x] - universes[0]->value_matrix[y][x]));
+            }
+        }
+        // Far below a quantization step of the normalized image.
+        TEST_ASSERT(maximum_intensity > 0.0);
+        TEST_ASSERT(maximum_difference <= 1e-3 * maximum_intensity / 255.0);
+        delete_universe(universes[0]);
+        delete_universe(universes[1]);
+    }
+}
+
+void test_next_fft_size_only_has_small_prime_factors() {
+    TEST_ASSERT(next_fft_size(0) == 1);
+    TEST_ASSERT(next_fft_size(7) == 8);
+    TEST_ASSERT(next_fft_size(999) == 1000);
+    TEST_ASSERT(next_fft_size(1001) == 1024);
+}
+
+void test_cluster_tree_nodes_contain_their_sources() {
+    double x[100];
+    double y[100];
+    double amplitude[100];
+    size_t indices[100];
+    for (int i = 0; i < 100; i++) {
+        x[i] = (i * 37) % 101;
+        y[i] = (i * 59) % 97;
+        amplitude[i] = 1.0;
+        indices[i] = i;
+    }
+    ClusterTree *tree = build_cluster_tree(x, y, amplitude, indices, 100);
+    TEST_ASSERT(tree->nodes[0].count == 100);
+    TEST_ASSERT(tree->nodes[0].amplitude == 100.0);
+    TEST_ASSERT(!is_cluster_leaf(&tree->nodes[0]));
+    for (size_t n = 0; n < tree->node_count; n++) {
+        const ClusterNode *node = &tree->nodes[n];
+        TEST_ASSERT(!is_cluster_leaf(node) || node->count <= CLUSTER_TREE_LEAF_SIZE);
+        for (size_t i = node->first; i < node->first + node->count; i++) {
+            TEST_ASSERT(x[tree->order[i]] == tree->x[i]);
+            TEST_ASSERT(distance(node->center_x, node->center_y, tree->x[i], tree->y[i]) <= node->radius);
+        }
+    }
+    delete_cluster_tree(tree);
+}
+
+void test_far_field_is_within_its_error_bound() {
+    const double x[] = {0.0, 3.5, -4.0, 2.25, 5.0};
+    const double y[] = {0.0, -2.0, 1.75, 4.0, 5.0};
+    const double amplitude[] = {1.0, 0.5, 2.0, 1.5, 1.0};
+    const size_t indices[] = {0, 1, 2, 3, 4};
+    ClusterTree *tree = build_cluster_tree(x, y, amplitude, indices, 5);
+    const ClusterNode *node = &tree->nodes[0];
+    const double wave_number = TAU / 50.0;
+    FarField far_field;
+    compute_far_field(tree, node, wave_number, 300.0, 200.0, &far_field);
+    const double bound = node->amplitude * far_field_error_bound(node, wave_number, 300.0, 12.0);
+    for (int dy = 192; dy <= 208; dy += 4) {
+        for (int dx = 292; dx <= 308; dx += 4) {
+            double expected = 0.0;
+            for (size_t i = 0; i < 5; i++) {
+                const double r = distance(dx, dy, x[i] - node->center_x, y[i] - node->center_y);
+                expected += amplitude[i] * (1.0 + sin(wave_number * r)) / 2.0;
+            }
+            TEST_ASSERT(fabs(evaluate_far_field(&far_field, wave_number, dx, dy) - expected) <= bound);
+        }
+    }
+    delete_cluster_tree(tree);
+}
+
+void record_task(void *context, size_t index) {
+    ((int *) context)[index]++;
+}
+
+void test_run_parallel_runs_every_task_once() {
+    ThreadPool *pool = create_thread_pool(4);
+    int counts[100] = {0};
+    for (int i = 0; i < 10; i++) {
+        run_parallel(pool, record_task, counts, 100);
+    }
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT(counts[i] == 10);
+    }
+    delete_thread_pool(pool);
+}
+
+void test_fdtd_pulse_spreads_symmetrically_around_obstacles() {
+    ThreadPool *pool = create_thread_pool(3);
+    FDTDSimulation *simulation = create_fdtd_simulation(41, 41, pool);
+    set_fdtd_obstacle(simulation, 20, 10, 1);
+    set_fdtd_obstacle(simulation, 10, 20, 1);
+    update_fdtd_coefficients(simulation);
+    add_to_fdtd_field(simulation, 20, 20, 1.0f);
+    for (int i = 0; i < 40; i++) {
+        step_fdtd(simulation);
+    }
+    TEST_ASSERT(get_fdtd_value(simulation, 20, 10) == 0.0f);
+    TEST_ASSERT(get_fdtd_value(simulation, 20, 0) != 0.0f);
+    for (int y = 0; y < 41; y++) {
+        for (int x = 0; x < 41; x++) {
+            // The obstacles are placed symmetrically with respect to the diagonal.
+            TEST_ASSERT(fabs(get_fdtd_value(simulation, x, y) - get_fdtd_value(simulation, y, x)) < 1e-6);
+        }
+    }
+    delete_fdtd_simulation(simulation);
+    delete_thread_pool(pool);
+}
+
+void test_radial_tables_interpolate_fractional_distances() {
+    CachedGeometry *geometry = create_cached_geometry(NULL, DEFAULT_CACHED_GEOMETRY_MAXIMUM);
+    for (double radius = 0.0; radius < 700.0; radius += 0.37) {
+        TEST_ASSERT(fabs(sin_of_radius(geometry, radius, DEFAULT_WAVELENGTH) - sin(radius * TAU / DEFAULT_WAVELENGTH)) < 1e-4);
+        for (int model = 0; model < NUMBER_OF_DISSIPATION_MODELS; model++) {
+            TEST_ASSERT(fabs(attenuation_of_radius(geometry, model, radius) - attenuation(model, radius)) < 1e-4);
+        }
+    }
+    delete_cached_geometry(geometry);
+}
+
+void test_cached_geometry_grows_and_evaluates_offsets_beyond_it() {
+    CachedGeometry *geometry = create_cached_geometry(NULL, DEFAULT_CACHED_GEOMETRY_MAXIMUM);
+    const double before = sin_of_distance(geometry, 100, 37, DEFAULT_WAVELENGTH);
+    TEST_ASSERT(grow_cached_geometry(geometry, 1000) == 0);
+    TEST_ASSERT(is_offset_in_cache(geometry, 1000, 1000));
+    TEST_ASSERT(sin_of_distance(geometry, 100, 37, DEFAULT_WAVELENGTH) == before);
+    const double expected = sin(distance_to_origin(900, 3) * TAU / DEFAULT_WAVELENGTH);
+    TEST_ASSERT(fabs(sin_of_distance(geometry, 900, 3, DEFAULT_WAVELENGTH) - expected) < 1e-12);
+    double sines[64];
+    evaluate_sin_of_distances(sines, 64, -100000.5, 37.0, 12345.0, 7.3);
+    for (int i = 0; i < 64; i++) {
+        const double radius = sqrt(square(-100000.5 + 37.0 * i) + square(12345.0));
+        TEST_ASSERT(fabs(sines[i] - sin(radius * TAU / 7.3)) < 1e-9);
+    }
+    delete_cached_geometry(geometry);
+}
+
+void test_grown_cached_geometry_is_filled_lazily_and_warmed_up() {
+    CachedGeometry *geometry = create_cached_geometry(NULL, DEFAULT_CACHED_GEOMETRY_MAXIMUM);
+    TEST_ASSERT(grow_cached_geometry(geometry, 1000) == 0);
+    const int cache_maximum = geometry->offset_table_maximum;
+    TEST_ASSERT(geometry->offset_row_ends[900] == 0);
+    const double expected = sin(distance_to_origin(3, 900) * TAU / DEFAULT_WAVELENGTH);
+    TEST_ASSERT(fabs(sin_of_distance(geometry, 3, 900, DEFAULT_WAVELENGTH) - expected) < 1e-12);
+    TEST_ASSERT(geometry->offset_row_ends[900] == cache_maximum + 1);
+    TEST_ASSERT(geometry->offset_row_ends[901] == 0);
+    ThreadPool *pool = create_thread_pool(4);
+    warm_cached_geometry(geometry, pool);
+    delete_thread_pool(pool);
+    for (int y = 0; y <= cache_maximum; y += 7) {
+        TEST_ASSERT(geometry->offset_row_ends[y] == cache_maximum + 1);
+        for (int x = 0; x <= cache_maximum; x += 13) {
+            const double distance = distance_to_origin(x, y);
+            const size_t index = (size_t) y * (cache_maximum + 1) + x;
+            TEST_ASSERT(fetch_sin_of_distance(geometry, x, y) == sin(distance * TAU / DEFAULT_WAVELENGTH));
+            TEST_ASSERT(geometry->offset_tables[ATTENUATION_TABLE(0)][index] == attenuation(0, distance));
+        }
+    }
+    for (int i = 0; i < geometry->radial_table_size; i += 101) {
+        const double radius = (double) i / RADIAL_TABLE_RESOLUTION;
+        TEST_ASSERT(geometry->radial_tables[SINE_TABLE][i] == sin(radius * TAU / DEFAULT_WAVELENGTH));
+    }
+    delete_cached_geometry(geometry);
+}
+
+void test_generated_tables_match_the_evaluated_values() {
+    CachedGeometry *geometry = create_cached_geometry(NULL, DEFAULT_CACHED_GEOMETRY_MAXIMUM);
+    TEST_ASSERT(geometry->offset_tables[SINE_TABLE] == GENERATED_OFFSET_TABLES[SINE_TABLE]);
+    // Reading the generated sine does not fill the attenuation tables, which are filled on first use.
+    TEST_ASSERT(sin_of_distance(geometry, 3, 0, DEFAULT_WAVELENGTH) == sin(3.0 * TAU / DEFAULT_WAVELENGTH));
+    TEST_ASSERT(atomic_load(&geometry->offset_row_ends[0]) == 0);
+    for (int y = 0; y <= GENERATED_TABLES_MAXIMUM; y += 31) {
+        for (int x = 0; x <= GENERATED_TABLES_MAXIMUM; x += 17) {
+            const double distance = distance_to_origin(x, y);
+            TEST_ASSERT(sin_of_distance(geometry, x, y, DEFAULT_WAVELENGTH) == sin(distance * TAU / DEFAULT_WAVELENGTH));
+            for (int model = 0; model < NUMBER_OF_DISSIPATION_MODELS; model++) {
+                TEST_ASSERT(attenuation_of_offset(geometry, model, x, y) == attenuation(model, distance));
+            }
+        }
+    }
+    delete_cached_geometry(geometry);
+}
+
+void test_cached_geometry_is_persisted_and_mapped() {
+    char directory[] = "/tmp/waves-autotest-XXXXXX";
+    TEST_ASSERT(mkdtemp(directory) != NULL);
+    CachedGeometry *geometry = create_cached_geometry(directory, 600);
+    TEST_ASSERT(geometry->maximum == 768);
+    TEST_ASSERT(geometry->offset_table_storage == MAPPED_TABLES);
+    const double evaluated = sin_of_distance(geometry, 700, 300, DEFAULT_WAVELENGTH);
+    // Another engine maps the same file.
+    CachedGeometry *other = create_cached_geometry(directory, 600);
+    TEST_ASSERT(other->offset_table_storage == MAPPED_TABLES);
+    TEST_ASSERT(other->mapping != geometry->mapping);
+    TEST_ASSERT(sin_of_distance(other, 700, 300, DEFAULT_WAVELENGTH) == evaluated);
+    delete_cached_geometry(other);
+    // A corrupted file is not mapped, but evaluated and written again.
+    char path[4096];
+    TEST_ASSERT(get_geometry_cache_path(geometry, path, sizeof(path), 768) == 0);
+    FILE *file = fopen(path, "r+b");
+    TEST_ASSERT(file != NULL);
+    fseek(file, sizeof(GeometryCacheHeader) + 8, SEEK_SET);
+    const int byte = fgetc(file);
+    fseek(file, sizeof(GeometryCacheHeader) + 8, SEEK_SET);
+    fputc(byte ^ 0xFF, file);
+    fclose(file);
+    TEST_ASSERT(map_cached_geometry(geometry, 768) != 0);
+    delete_cached_geometry(geometry);
+    geometry = create_cached_geometry(directory, 600);
+    TEST_ASSERT(geometry->offset_table_storage == MAPPED_TABLES);
+    TEST_ASSERT(sin_of_distance(geometry, 700, 300, DEFAULT_WAVELENGTH) == evaluated);
+    delete_cached_geometry(geometry);
+    remove(path);
+    rmdir(directory);
+}
+
+void test_persisted_geometry_keeps_the_most_recently_used_files() {
+    char directory[] = "/tmp/waves-autotest-XXXXXX";
+    TEST_ASSERT(mkdtemp(directory) != NULL);
+    // Files of older sizes, used one after the other long ago, a file of another version, and an unrelated file.
+    const char *names[] = {"geometry-1024-v1.cache", "geometry-1280-v1.cache", "geometry-1536-v1.cache",
+                           "geometry-1792-v1.cache", "geometry-2048-v1.cache", "geometry-768-v0.cache", "notes.txt"};
+    const size_t name_count = sizeof(names) / sizeof(names[0]);
+    char path[4096];
+    for (size_t i = 0; i < name_count; i++) {
+        snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+        fclose(fopen(path, "w"));
+        const struct timespec times[2] = {{1000 + (time_t) i, 0}, {1000 + (time_t) i, 0}};
+        utimensat(AT_FDCWD, path, times, 0);
+    }
+    CachedGeometry *geometry = create_cached_geometry(directory, 600);
+    TEST_ASSERT(geometry->offset_table_storage == MAPPED_TABLES);
+    delete_cached_geometry(geometry);
+    // The file just written and the three most recently used ones are kept.
+    const int kept[] = {0, 0, 1, 1, 1, 0, 1};
+    for (size_t i = 0; i < name_count; i++) {
+        snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+        TEST_ASSERT(access(path, F_OK) == (kept[i] ? 0 : -1));
+        remove(path);
+    }
+    snprintf(path, sizeof(path), "%s/geometry-768-v%d.cache", directory, GEOMETRY_CACHE_FILE_VERSION);
+    TEST_ASSERT(access(path, F_OK) == 0);
+    remove(path);
+    rmdir(directory);
+}
+
+/**
+ * Grows the CachedGeometry of an engine far beyond the default window and reads it.
+ */
+void *use_engine_geometry(void *argument) {
+    CachedGeometry *geometry = argument;
+    grow_cached_geometry(geometry, 900);
+    for (int y = 0; y <= 900; y += 3) {
+        for (int x = 0; x <= 900; x += 5) {
+            const double expected = sin(distance_to_origin(x, y) * TAU / DEFAULT_WAVELENGTH);
+            if (fabs(sin_of_distance(geometry, x, y, DEFAULT_WAVELENGTH) - expected) > 1e-12) {
+                return argument;
+            }
+        }
+    }
+    return NULL;
+}
+
+void test_engines_use_their_own_cached_geometry_concurrently() {
+    CachedGeometry *geometries[2] = {create_cached_geometry(NULL, 500), create_cached_geometry(NULL, 500)};
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT(pthread_create(&threads[i], NULL, use_engine_geometry, geometries[i]) == 0);
+    }
+    for (int i = 0; i < 2; i++) {
+        void *failure;
+        pthread_join(threads[i], &failure);
+        TEST_ASSERT(failure == NULL);
+    }
+    // Each engine grew tables of its own, which the other translation unit reads just the same.
+    TEST_ASSERT(geometries[0]->radial_tables[SINE_TABLE] != geometries[1]->radial_tables[SINE_TABLE]);
+    const double value = sin_of_distance(geometries[0], 700, 300, DEFAULT_WAVELENGTH);
+    TEST_ASSERT(sin_of_distance_in_second_unit(geometries[1], 700, 300) == value);
+    delete_cached_geometry(geometries[0]);
+    delete_cached_geometry(geometries[1]);
+}
+
+void test_frame_cache_evicts_the_least_recently_used_frame() {
+    const uint32_t pixels[4] = {1, 2, 3, 4};
+    FrameCache *cache = create_frame_cache(2 * sizeof(pixels));
+    const uint64_t keys[3] = {hash_bytes(FRAME_HASH_SEED, "a", 1), hash_bytes(FRAME_HASH_SEED, "b", 1),
+                              hash_bytes(FRAME_HASH_SEED, "c", 1)};
+    TEST_ASSERT(store_frame(cache, keys[0], pixels, 4) == 0);
+    TEST_ASSERT(store_frame(cache, keys[1], pixels, 4) == 0);
+    // Using the first frame makes the second one the least recently used.
+    TEST_ASSERT(lookup_frame(cache, keys[0], 4) != NULL);
+    TEST_ASSERT(store_frame(cache, keys[2], pixels, 4) == 0);
+    TEST_ASSERT(cache->used <= cache->budget);
+    TEST_ASSERT(lookup_frame(cache, keys[1], 4) == NULL);
+    TEST_ASSERT(lookup_frame(cache, keys[2], 4)[3] == 4);
+    TEST_ASSERT(lookup_frame(cache, keys[0], 4)[0] == 1);
+    // Frames larger than the budget are not stored.
+    const uint32_t large_pixels[16] = {0};
+    TEST_ASSERT(store_frame(cache, keys[1], large_pixels, 16) != 0);
+    TEST_ASSERT(cache->frame_count == 2);
+    delete_frame_cache(cache);
+}
+
+void test_scene_lines_are_parsed_or_rejected() {
+    Scene *scene = create_scene();
+    char lines[][SCENE_LINE_SIZE] = {"# A comment\n", "  size 800 600 # Trailing comment\n", "dissipation gaussian\n",
+                                     "oscillator -12.5 40 0.75 55\r\n", "\n"};
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        TEST_ASSERT(parse_scene_line(scene, lines[i]) == NULL);
+    }
+    TEST_ASSERT(scene->width == 800 && scene->height == 600);
+    TEST_ASSERT(scene->dissipation_model == GAUSSIAN_DISSIPATION);
+    TEST_ASSERT(scene->oscillators->count == 1);
+    TEST_ASSERT(scene->oscillators->center_x[0] == -12.5);
+    TEST_ASSERT(scene->oscillators->wavelength[0] == 55.0);
+    char invalid_lines[][SCENE_LINE_SIZE] = {"size 800\n", "size 800.5 600\n", "size 0 600\n", "dissipation cubic\n",
+                                             "oscillator 1 2 3\n", "oscillator 1 2 3 0\n", "oscillator 1 2 -3 4\n",
+                                             "oscillator 1 2 3 4 5\n", "oscillator 1 2x 3 4\n", "oscillator 1 nan 3 4\n",
+                                             "wave 1 2\n"};
+    for (size_t i = 0; i < sizeof(invalid_lines) / sizeof(invalid_lines[0]); i++) {
+        TEST_ASSERT(parse_scene_line(scene, invalid_lines[i]) != NULL);
+    }
+    TEST_ASSERT(scene->width == 800 && scene->oscillators->count == 1);
+    delete_scene(scene);
+}
+
+void test_scenes_are_rendered_at_their_own_size() {
+    char text[] = "size 10 10\ndissipation exponential\noscillator 0 0 1 40\noscillator 3 2 0.5 7\n";
+    FILE *file = fmemopen(text, strlen(text), "r");
+    Scene *scene = read_scene(file, "small scene");
+    fclose(file);
+    TEST_ASSERT(scene != NULL && scene->width == 10 && scene->height == 10);
+    // Rendered as waves-render renders a scene which fits in memory.
+    Universe *universe = create_universe((uint16_t) scene->width, (uint16_t) scene->height, NULL);
+    universe->dissipation_model = scene->dissipation_model;
+    const OscillatorStore *oscillators = scene->oscillators;
+    for (size_t i = 0; i < oscillators->count; i++) {
+        universe_add_oscillator(universe, oscillators->center_x[i], oscillators->center_y[i], oscillators->amplitude[i],
+                                oscillators->wavelength[i]);
+    }
+    Controller *controller = create_controller(universe);
+    Display *display = create_headless_display(universe->width, universe->height, 0);
+    write_waves(display, controller, universe);
+    char path[] = "/tmp/waves-autotest-XXXXXX.ppm";
+    const int descriptor = mkstemps(path, 4);
+    TEST_ASSERT(descriptor != -1);
+    close(descriptor);
+    TEST_ASSERT(write_image_file(path, display->pixels, display->width, display->height) == 0);
+    file = fopen(path, "rb");
+    int width = 0;
+    int height = 0;
+    TEST_ASSERT(fscanf(file, "P6 %d %d 255", &width, &height) == 2);
+    TEST_ASSERT(width == 10 && height == 10);
+    // The pixels are gray levels of the sum of the dissipated waves, normalized by its maximum.
+    double expected[10][10];
+    double maximum_intensity = 0.0;
+    for (int y = 0; y < 10; y++) {
+        for (int x = 0; x < 10; x++) {
+            expected[y][x] = 0.0;
+            for (size_t i = 0; i < oscillators->count; i++) {
+                const double distance = distance_to_origin(x - 5 - oscillators->center_x[i], y - 5 - oscillators->center_y[i]);
+                const double wave = (sin(distance * TAU / oscillators->wavelength[i]) + 1.0) / 2.0;
+                expected[y][x] += oscillators->amplitude[i] * wave * attenuation(EXPONENTIAL_DISSIPATION, distance);
+            }
+            maximum_intensity = maximum(maximum_intensity, expected[y][x]);
+        }
+    }
+    fgetc(file);
+    for (int y = 0; y < 10; y++) {
+        for (int x = 0; x < 10; x++) {
+            unsigned char pixel[3];
+            TEST_ASSERT(fread(pixel, 1, 3, file) == 3);
+            TEST_ASSERT(pixel[0] == pixel[1] && pixel[1] == pixel[2]);
+            // Truncating the quantized value may round either way of an exact boundary.
+            TEST_ASSERT(abs(pixel[0] - (int) (255 * expected[y][x] / maximum_intensity)) <= 1);
+        }
+    }
+    fclose(file);
+    remove(path);
+    delete_display(display);
+    free(controller);
+    delete_universe(universe);
+    delete_scene(scene);
+}
+
+void test_scene_templates_expand_every_variant() {
+    SceneParameter parameters[2];
+    TEST_ASSERT(parse_scene_parameter("wavelength=20:40:10", &parameters[0]) == 0);
+    TEST_ASSERT(parse_scene_parameter("x=0.5", &parameters[1]) == 0);
+    TEST_ASSERT(parameters[0].count == 3 && parameters[1].count == 1);
+    TEST_ASSERT(parse_scene_parameter("y=0:1:0.1", &parameters[1]) == 0);
+    TEST_ASSERT(parameters[1].count == 11);
+    const char *invalid_parameters[] = {"=1", "x", "x=1:2", "x=1:2:0", "x=2:1:1", "x=1:2:1:1", "x-y=1", "x=nan"};
+    for (size_t i = 0; i < sizeof(invalid_parameters) / sizeof(invalid_parameters[0]); i++) {
+        SceneParameter parameter;
+        TEST_ASSERT(parse_scene_parameter(invalid_parameters[i], &parameter) != 0);
+    }
+    TEST_ASSERT(count_scene_variants(parameters, 2) == 33);
+    double values[2];
+    get_scene_variant(parameters, 2, 12, values);
+    TEST_ASSERT(values[0] == 30.0 && values[1] == 0.1);
+    char *text = expand_scene_template("oscillator ${y} 0 1 ${wavelength}\n", parameters, 2, values);
+    Scene *scene = create_scene();
+    TEST_ASSERT(text != NULL && parse_scene_line(scene, text) == NULL);
+    TEST_ASSERT(scene->oscillators->center_x[0] == 0.1 && scene->oscillators->wavelength[0] == 30.0);
+    delete_scene(scene);
+    free(text);
+    TEST_ASSERT(expand_scene_template("size ${z} 10\n", parameters, 2, values) == NULL);
+    TEST_ASSERT(expand_scene_template("size ${y 10\n", parameters, 2, values) == NULL);
+}
+
+void test_image_checksums_match_known_values() {
+    uint32_t table[256];
+    make_crc32_table(table);
+    TEST_ASSERT(update_crc32(table, 0, (const unsigned char *) "123456789", 9) == 0xCBF43926u);
+    TEST_ASSERT(update_crc32(table, update_crc32(table, 0, (const unsigned char *) "1234", 4),
+                             (const unsigned char *) "56789", 5) == 0xCBF43926u);
+    TEST_ASSERT(update_adler32(1, (const unsigned char *) "Wikipedia", 9) == 0x11E60398u);
+    // Long runs of large bytes are reduced before they overflow.
+    unsigned char *ones = malloc(100000);
+    memset(ones, 0xFF, 100000);
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < 100000; i++) {
+        a = (a + 0xFF) % 65521;
+        b = (b + a) % 65521;
+    }
+    TEST_ASSERT(update_adler32(1, ones, 100000) == (b << 16 | a));
+    free(ones);
+}
+
+void test_png_rows_are_stored_in_blocks() {
+    // Rows of 30000 pixels span several stored blocks.
+    const int width = 30000;
+    uint32_t *row = malloc(width * sizeof(uint32_t));
+    for (int x = 0; x < width; x++) {
+        row[x] = 0xFF000000u | (uint32_t) x;
+    }
+    FILE *file = tmpfile();
+    TEST_ASSERT(file != NULL);
+    ImageWriter *writer = create_image_writer(file, PNG_IMAGE, width, 2);
+    write_image_row(writer, row);
+    write_image_row(writer, row);
+    TEST_ASSERT(finish_image_writer(writer) == 0);
+    const size_t row_size = 1 + 3 * (size_t) width;
+    const size_t block_count = (2 * row_size + STORED_BLOCK_SIZE - 1) / STORED_BLOCK_SIZE;
+    const long expected_size = 8 + 25 + 2 + (long) block_count * (12 + 5) + (long) (2 * row_size) + 4 + 12;
+    TEST_ASSERT(ftell(file) == expected_size);
+    // The last pixel of the second row is the last pixel data before the checksums and the IEND chunk.
+    unsigned char tail[3];
+    fseek(file, expected_size - 12 - 4 - 4 - 3, SEEK_SET);
+    TEST_ASSERT(fread(tail, 1, 3, file) == 3);
+    TEST_ASSERT(tail[0] == 0x00 && tail[1] == (unsigned char) ((width - 1) >> 8) && tail[2] == (unsigned char) (width - 1));
+    fclose(file);
+    free(row);
+}
+
+void test_video_capture_writes_y4m_frames_and_drops_unclaimed_ones() {
+    char path[] = "/tmp/waves-autotest-XXXXXX.y4m";
+    const int descriptor = mkstemps(path, 4);
+    TEST_ASSERT(descriptor != -1);
+    close(descriptor);
+    VideoCapture *capture = create_video_capture(path, 2, 1, 10);
+    TEST_ASSERT(capture != NULL && capture->format == Y4M_VIDEO);
+    for (int i = 0; i < 3; i++) {
+        uint32_t *frame = begin_video_frame(capture);
+        TEST_ASSERT(frame != NULL);
+        // Only one frame may be filled at a time, so a second one is dropped.
+        TEST_ASSERT(begin_video_frame(capture) == NULL);
+        frame[0] = 0xFF000000u;
+        frame[1] = 0xFFFFFFFFu;
+        end_video_frame(capture);
+    }
+    TEST_ASSERT(stop_video_capture(capture) == 0);
+    TEST_ASSERT(capture->captured_count == 6 && capture->written_count == 3 && capture->dropped_count == 3);
+    delete_video_capture(capture);
+    FILE *file = fopen(path, "rb");
+    char header[64];
+    TEST_ASSERT(fgets(header, sizeof(header), file) != NULL);
+    TEST_ASSERT(strcmp(header, "YUV4MPEG2 W2 H1 F10:1 Ip A1:1 C444\n") == 0);
+    unsigned char frame[6 + 6];
+    TEST_ASSERT(fread(frame, 1, sizeof(frame), file) == sizeof(frame));
+    TEST_ASSERT(memcmp(frame, "FRAME\n", 6) == 0);
+    // Black and white have the extremes of the luma and no chroma.
+    const unsigned char planes[6] = {16, 235, 128, 128, 128, 128};
+    TEST_ASSERT(memcmp(frame + 6, planes, sizeof(planes)) == 0);
+    fseek(file, 0, SEEK_END);
+    TEST_ASSERT(ftell(file) == (long) strlen(header) + 3 * 12);
+    fclose(file);
+    remove(path);
+}
+
 int main() {
     UNITY_BEGIN();
     RUN_TEST(test_minimum_works_as_expected);
     RUN_TEST(test_maximum_works_as_expected);
+    RUN_TEST(test_oscillator_store_grows_as_needed);
+    RUN_TEST(test_oscillator_store_removal_swaps_the_last_oscillator_in);
+    RUN_TEST(test_cutoff_radius_bounds_the_attenuation);
+    RUN_TEST(test_cutoff_changes_the_image_by_at_most_its_error);
+    RUN_TEST(test_attenuation_rate_bounds_the_derivatives);
+    RUN_TEST(test_spatial_index_maps_tiles_to_intersecting_disks);
+    RUN_TEST(test_fft_matches_the_discrete_fourier_transform);
+    RUN_TEST(test_next_fft_size_only_has_small_prime_factors);
+    RUN_TEST(test_convolution_reproduces_direct_evaluation);
+    RUN_TEST(test_cluster_tree_nodes_contain_their_sources);
+    RUN_TEST(test_far_field_is_within_its_error_bound);
+    RUN_TEST(test_run_parallel_runs_every_task_once);
+    RUN_TEST(test_fdtd_pulse_spreads_symmetrically_around_obstacles);
+    RUN_TEST(test_radial_tables_interpolate_fractional_distances);
+    RUN_TEST(test_cached_geometry_grows_and_evaluates_offsets_beyond_it);
+    RUN_TEST(test_grown_cached_geometry_is_filled_lazily_and_warmed_up);
+    RUN_TEST(test_generated_tables_match_the_evaluated_values);
+    RUN_TEST(test_cached_geometry_is_persisted_and_mapped);
+    RUN_TEST(test_persisted_geometry_keeps_the_most_recently_used_files);
+    RUN_TEST(test_engines_use_their_own_cached_geometry_concurrently);
+    RUN_TEST(test_frame_cache_evicts_the_least_recently_used_frame);
+    RUN_TEST(test_scene_lines_are_parsed_or_rejected);
+    RUN_TEST(test_scenes_are_rendered_at_their_own_size);
+    RUN_TEST(test_scene_templates_expand_every_variant);
+    RUN_TEST(test_image_checksums_match_known_values);
+    RUN_TEST(test_png_rows_are_stored_in_blocks);
+    RUN_TEST(test_video_capture_writes_y4m_frames_and_drops_unclaimed_ones);
     return UNITY_END();
 }
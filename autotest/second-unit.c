@@ -0,0 +1,28 @@
+// A second translation unit which includes every header of the library.
+//
+// It only links if the headers define nothing with external linkage, so that
+// the library can be included from several translation units of a program.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#include "cached-geometry.h"
+#include "cluster-tree.h"
+#include "constants.h"
+#include "dissipation.h"
+#include "fdtd.h"
+#include "fft.h"
+#include "frame-cache.h"
+#include "geometry-cache-file.h"
+#include "geometry-tables.h"
+#include "geometry.h"
+#include "image-file.h"
+#include "logger.h"
+#include "oscillator-store.h"
+#include "scene.h"
+#include "spatial-index.h"
+#include "thread-pool.h"
+#include "video-capture.h"
+
+double sin_of_distance_in_second_unit(const CachedGeometry * const geometry, int x, int y) {
+    return sin_of_distance(geometry, x, y, DEFAULT_WAVELENGTH);
+}
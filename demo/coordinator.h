@@ -0,0 +1,435 @@
+// A coordinator of the worker processes which render the tiles of a frame.
+//
+// The frame is split into tiles, each rendered by a process of waves-render
+// run with -r on the same host. The processes share nothing but files in a
+// private directory: each worker writes its tile, or the estimated maximum of
+// its tile, to a file of its own and exits with 0 once the file is complete. A
+// worker which fails, is killed, or exceeds the timeout is run again, up to
+// MAXIMUM_TILE_ATTEMPTS times. Once every tile is done, the tiles are read back
+// row by row into the image, so the coordinator only holds a row of it.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "image-file.h"
+
+extern char **environ;
+
+/**
+ * By default, the width and the height of the tiles of a coordinated render.
+ */
+#define DEFAULT_TILE_SIZE 1024
+
+/**
+ * How many times a tile is dispatched before the render is abandoned.
+ */
+#define MAXIMUM_TILE_ATTEMPTS 3
+
+/**
+ * How long the coordinator sleeps when no worker has finished, in milliseconds.
+ */
+#define WORKER_POLL_INTERVAL 10
+
+/**
+ * A rectangle of the frame, whose top-left pixel is (left, top).
+ */
+typedef struct Region {
+    int left;
+    int top;
+    int width;
+    int height;
+} Region;
+
+typedef struct Tile {
+    Region region;
+    int attempts; // How many times the tile was dispatched in the current pass.
+} Tile;
+
+typedef struct Coordination {
+    const char *executable; // The worker, which is waves-render or a wrapper which runs it.
+    const char *scene_path;
+    int frame_width;
+    int frame_height;
+    int tile_size;
+    size_t worker_count;
+    size_t thread_count; // The threads of each worker, 0 for every processor.
+    long memory_budget; // The memory budget of each worker, in mebibytes.
+    int timeout; // How long a worker may take, in seconds, 0 for no limit.
+    int estimating; // Whether or not the maximum is estimated by a first pass of the workers.
+    double maximum_intensity; // The maximum the tiles are normalized by, unless it is estimated.
+} Coordination;
+
+typedef struct Worker {
+    pid_t pid; // Zero if the slot is free.
+    size_t tile;
+    struct timespec start;
+    int killed; // Whether or not the worker was killed for exceeding the timeout.
+} Worker;
+
+/**
+ * Parses a region of the form LEFT,TOP,WIDTH,HEIGHT.
+ *
+ * Returns 0 if the region was valid.
+ */
+static inline int parse_region(const char *argument, Region *region) {
+    int length = 0;
+    if (sscanf(argument, "%d,%d,%d,%d%n", &region->left, &region->top, &region->width, &region->height, &length) != 4 ||
+        argument[length] != '\0') {
+        return 1;
+    }
+    return region->left < 0 || region->top < 0 || region->width < 1 || region->height < 1;
+}
+
+static inline void get_tile_path(const char *directory, const size_t tile, const int estimating, char *path, size_t size) {
+    snprintf(path, size, "%s/tile-%zu.%s", directory, tile, estimating ? "max" : "ppm");
+}
+
+/**
+ * Reads the maximum a worker estimated for its tile.
+ *
+ * Returns 0 if the file held a single finite number.
+ */
+static inline int read_estimated_maximum(const char *path, double *maximum_intensity) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 1;
+    }
+    char text[64];
+    const int read = fgets(text, sizeof(text), file) != NULL;
+    fclose(file);
+    char *end;
+    *maximum_intensity = read ? strtod(text, &end) : 0.0;
+    return !read || end == text || *end != '\n' || !isfinite(*maximum_intensity);
+}
+
+/**
+ * Opens the PPM file of a tile and skips its header, checking that it holds the whole region.
+ *
+ * Returns NULL if it does not.
+ */
+static inline FILE *open_tile_image(const char *path, const Region *region) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    int width;
+    int height;
+    int maximum_value;
+    if (fscanf(file, "P6 %d %d %d", &width, &height, &maximum_value) != 3 || fgetc(file) != '\n' ||
+        width != region->width || height != region->height || maximum_value != 255) {
+        fclose(file);
+        return NULL;
+    }
+    const long header_size = ftell(file);
+    fseek(file, 0, SEEK_END);
+    const long expected_size = header_size + 3L * region->width * region->height;
+    if (ftell(file) != expected_size) {
+        fclose(file);
+        return NULL;
+    }
+    fseek(file, header_size, SEEK_SET);
+    return file;
+}
+
+static inline int is_tile_complete(const char *path, const Region *region, const int estimating) {
+    if (estimating) {
+        double maximum_intensity;
+        return read_estimated_maximum(path, &maximum_intensity) == 0;
+    }
+    FILE *file = open_tile_image(path, region);
+    if (file == NULL) {
+        return 0;
+    }
+    fclose(file);
+    return 1;
+}
+
+/**
+ * Starts a worker which renders the tile, or estimates its maximum, into the file at the path.
+ *
+ * Its output is discarded. Returns its process identifier, or -1 if it could not be started.
+ */
+static inline pid_t start_worker(const Coordination *coordination, const Tile *tile, const char *path) {
+    char threads[32];
+    char memory[32];
+    char size[32];
+    char region[64];
+    char maximum_intensity[64];
+    snprintf(threads, sizeof(threads), "%zu", coordination->thread_count);
+    snprintf(memory, sizeof(memory), "%ld", coordination->memory_budget);
+    snprintf(size, sizeof(size), "%dx%d", coordination->frame_width, coordination->frame_height);
+    snprintf(region, sizeof(region), "%d,%d,%d,%d", tile->region.left, tile->region.top, tile->region.width,
+             tile->region.height);
+    // Hexadecimal floating-point preserves every bit of the maximum.
+    snprintf(maximum_intensity, sizeof(maximum_intensity), "%a", coordination->maximum_intensity);
+    char *arguments[16];
+    int count = 0;
+    arguments[count++] = (char *) coordination->executable;
+    if (coordination->thread_count != 0) {
+        arguments[count++] = "-t";
+        arguments[count++] = threads;
+    }
+    arguments[count++] = "-m";
+    arguments[count++] = memory;
+    arguments[count++] = "-s";
+    arguments[count++] = size;
+    arguments[count++] = "-r";
+    arguments[count++] = region;
+    if (coordination->estimating) {
+        arguments[count++] = "-e";
+    } else {
+        arguments[count++] = "-M";
+        arguments[count++] = maximum_intensity;
+    }
+    arguments[count++] = (char *) coordination->scene_path;
+    arguments[count++] = (char *) path;
+    arguments[count] = NULL;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    const int failed = posix_spawn(&pid, coordination->executable, &actions, NULL, arguments, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    return failed ? -1 : pid;
+}
+
+/**
+ * Records a failed attempt at a tile, queueing it again unless it failed too many times.
+ *
+ * Returns 0 if it was queued again.
+ */
+static inline int retry_tile(Tile *tiles, const size_t tile, size_t *queue, size_t *queue_end) {
+    tiles[tile].attempts++;
+    if (tiles[tile].attempts >= MAXIMUM_TILE_ATTEMPTS) {
+        printf("Tile %zu failed %d times, giving up\n", tile, tiles[tile].attempts);
+        return 1;
+    }
+    printf("Tile %zu failed, dispatching it again\n", tile);
+    queue[(*queue_end)++] = tile;
+    return 0;
+}
+
+/**
+ * Runs a pass of the workers over every tile, writing their files to the directory.
+ *
+ * Returns 0 if every tile was completed.
+ */
+static inline int run_workers(const Coordination *coordination, Tile *tiles, const size_t tile_count,
+                              const char *directory) {
+    // Every tile is queued at most MAXIMUM_TILE_ATTEMPTS times.
+    size_t *queue = malloc(tile_count * MAXIMUM_TILE_ATTEMPTS * sizeof(size_t));
+    Worker *workers = calloc(coordination->worker_count, sizeof(Worker));
+    size_t queue_begin = 0;
+    size_t queue_end = 0;
+    for (size_t i = 0; i < tile_count; i++) {
+        tiles[i].attempts = 0;
+        queue[queue_end++] = i;
+    }
+    size_t completed = 0;
+    size_t running = 0;
+    int failed = 0;
+    char path[4096];
+    while (!failed && completed < tile_count) {
+        for (size_t slot = 0; slot < coordination->worker_count && queue_begin < queue_end && !failed; slot++) {
+            if (workers[slot].pid != 0) {
+                continue;
+            }
+            const size_t tile = queue[queue_begin++];
+            get_tile_path(directory, tile, coordination->estimating, path, sizeof(path));
+            remove(path);
+            const pid_t pid = start_worker(coordination, &tiles[tile], path);
+            if (pid == -1) {
+                printf("Could not start %s\n", coordination->executable);
+                failed = retry_tile(tiles, tile, queue, &queue_end);
+                continue;
+            }
+            workers[slot].pid = pid;
+            workers[slot].tile = tile;
+            workers[slot].killed = 0;
+            clock_gettime(CLOCK_MONOTONIC, &workers[slot].start);
+            running++;
+        }
+        if (running == 0) {
+            continue;
+        }
+        // Only the workers of this pass are reaped, so other children of the process are left alone.
+        int reaped = 0;
+        for (size_t slot = 0; slot < coordination->worker_count; slot++) {
+            int status;
+            if (workers[slot].pid == 0 || waitpid(workers[slot].pid, &status, WNOHANG) != workers[slot].pid) {
+                continue;
+            }
+            const size_t tile = workers[slot].tile;
+            workers[slot].pid = 0;
+            running--;
+            reaped = 1;
+            get_tile_path(directory, tile, coordination->estimating, path, sizeof(path));
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+                is_tile_complete(path, &tiles[tile].region, coordination->estimating)) {
+                completed++;
+            } else if (!failed) {
+                failed = retry_tile(tiles, tile, queue, &queue_end);
+            }
+        }
+        if (reaped) {
+            continue;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (size_t slot = 0; slot < coordination->worker_count; slot++) {
+            const struct timespec start = workers[slot].start;
+            const double elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1000000000.0;
+            // A killed worker is reaped and dispatched again like any other failed one.
+            if (workers[slot].pid != 0 && !workers[slot].killed && coordination->timeout > 0 &&
+                elapsed >= coordination->timeout) {
+                printf("Tile %zu timed out\n", workers[slot].tile);
+                kill(workers[slot].pid, SIGKILL);
+                workers[slot].killed = 1;
+            }
+        }
+        const struct timespec interval = {0, WORKER_POLL_INTERVAL * 1000000L};
+        nanosleep(&interval, NULL);
+    }
+    // Workers still running when the pass is abandoned are stopped.
+    for (size_t slot = 0; slot < coordination->worker_count; slot++) {
+        if (workers[slot].pid != 0) {
+            kill(workers[slot].pid, SIGKILL);
+            waitpid(workers[slot].pid, NULL, 0);
+        }
+    }
+    free(queue);
+    free(workers);
+    return failed;
+}
+
+/**
+ * Writes the tiles in the directory to the path, a row of the frame at a time.
+ *
+ * Returns 0 if the image was written.
+ */
+static inline int assemble_tiles(const Coordination *coordination, const Tile *tiles, const size_t columns,
+                                 const size_t rows, const char *directory, const char *path, const ImageFormat format) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return 1;
+    }
+    ImageWriter *writer = create_image_writer(file, format, coordination->frame_width, coordination->frame_height);
+    FILE **tile_files = calloc(columns, sizeof(FILE *));
+    uint32_t *pixels = malloc((size_t) coordination->frame_width * sizeof(uint32_t));
+    unsigned char *bytes = malloc(3 * (size_t) coordination->tile_size);
+    int failed = writer == NULL || tile_files == NULL || pixels == NULL || bytes == NULL;
+    char tile_path[4096];
+    for (size_t row = 0; row < rows && !failed; row++) {
+        for (size_t column = 0; column < columns && !failed; column++) {
+            const Tile *tile = &tiles[row * columns + column];
+            get_tile_path(directory, row * columns + column, 0, tile_path, sizeof(tile_path));
+            tile_files[column] = open_tile_image(tile_path, &tile->region);
+            failed = tile_files[column] == NULL;
+        }
+        const int height = tiles[row * columns].region.height;
+        for (int y = 0; y < height && !failed; y++) {
+            for (size_t column = 0; column < columns && !failed; column++) {
+                const Region *region = &tiles[row * columns + column].region;
+                const size_t size = 3 * (size_t) region->width;
+                failed = fread(bytes, 1, size, tile_files[column]) != size;
+                for (int x = 0; x < region->width; x++) {
+                    pixels[region->left + x] = 0xFF000000u | (uint32_t) bytes[3 * x] << 16 |
+                                               (uint32_t) bytes[3 * x + 1] << 8 | bytes[3 * x + 2];
+                }
+            }
+            if (!failed) {
+                write_image_row(writer, pixels);
+            }
+        }
+        for (size_t column = 0; column < columns; column++) {
+            if (tile_files[column] != NULL) {
+                fclose(tile_files[column]);
+                tile_files[column] = NULL;
+            }
+        }
+    }
+    if (writer != NULL) {
+        failed = finish_image_writer(writer) || failed;
+    }
+    failed = fclose(file) != 0 || failed;
+    free(tile_files);
+    free(pixels);
+    free(bytes);
+    return failed;
+}
+
+/**
+ * Renders the frame on worker processes, tile by tile, and writes it to the path.
+ *
+ * When estimating, the tiles are normalized by the largest of the sampled
+ * maxima of the tiles, so the image matches a streamed render rather than one
+ * normalized by the exact maximum of a frame in memory.
+ *
+ * Returns 0 if the image was written.
+ */
+static inline int coordinate_render(Coordination *coordination, const char *path, const ImageFormat format) {
+    const char *temporary = getenv("TMPDIR");
+    char directory[1024];
+    snprintf(directory, sizeof(directory), "%s/waves-render-XXXXXX", temporary != NULL && *temporary != '\0' ? temporary : "/tmp");
+    if (mkdtemp(directory) == NULL) {
+        printf("Could not create a directory for the tiles\n");
+        return 1;
+    }
+    const size_t tile_size = (size_t) coordination->tile_size;
+    const size_t columns = (coordination->frame_width + tile_size - 1) / tile_size;
+    const size_t rows = (coordination->frame_height + tile_size - 1) / tile_size;
+    const size_t tile_count = columns * rows;
+    Tile *tiles = malloc(tile_count * sizeof(Tile));
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t column = 0; column < columns; column++) {
+            Region *region = &tiles[row * columns + column].region;
+            region->left = (int) (column * tile_size);
+            region->top = (int) (row * tile_size);
+            region->width = (int) minimum(tile_size, coordination->frame_width - region->left);
+            region->height = (int) minimum(tile_size, coordination->frame_height - region->top);
+        }
+    }
+    printf("Rendering %zu tiles on %zu workers\n", tile_count, coordination->worker_count);
+    int failed = 0;
+    char tile_path[4096];
+    if (coordination->estimating) {
+        failed = run_workers(coordination, tiles, tile_count, directory);
+        coordination->maximum_intensity = 0.0;
+        for (size_t i = 0; i < tile_count && !failed; i++) {
+            double maximum_intensity = 0.0;
+            get_tile_path(directory, i, 1, tile_path, sizeof(tile_path));
+            failed = read_estimated_maximum(tile_path, &maximum_intensity);
+            coordination->maximum_intensity = maximum(coordination->maximum_intensity, maximum_intensity);
+            remove(tile_path);
+        }
+        coordination->estimating = 0;
+        if (!failed) {
+            printf("Estimated the maximum as %g\n", coordination->maximum_intensity);
+        }
+    }
+    failed = failed || run_workers(coordination, tiles, tile_count, directory);
+    failed = failed || assemble_tiles(coordination, tiles, columns, rows, directory, path, format);
+    for (size_t i = 0; i < tile_count; i++) {
+        get_tile_path(directory, i, 0, tile_path, sizeof(tile_path));
+        remove(tile_path);
+        get_tile_path(directory, i, 1, tile_path, sizeof(tile_path));
+        remove(tile_path);
+    }
+    rmdir(directory);
+    free(tiles);
+    return failed;
+}
@@ -2,302 +2,411 @@
 //
 // Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
 
-#include "SDL.h"
+#include "window.h"
 
-#include <math.h>
-#include <stdio.h>
-#include <time.h>
-
-#include "cached-geometry.h"
-#include "constants.h"
-#include "geometry.h"
-
-#define DISSIPATION_START 10.0
+/**
+ * The number of resolutions frames may be computed at, each with half the width and the height of the previous one.
+ *
+ * Progressive refinement starts from the coarsest one.
+ */
+#define NUMBER_OF_RESOLUTIONS 4
 
 /**
- * The width of the window, in pixels.
+ * After this many milliseconds without input, a frame drawn at reduced resolution is redrawn at full resolution.
  */
-#define WIDTH 500
+const Uint32 IDLE_DELAY = 250;
 
 /**
- * The height of the window, in pixels.
+ * The longest the program waits for an event before checking whether a frame is due, in milliseconds.
  */
-#define HEIGHT 500
+const int EVENT_WAIT_TIMEOUT = 10;
 
-#define FRAMES_PER_SEC 10
+/**
+ * Where recordings go unless WAVES_CAPTURE says otherwise.
+ */
+const char * const DEFAULT_CAPTURE_PATH = "waves.y4m";
 
 /**
- * The maximum number of oscillators.
+ * Chooses the resolution of the frames drawn while the user interacts.
  *
- * Currently 10 so that each key from 1 to 0 match to one oscillator.
+ * Frames at the level n are computed with a stride of 2^n, at the pixels whose
+ * coordinates are multiples of the stride, and scaled up to the window. The
+ * level rises when a frame exceeds the frame budget and falls when a frame at
+ * the finer level is expected to fit it. Once input goes idle, the frame is
+ * redrawn at full resolution.
+ *
+ * With progressive refinement, frames instead start at the coarsest stride and
+ * the stride is halved by each pass until input arrives. The samples of a pass
+ * are a subset of the samples of the next one, so they are reused.
  */
-const int MAXIMUM_OSCILLATORS = 10;
-
-const double MINIMUM_AMPLITUDE = 0.1;
-const double DEFAULT_AMPLITUDE = 1.0;
-const double MAXIMUM_AMPLITUDE = 2.0;
-
-const double AMPLITUDE_TICK = 0.1;
-
-typedef struct Point {
-    int x;
-    int y;
-} Point;
-
-const Point ORIGIN = {0, 0};
+typedef struct Governor {
+    int level;
+    int stride; // The stride of the last frame, 1 if it was drawn at full resolution.
+    Uint32 last_input_ticks;
+    Uint32 frame_times[NUMBER_OF_RESOLUTIONS]; // The time the last frame at each level took, zero if there was none.
+    double **samples; // The values of the frames at reduced resolution, at their pixels.
+} Governor;
+
+Governor *create_governor(const Universe * const universe) {
+    Governor *governor = malloc(sizeof(Governor));
+    governor->level = 0;
+    governor->stride = 1;
+    governor->last_input_ticks = 0;
+    for (int i = 0; i < NUMBER_OF_RESOLUTIONS; i++) {
+        governor->frame_times[i] = 0;
+    }
+    governor->samples = create_matrix(universe->width, universe->height);
+    return governor;
+}
 
-typedef struct Oscillator {
-    Point center;
-    double amplitude;
-    double wavelength;
-} Oscillator;
+void delete_governor(Governor *governor, const Universe * const universe) {
+    delete_matrix(governor->samples, universe->height);
+    free(governor);
+}
 
-typedef enum DissipationModel {
-    NO_DISSIPATION,
-    INVERSE_LINEAR_DISSIPATION,
-    INVERSE_SQUARE_DISSIPATION,
-    NUMBER_OF_DISSIPATION_MODELS // Helper value
-} DissipationModel;
+/**
+ * Adapts the level of the Governor to the time the last interactive frame took.
+ */
+void govern_resolution(Governor *governor, const Uint32 frame_budget, const Uint32 elapsed) {
+    const int old_level = governor->level;
+    governor->frame_times[old_level] = elapsed;
+    if (elapsed > frame_budget && old_level + 1 < NUMBER_OF_RESOLUTIONS) {
+        governor->level++;
+    } else if (old_level > 0) {
+        // Full resolution frames may be incremental, so the time measured at the finer level is a better estimate
+        // than four times the time of this level, which has a quarter of its pixels.
+        const Uint32 finer_time = governor->frame_times[old_level - 1];
+        const Uint32 estimate = finer_time > 0 ? finer_time : 4 * elapsed;
+        if (estimate <= frame_budget) {
+            governor->level--;
+        }
+    }
+    if (governor->level != old_level) {
+        printf("Interactive resolution is now 1/%d\n", 1 << governor->level);
+    }
+}
 
 /**
- * Returns a human-readable string for a DissipationModel value.
+ * Draws a frame in response to input, at the resolution chosen by the Governor or at the coarsest one if refining progressively.
+ *
+ * Only superposition frames which are recomputed and not zoomed out can be reduced.
  */
-char *dissipation_model_to_string(DissipationModel model) {
-    if (model == NO_DISSIPATION) {
-        return "no dissipation";
-    } else if (model == INVERSE_LINEAR_DISSIPATION) {
-        return "inverse linear";
-    } else if (INVERSE_SQUARE_DISSIPATION) {
-        return "inverse square";
+void draw_interactive_frame(Display *display, Governor *governor, const Controller * const controller, Universe * const universe) {
+    const Uint32 start = SDL_GetTicks();
+    const int reducible = controller->rendering && universe->engine == SUPERPOSITION_ENGINE && universe->zoom >= 0;
+    const int level = controller->progressive ? NUMBER_OF_RESOLUTIONS - 1 : governor->level;
+    if (present_cached_frame(display, controller, universe)) {
+        // States which were drawn before need neither reduction nor refinement.
+        governor->stride = 1;
+        return;
+    }
+    if (reducible && level > 0) {
+        governor->stride = 1 << level;
+        write_samples(display, controller, universe, governor->samples, governor->stride, 0);
     } else {
-        return "unknown";
+        write_waves(display, controller, universe);
+        governor->stride = 1;
+    }
+    if (reducible && !controller->progressive) {
+        govern_resolution(governor, controller->frame_budget, SDL_GetTicks() - start);
     }
 }
 
-typedef struct Universe {
-    Uint16 width;
-    Uint16 height;
-    double **value_matrix;
-    DissipationModel dissipation_model;
-    Oscillator **oscillators;
-} Universe;
-
-const DissipationModel DEFAULT_UNIVERSE_DISSIPATION_MODEL = NO_DISSIPATION;
-
-typedef enum HighlightMode {
-    HIGHLIGHT_NONE, HIGHLIGHT_DOT
-} HighlightMode;
-
 /**
- * The structure responsible for modifying an Universe from user input.
+ * Returns whether or not the last frame should be refined, which requires that nothing changed since it was drawn.
  */
-typedef struct Controller {
-    Universe *universe;
-    size_t selection;
-    HighlightMode highlight;
-    int rendering; // Whether or not we are rendering.
-} Controller;
-
-SDL_Surface *get_empty_surface(Uint32 width, Uint32 height) {
-    return SDL_CreateRGBSurface(0, width, height, 32, 0, 0, 0, 0);
+int is_refinement_due(const Governor * const governor, const Controller * const controller, const Uint32 ticks) {
+    return governor->stride > 1 && (controller->progressive || ticks - governor->last_input_ticks >= IDLE_DELAY);
 }
 
 /**
- * Creates an oscillator at the origin.
+ * Refines the last frame, halving its stride if refining progressively and going straight to full resolution otherwise.
+ *
+ * A full resolution frame which fits the frame budget also returns interaction to full resolution.
  */
-Oscillator *create_oscillator() {
-    Oscillator *oscillator = malloc(sizeof(Oscillator));
-    oscillator->center = ORIGIN;
-    oscillator->amplitude = DEFAULT_AMPLITUDE;
-    oscillator->wavelength = DEFAULT_WAVELENGTH;
-    return oscillator;
+void draw_refined_frame(Display *display, Governor *governor, const Controller * const controller, Universe * const universe) {
+    if (controller->progressive && governor->stride > 2) {
+        governor->stride /= 2;
+        write_samples(display, controller, universe, governor->samples, governor->stride, 1);
+        return;
+    }
+    if (present_cached_frame(display, controller, universe)) {
+        // Presenting a cached frame says nothing about how long computing one takes.
+        governor->stride = 1;
+        return;
+    }
+    const Uint32 start = SDL_GetTicks();
+    write_waves(display, controller, universe);
+    governor->stride = 1;
+    const Uint32 elapsed = SDL_GetTicks() - start;
+    governor->frame_times[0] = elapsed;
+    if (governor->level > 0 && elapsed <= controller->frame_budget) {
+        governor->level = 0;
+        printf("Interactive resolution is now 1/1\n");
+    }
+}
+
+OscillatorStore *get_controller_store(Controller *controller) {
+    return controller->universe->oscillators;
+}
+
+void controller_move_up(Controller *controller, const double distance) {
+    get_controller_store(controller)->center_y[controller->selection] -= distance;
 }
 
-void delete_oscillator(Oscillator *oscillator) {
-    free(oscillator);
+void controller_move_left(Controller *controller, const double distance) {
+    get_controller_store(controller)->center_x[controller->selection] -= distance;
+}
+
+void controller_move_down(Controller *controller, const double distance) {
+    get_controller_store(controller)->center_y[controller->selection] += distance;
+}
+
+void controller_move_right(Controller *controller, const double distance) {
+    get_controller_store(controller)->center_x[controller->selection] += distance;
 }
 
 /**
- * Creates a Universe.
+ * Moves the selected Oscillator to a position of the window.
  */
-Universe *create_universe(const Uint16 width, const Uint16 height) {
-    Universe *universe = malloc(sizeof(Universe));
-
-    universe->width = width;
-    universe->height = height;
+void controller_move_to(Controller *controller, const double window_x, const double window_y) {
+    const Universe *universe = controller->universe;
+    OscillatorStore *store = universe->oscillators;
+    const double magnification = get_view_magnification(universe);
+    store->center_x[controller->selection] = (window_x - universe->width / 2) / magnification;
+    store->center_y[controller->selection] = (window_y - universe->height / 2) / magnification;
+}
 
-    // Initialize the value matrix
-    universe->value_matrix = malloc(height * sizeof(double*));
-    if (universe->value_matrix) {
-        for (Uint16 y = 0; y < height; y++) {
-            universe->value_matrix[y] = malloc(width * sizeof(double));
+/**
+ * Selects the Oscillator nearest to a position of the window, if it is within the SELECTION_RADIUS.
+ *
+ * Returns 0 if no Oscillator was selected.
+ */
+int controller_select_at(Controller *controller, const double window_x, const double window_y) {
+    const Universe *universe = controller->universe;
+    const OscillatorStore *store = universe->oscillators;
+    const double magnification = get_view_magnification(universe);
+    double nearest_distance = SELECTION_RADIUS;
+    int found = 0;
+    for (size_t index = 0; index < store->count; index++) {
+        const double d = magnification * distance((window_x - universe->width / 2) / magnification, (window_y - universe->height / 2) / magnification,
+                                                  store->center_x[index], store->center_y[index]);
+        if (d <= nearest_distance) {
+            nearest_distance = d;
+            controller->selection = index;
+            found = 1;
         }
     }
+    return found;
+}
 
-    // Initialize the Oscillators
-    Oscillator **oscillators = malloc(MAXIMUM_OSCILLATORS * sizeof(Oscillator));
-    oscillators[0] = create_oscillator();
-    for (int i = 1; i < MAXIMUM_OSCILLATORS; i++) {
-        oscillators[i] = NULL;
-    }
-    universe->oscillators = oscillators;
-    universe->dissipation_model = DEFAULT_UNIVERSE_DISSIPATION_MODEL;
-    return universe;
+void controller_increase_amplitude(Controller *controller) {
+    double *amplitude = &get_controller_store(controller)->amplitude[controller->selection];
+    *amplitude = minimum(*amplitude + AMPLITUDE_TICK, MAXIMUM_AMPLITUDE);
 }
 
-Controller *create_controller(Universe *universe) {
-    Controller *controller = malloc(sizeof(Controller));
-    controller->universe = universe;
-    controller->selection = 0;
-    controller->highlight = HIGHLIGHT_DOT;
-    controller->rendering = 1;
-    return controller;
+void controller_decrease_amplitude(Controller *controller) {
+    double *amplitude = &get_controller_store(controller)->amplitude[controller->selection];
+    *amplitude = maximum(*amplitude - AMPLITUDE_TICK, MINIMUM_AMPLITUDE);
 }
 
-void reset_universe_value_matrix(const Universe * const universe) {
-    for (Uint16 y = 0; y < universe->height; y++) {
-        for (Uint16 x = 0; x < universe->width; x++) {
-            universe->value_matrix[y][x] = 0.0;
-        }
+/**
+ * Creates an Oscillator at the origin and selects it.
+ */
+void controller_add(Controller *controller) {
+    const size_t index = universe_add_oscillator(controller->universe, ORIGIN.x, ORIGIN.y, DEFAULT_AMPLITUDE, DEFAULT_WAVELENGTH);
+    if (index < get_controller_store(controller)->count) {
+        controller->selection = index;
     }
 }
 
-double dissipate(double value, double distance, DissipationModel model) {
-    if (model == NO_DISSIPATION) {
-        return value;
-    } else if (model == INVERSE_LINEAR_DISSIPATION) {
-        return DISSIPATION_START * value / maximum(DISSIPATION_START, distance);
+/**
+ * Selects the Oscillator at the target index, creating a new one if there are not enough Oscillators.
+ */
+void controller_select(Controller *controller, size_t target) {
+    if (target < get_controller_store(controller)->count) {
+        controller->selection = target;
     } else {
-        return DISSIPATION_START * value / square(maximum(DISSIPATION_START, distance)); // No need to ensure positiveness.
+        controller_add(controller);
     }
 }
 
-void write_waves(SDL_Window *window, SDL_Renderer *renderer, const Controller * const controller, const Universe * const universe) {
-    clock_t start = clock();
-    int ms;
-    if (controller->rendering) {
-        reset_universe_value_matrix(universe);
-
-        // Calculate all values of the matrix.
-        for (unsigned int index = 0; index < MAXIMUM_OSCILLATORS; index++) {
-            if (universe->oscillators[index] != NULL) {
-                const Oscillator *osc = universe->oscillators[index];
-                const Point center = osc->center;
-                const int center_x = center.x;
-                const int center_y = center.y;
-                for (int x = -WIDTH / 2; x < WIDTH / 2; x++) {
-                    for (int y = -HEIGHT / 2; y < HEIGHT / 2; y++) {
-                        const double wave_value = sin_of_distance(x - center_x, y - center_y, osc->wavelength);
-                        const double amplitude = (wave_value + 1.0) / 2.0;
-                        // If the model is NO_DISSIPATION, distance_to_center is useless. However, I think GCC removes it then.
-                        const double distance_to_center = distance_to_origin(x - center_x, y - center_y);
-                        const double after_dissipation = dissipate(amplitude, distance_to_center, universe->dissipation_model);
-                        const int array_x = x + WIDTH / 2;
-                        const int array_y = y + HEIGHT / 2;
-                        universe->value_matrix[array_y][array_x] += after_dissipation;
-                    }
-                }
-                printf("Evaluated Oscillator #%d\n", index + 1);
-            }
-        }
+/**
+ * Selects the next Oscillator.
+ */
+void controller_cycle(Controller *controller) {
+    controller->selection = (controller->selection + 1) % get_controller_store(controller)->count;
+}
 
-        ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
-        printf("Took %d ms to recompute.\n", ms);
-        start = clock();
+void controller_delete(Controller *controller) {
+    universe_remove_oscillator(controller->universe, controller->selection);
+    // The last Oscillator took the place of the deleted one, so the selection is still valid unless it was the last.
+    const size_t count = get_controller_store(controller)->count;
+    if (count == 0) {
+        // There must always be a selected Oscillator.
+        controller_add(controller);
+    } else if (controller->selection >= count) {
+        controller->selection = count - 1;
     }
+}
 
-    double maximum_intensity = 0.0;
-    for (size_t i = 0; i < HEIGHT; i++) {
-        for (size_t j = 0; j < WIDTH; j++) {
-            if (universe->value_matrix[i][j] > maximum_intensity) {
-                maximum_intensity = universe->value_matrix[i][j];
-            }
-        }
+/**
+ * Pans the view by the specified number of pixels of the window, rounded to whole pixels of the plane.
+ */
+void controller_pan(Controller *controller, const int window_dx, const int window_dy) {
+    Universe *universe = controller->universe;
+    if (universe->engine != SUPERPOSITION_ENGINE) {
+        printf("Only the superposition engine can be panned\n");
+        return;
     }
+    const double magnification = get_view_magnification(universe);
+    pan_universe(universe, (int) lround(window_dx / magnification), (int) lround(window_dy / magnification));
+    printf("Viewing (%d, %d)\n", universe->view_x, universe->view_y);
+}
 
-    for (size_t i = 0; i < HEIGHT; i++) {
-        for (size_t j = 0; j < WIDTH; j++) {
-            Uint8 normalized = (Uint8) (255 * (universe->value_matrix[i][j] / maximum_intensity));
-            SDL_SetRenderDrawColor(renderer, normalized, normalized, normalized, 0);
-            SDL_RenderDrawPoint(renderer, j, i);
-        }
+/**
+ * Pans the view back to the origin of the plane.
+ */
+void controller_pan_to_origin(Controller *controller) {
+    Universe *universe = controller->universe;
+    if (universe->engine != SUPERPOSITION_ENGINE) {
+        printf("Only the superposition engine can be panned\n");
+        return;
     }
+    pan_universe(universe, -universe->view_x, -universe->view_y);
+    printf("Viewing (%d, %d)\n", universe->view_x, universe->view_y);
+}
 
-    if (controller->highlight == HIGHLIGHT_DOT) {
-        // Make a red dot for each Oscillator.
-        SDL_SetRenderDrawColor(renderer, 255, 0, 0, 0);
-        for (unsigned int index = 0; index < MAXIMUM_OSCILLATORS; index++) {
-            if (universe->oscillators[index] != NULL) {
-                Point center = universe->oscillators[index]->center;
-                SDL_RenderDrawPoint(renderer, center.x + WIDTH / 2, center.y + HEIGHT / 2);
-            }
-        }
+/**
+ * Zooms the view in by the specified number of factors of two, or out if it is negative, within the limits.
+ */
+void controller_zoom(Controller *controller, const int levels) {
+    Universe *universe = controller->universe;
+    if (universe->engine != SUPERPOSITION_ENGINE) {
+        printf("Only the superposition engine can be zoomed\n");
+        return;
     }
+    const int zoom = universe->zoom + levels;
+    universe->zoom = zoom < -MAXIMUM_ZOOM ? -MAXIMUM_ZOOM : zoom > MAXIMUM_ZOOM ? MAXIMUM_ZOOM : zoom;
+    printf("Zoom is now %gx\n", get_view_magnification(universe));
+}
 
-    ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
-    printf("Took %d ms to redraw.\n", ms);
+void controller_toggle_rendering(Controller *controller) {
+    controller->rendering = controller->rendering ? 0 : 1;
+}
 
-    SDL_RenderPresent(renderer);
+void controller_cycle_evaluation_mode(Controller *controller) {
+    Universe *universe = controller->universe;
+    universe->evaluation_mode = (universe->evaluation_mode + 1) % NUMBER_OF_EVALUATION_MODES;
+    universe->rebuild_requested = 1;
+    printf("Evaluation mode is now %s\n", evaluation_mode_to_string(universe->evaluation_mode));
 }
 
-Oscillator *get_controller_oscillator(Controller *controller) {
-    return controller->universe->oscillators[controller->selection];
+void controller_toggle_cutoff(Controller *controller) {
+    Universe *universe = controller->universe;
+    universe->cutoff_enabled = universe->cutoff_enabled ? 0 : 1;
+    universe->rebuild_requested = 1;
+    printf("Cutoff of distant waves %s\n", universe->cutoff_enabled ? "enabled" : "disabled");
 }
 
-void controller_move_up(Controller *controller) {
-    get_controller_oscillator(controller)->center.y--;
+void controller_toggle_clustering(Controller *controller) {
+    Universe *universe = controller->universe;
+    universe->clustering_enabled = universe->clustering_enabled ? 0 : 1;
+    universe->rebuild_requested = 1;
+    printf("Clustering of distant waves %s\n", universe->clustering_enabled ? "enabled" : "disabled");
 }
 
-void controller_move_left(Controller *controller) {
-    get_controller_oscillator(controller)->center.x--;
+/**
+ * Multiplies the clustering error by the factor, within its limits.
+ */
+void controller_scale_clustering_error(Controller *controller, const double factor) {
+    Universe *universe = controller->universe;
+    const double error = universe->clustering_error * factor;
+    universe->clustering_error = minimum(maximum(error, MINIMUM_CLUSTERING_ERROR), MAXIMUM_CLUSTERING_ERROR);
+    universe->rebuild_requested = universe->clustering_enabled;
+    printf("Clustering error is now %g quantization steps\n", universe->clustering_error);
 }
 
-void controller_move_down(Controller *controller) {
-    get_controller_oscillator(controller)->center.y++;
+/**
+ * Multiplies the frame budget by the factor, within its limits.
+ */
+void controller_scale_frame_budget(Controller *controller, const double factor) {
+    const double budget = controller->frame_budget * factor;
+    controller->frame_budget = (Uint32) minimum(maximum(budget, MINIMUM_FRAME_BUDGET), MAXIMUM_FRAME_BUDGET);
+    printf("Frame budget is now %u ms\n", (unsigned int) controller->frame_budget);
 }
 
-void controller_move_right(Controller *controller) {
-    get_controller_oscillator(controller)->center.x++;
+void controller_toggle_progressive(Controller *controller) {
+    controller->progressive = controller->progressive ? 0 : 1;
+    printf("Progressive refinement %s\n", controller->progressive ? "enabled" : "disabled");
 }
 
-void controller_increase_amplitude(Controller *controller) {
-    Oscillator *oscillator = get_controller_oscillator(controller);
-    oscillator->amplitude = minimum(oscillator->amplitude + AMPLITUDE_TICK, MAXIMUM_AMPLITUDE);
+void controller_toggle_interpolation(Controller *controller) {
+    Universe *universe = controller->universe;
+    universe->interpolation_enabled = universe->interpolation_enabled ? 0 : 1;
+    universe->rebuild_requested = 1;
+    printf("Interpolation of smooth waves %s\n", universe->interpolation_enabled ? "enabled" : "disabled");
 }
 
-void controller_decrease_amplitude(Controller *controller) {
-    Oscillator *oscillator = get_controller_oscillator(controller);
-    oscillator->amplitude = maximum(oscillator->amplitude - AMPLITUDE_TICK, MINIMUM_AMPLITUDE);
+/**
+ * Multiplies the interpolation error by the factor, within its limits.
+ */
+void controller_scale_interpolation_error(Controller *controller, const double factor) {
+    Universe *universe = controller->universe;
+    const double error = universe->interpolation_error * factor;
+    universe->interpolation_error = minimum(maximum(error, MINIMUM_INTERPOLATION_ERROR), MAXIMUM_INTERPOLATION_ERROR);
+    universe->rebuild_requested = universe->interpolation_enabled;
+    printf("Interpolation error is now %g quantization steps\n", universe->interpolation_error);
 }
 
-void controller_select(Controller *controller, size_t target) {
-    controller->selection = target;
-    if (get_controller_oscillator(controller) == NULL) {
-        controller->universe->oscillators[controller->selection] = create_oscillator();
+void controller_toggle_speculation(Controller *controller) {
+    Universe *universe = controller->universe;
+    if (universe->speculation == NULL) {
+        universe->speculation = create_speculation(universe->geometry, universe->width, universe->height);
+    } else {
+        delete_speculation(universe->speculation);
+        universe->speculation = NULL;
     }
+    printf("Speculation %s\n", universe->speculation != NULL ? "enabled" : "disabled");
 }
 
-void controller_delete(Controller *controller) {
-    Oscillator *oscillator = get_controller_oscillator(controller);
-    delete_oscillator(oscillator);
-    controller->universe->oscillators[controller->selection] = NULL;
-    // Select another Oscillator to prevent a segmentation fault.
-    // A flag indicating whether or not another Oscillator could be found.
-    int found_oscillator = 0;
-    for (unsigned int index = 0; index < MAXIMUM_OSCILLATORS && !found_oscillator; index++) {
-        if (controller->universe->oscillators[index] != NULL) {
-            controller->selection = index;
-            found_oscillator = 1;
-        }
+/**
+ * Requests the Layers of the selected Oscillator at the positions the arrow keys would move it to, if it has a cached Layer.
+ */
+void controller_speculate(Controller *controller) {
+    Universe *universe = controller->universe;
+    const OscillatorStore *store = universe->oscillators;
+    if (universe->speculation == NULL || universe->engine != SUPERPOSITION_ENGINE || controller->selection >= store->count) {
+        return;
     }
-    // If we couldn't find another Oscillator, we create a new one with controller_select().
-    if (!found_oscillator) {
-        controller_select(controller, 0);
+    const Layer *layer = &universe->layers[controller->selection];
+    if (layer->values != NULL && is_layer_wave_valid(layer, store, controller->selection)) {
+        speculate(universe->speculation, layer->center, layer->wavelength, universe->dissipation_model);
     }
 }
 
-void controller_toggle_rendering(Controller *controller) {
-    controller->rendering = controller->rendering ? 0 : 1;
+void controller_cycle_engine(Controller *controller) {
+    Universe *universe = controller->universe;
+    universe->engine = (universe->engine + 1) % NUMBER_OF_ENGINES;
+    printf("Engine is now %s\n", engine_to_string(universe->engine));
+}
+
+void controller_toggle_slits(Controller *controller) {
+    if (controller->universe->engine == SIMULATION_ENGINE) {
+        toggle_simulation_slits(controller->universe);
+    }
+}
+
+/**
+ * Toggles between the default absorbing layers and reflecting edges.
+ */
+void controller_toggle_absorbing_layers(Controller *controller) {
+    if (controller->universe->engine == SIMULATION_ENGINE) {
+        FDTDSimulation *simulation = get_universe_simulation(controller->universe);
+        const int width = simulation->absorbing_width > 0 ? 0 : FDTD_DEFAULT_ABSORBING_WIDTH;
+        set_fdtd_absorbing_layers(simulation, width, FDTD_DEFAULT_ABSORBING_STRENGTH);
+        printf("Absorbing layers %s\n", width > 0 ? "enabled" : "disabled");
+    }
 }
 
 /**
@@ -307,16 +416,36 @@ void controller_toggle_rendering(Controller *controller) {
  */
 int handle_keydown(Controller *controller, SDL_Event event) {
     const SDL_Keycode sym = event.key.keysym.sym;
-    if (sym == SDLK_UP) {
-        controller_move_up(controller);
+    const double movement = (event.key.keysym.mod & KMOD_SHIFT) ? FINE_MOVEMENT_TICK : MOVEMENT_TICK;
+    const int panning = (event.key.keysym.mod & KMOD_CTRL) != 0;
+    if (panning && sym == SDLK_UP) {
+        controller_pan(controller, 0, -PAN_TICK);
+    } else if (panning && sym == SDLK_RIGHT) {
+        controller_pan(controller, PAN_TICK, 0);
+    } else if (panning && sym == SDLK_DOWN) {
+        controller_pan(controller, 0, PAN_TICK);
+    } else if (panning && sym == SDLK_LEFT) {
+        controller_pan(controller, -PAN_TICK, 0);
+    } else if (sym == SDLK_HOME) {
+        controller_pan_to_origin(controller);
+    } else if (sym == SDLK_z) {
+        controller_zoom(controller, 1);
+    } else if (sym == SDLK_x) {
+        controller_zoom(controller, -1);
+    } else if (sym == SDLK_UP) {
+        controller_move_up(controller, movement);
     } else if (sym == SDLK_RIGHT) {
-        controller_move_right(controller);
+        controller_move_right(controller, movement);
     } else if (sym == SDLK_DOWN) {
-        controller_move_down(controller);
+        controller_move_down(controller, movement);
     } else if (sym == SDLK_LEFT) {
-        controller_move_left(controller);
+        controller_move_left(controller, movement);
     } else if (sym >= SDLK_1 && sym <= SDLK_8) {
         controller_select(controller, sym - SDLK_1);
+    } else if (sym == SDLK_INSERT) {
+        controller_add(controller);
+    } else if (sym == SDLK_TAB) {
+        controller_cycle(controller);
     } else if (sym == SDLK_DELETE) {
         controller_delete(controller);
     } else if (sym == SDLK_KP_PLUS) {
@@ -325,6 +454,36 @@ int handle_keydown(Controller *controller, SDL_Event event) {
         controller_decrease_amplitude(controller);
     } else if (sym == SDLK_r) {
         controller_toggle_rendering(controller);
+    } else if (sym == SDLK_c) {
+        controller_toggle_cutoff(controller);
+    } else if (sym == SDLK_m) {
+        controller_toggle_clustering(controller);
+    } else if (sym == SDLK_KP_MULTIPLY) {
+        controller_scale_clustering_error(controller, 2.0);
+    } else if (sym == SDLK_KP_DIVIDE) {
+        controller_scale_clustering_error(controller, 0.5);
+    } else if (sym == SDLK_PAGEUP) {
+        controller_scale_frame_budget(controller, 2.0);
+    } else if (sym == SDLK_PAGEDOWN) {
+        controller_scale_frame_budget(controller, 0.5);
+    } else if (sym == SDLK_p) {
+        controller_toggle_progressive(controller);
+    } else if (sym == SDLK_i) {
+        controller_toggle_interpolation(controller);
+    } else if (sym == SDLK_RIGHTBRACKET) {
+        controller_scale_interpolation_error(controller, 2.0);
+    } else if (sym == SDLK_LEFTBRACKET) {
+        controller_scale_interpolation_error(controller, 0.5);
+    } else if (sym == SDLK_s) {
+        controller_toggle_speculation(controller);
+    } else if (sym == SDLK_f) {
+        controller_cycle_evaluation_mode(controller);
+    } else if (sym == SDLK_e) {
+        controller_cycle_engine(controller);
+    } else if (sym == SDLK_o) {
+        controller_toggle_slits(controller);
+    } else if (sym == SDLK_a) {
+        controller_toggle_absorbing_layers(controller);
     } else if (sym == SDLK_d) {
         const DissipationModel old = controller->universe->dissipation_model;
         const DissipationModel new = (old + 1) % NUMBER_OF_DISSIPATION_MODELS;
@@ -338,17 +497,81 @@ int handle_keydown(Controller *controller, SDL_Event event) {
     return 1;
 }
 
+/**
+ * Starts recording the presented frames, or stops the recording and reports how many frames were dropped.
+ *
+ * Recordings are numbered from one after the path in WAVES_CAPTURE, which is a Y4M stream if it ends with .y4m and
+ * otherwise the prefix of numbered PPM files.
+ */
+void toggle_video_capture(Display *display, int *recording_count) {
+    if (display->capture != NULL) {
+        VideoCapture *capture = display->capture;
+        display->capture = NULL;
+        const int failed = stop_video_capture(capture);
+        printf("Recorded %llu of %llu frames to %s, dropping %llu\n", (unsigned long long) capture->written_count,
+               (unsigned long long) capture->captured_count, capture->path, (unsigned long long) capture->dropped_count);
+        if (failed) {
+            printf("Could not write every frame to %s\n", capture->path);
+        }
+        delete_video_capture(capture);
+        return;
+    }
+    const char *configured = getenv("WAVES_CAPTURE");
+    const char *base = configured != NULL && *configured != '\0' ? configured : DEFAULT_CAPTURE_PATH;
+    const int stem_length = get_video_format(base) == Y4M_VIDEO ? (int) (strlen(base) - strlen(".y4m")) : (int) strlen(base);
+    char path[4096];
+    (*recording_count)++;
+    snprintf(path, sizeof(path), "%.*s-%d%s", stem_length, base, *recording_count, base + stem_length);
+    display->capture = create_video_capture(path, display->width, display->height, FRAMES_PER_SEC);
+    if (display->capture == NULL) {
+        printf("Could not record to %s\n", path);
+    } else {
+        printf("Recording to %s\n", path);
+    }
+}
+
+/**
+ * Handles a mouse event, dragging Oscillators with the left button and zooming with the wheel.
+ *
+ * Returns 0 if this function call didn't change anything.
+ */
+int handle_mouse(Controller *controller, SDL_Event event) {
+    if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT) {
+        controller->dragging = controller_select_at(controller, event.button.x, event.button.y);
+        return 0;
+    } else if (event.type == SDL_MOUSEBUTTONUP && event.button.button == SDL_BUTTON_LEFT) {
+        controller->dragging = 0;
+        return 0;
+    } else if (event.type == SDL_MOUSEMOTION && controller->dragging) {
+        controller_move_to(controller, event.motion.x, event.motion.y);
+        return 1;
+    } else if (event.type == SDL_MOUSEWHEEL && event.wheel.y != 0) {
+        controller_zoom(controller, event.wheel.y > 0 ? 1 : -1);
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
-    init_cached_geometry();
+    Uint16 width = DEFAULT_WIDTH;
+    Uint16 height = DEFAULT_HEIGHT;
+    if (argc == 3) {
+        width = parse_dimension(argv[1], DEFAULT_WIDTH);
+        height = parse_dimension(argv[2], DEFAULT_HEIGHT);
+    } else if (argc != 1) {
+        printf("Usage: %s [width height]\n", argv[0]);
+        return 1;
+    }
+    const char *geometry_cache_directory = get_geometry_cache_directory();
     SDL_Window *window;                   
     SDL_Init(SDL_INIT_VIDEO);              
     window = SDL_CreateWindow(
             "Waves",
             SDL_WINDOWPOS_CENTERED,        
             SDL_WINDOWPOS_CENTERED,         
-            WIDTH,
-            HEIGHT,                           
-            SDL_WINDOW_OPENGL);
+            width,
+            height,
+            SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
     // Check that the window was successfully created
     if (window == NULL) {
         // In the case that the window could not be made, write about it.
@@ -356,36 +579,126 @@ int main(int argc, char* argv[]) {
         return 1;
     } else {
         SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+        SDL_SetWindowMinimumSize(window, MINIMUM_SIZE, MINIMUM_SIZE);
+        Display *display = create_display(window, renderer, width, height, get_frame_cache_budget());
+        if (display == NULL) {
+            printf("Could not create texture: %s\n", SDL_GetError());
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+            return 1;
+        }
         // Write waves to the window.
-        Universe *universe = create_universe(WIDTH, HEIGHT);
+        Universe *universe = create_universe(width, height, geometry_cache_directory);
+        universe->verbose = 1;
         Controller *controller = create_controller(universe);
-        write_waves(window, renderer, controller, universe);
+        Governor *governor = create_governor(universe);
+        // Speculation only pays off with processors to spare.
+        if (get_processor_count() > 1) {
+            controller_toggle_speculation(controller);
+        }
+        controller_add(controller);
+        write_waves(display, controller, universe);
+        // The first frame only filled the parts of the caches it read, so the rest is filled now, on every processor.
+        ThreadPool *warm_up_pool = create_thread_pool(0);
+        warm_cached_geometry(universe->geometry, warm_up_pool);
+        delete_thread_pool(warm_up_pool);
+        // Until the threshold is measured, convolution is used above the default one.
+        ConvolutionBenchmark *benchmark = start_convolution_benchmark(width, height);
         SDL_Event event;
         // The window is open, therefore we enter the program loop.
         unsigned int running = 1;
-        clock_t last_rendering = clock();
+        int dirty = 0; // Whether or not input changed something since the last frame.
+        Uint32 last_frame_ticks = SDL_GetTicks();
+        int resize_width = 0; // The size the window was resized to, if it has not been applied yet.
+        int resize_height = 0;
+        int recording_count = 0;
         while (running) {
-            while (SDL_PollEvent(&event) != 0) {
-                if (event.type == SDL_QUIT) {
-                    running = 0;
-                }
-                else if (event.type == SDL_KEYDOWN) {
-                    if (handle_keydown(controller, event)) {
-                        const clock_t current_time = clock();
-                        // Casting CPU time values to double makes sure that
-                        // arithmetic operations work properly and consistently
-                        // no matter what the underlying representation is.
-                        const double seconds = ((double) (current_time - last_rendering)) / CLOCKS_PER_SEC;
-                        if (seconds * FRAMES_PER_SEC >= 1) {
-                            write_waves(window, renderer, controller, universe);
-                            last_rendering = clock();
+            // Waiting rather than polling leaves the processor idle between frames, unless there are passes to refine.
+            const int refining = !dirty && controller->progressive && is_refinement_due(governor, controller, SDL_GetTicks());
+            if (refining ? SDL_PollEvent(&event) : SDL_WaitEventTimeout(&event, EVENT_WAIT_TIMEOUT)) {
+                do {
+                    if (event.type == SDL_QUIT) {
+                        running = 0;
+                    } else if (event.type == SDL_WINDOWEVENT) {
+                        if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                            resize_width = event.window.data1;
+                            resize_height = event.window.data2;
+                        }
+                    } else {
+                        int changed = 0;
+                        if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_v) {
+                            toggle_video_capture(display, &recording_count);
+                            // Drawing a frame starts the recording with what the window shows.
+                            changed = display->capture != NULL;
+                        } else if (event.type == SDL_KEYDOWN) {
+                            changed = handle_keydown(controller, event);
+                        } else {
+                            changed = handle_mouse(controller, event);
+                        }
+                        if (changed) {
+                            dirty = 1;
+                            governor->last_input_ticks = SDL_GetTicks();
                         }
                     }
+                } while (SDL_PollEvent(&event) != 0);
+            }
+            // Only the last of a burst of resize events is applied.
+            if (resize_width != 0 && (resize_width != display->width || resize_height != display->height)) {
+                const Uint16 new_width = clamp_dimension(resize_width);
+                const Uint16 new_height = clamp_dimension(resize_height);
+                if (display->capture != NULL) {
+                    // The frames of a recording all have the same size.
+                    printf("Resizing the window stops the recording\n");
+                    toggle_video_capture(display, &recording_count);
+                }
+                if (resize_window_display(display, new_width, new_height)) {
+                    printf("Could not resize the window: %s\n", SDL_GetError());
+                    break;
+                }
+                delete_governor(governor, universe);
+                resize_universe(universe, new_width, new_height);
+                governor = create_governor(universe);
+                printf("Resized to %dx%d\n", new_width, new_height);
+                dirty = 1;
+            }
+            resize_width = 0;
+            resize_height = 0;
+            if (benchmark != NULL && is_convolution_benchmark_finished(benchmark)) {
+                universe->convolution_threshold = finish_convolution_benchmark(benchmark);
+                benchmark = NULL;
+                printf("Convolution pays off above %zu Oscillators with the same wavelength\n", universe->convolution_threshold);
+            }
+            const Uint32 ticks = SDL_GetTicks();
+            const int frame_due = (ticks - last_frame_ticks) * FRAMES_PER_SEC >= 1000;
+            if (universe->engine == SIMULATION_ENGINE && controller->rendering) {
+                // The simulation evolves on its own, so it is redrawn at a steady rate.
+                if (frame_due) {
+                    write_waves(display, controller, universe);
+                    last_frame_ticks = ticks;
+                    dirty = 0;
                 }
+            } else if (dirty && frame_due) {
+                draw_interactive_frame(display, governor, controller, universe);
+                last_frame_ticks = ticks;
+                dirty = 0;
+            } else if (!dirty && is_refinement_due(governor, controller, ticks)) {
+                draw_refined_frame(display, governor, controller, universe);
+            } else if (!dirty && governor->stride == 1) {
+                // While idle, precompute where the arrow keys would move the selected Oscillator.
+                controller_speculate(controller);
             }
         }
 
         // Clean up
+        if (benchmark != NULL) {
+            finish_convolution_benchmark(benchmark);
+        }
+        if (display->capture != NULL) {
+            toggle_video_capture(display, &recording_count);
+        }
+        delete_governor(governor, universe);
+        delete_window_display(display);
+        SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
         SDL_Quit();
     }
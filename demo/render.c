@@ -0,0 +1,854 @@
+// Renders a scene to an image file, without a window.
+//
+// Frames which do not fit in the memory budget are streamed: they are
+// evaluated in bands of whole rows, each written to the file before the next
+// one is evaluated. As a band cannot be normalized by the maximum of the whole
+// frame, that maximum is first estimated by a cheap pass over a sparse grid of
+// pixels, or bounded by the sum of the amplitudes.
+//
+// A render may also cover only a rectangle of the frame, normalized by a given
+// maximum, which is how the worker processes of a coordinated render draw
+// their tiles.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#include <getopt.h>
+
+#include "image-file.h"
+#include "scene.h"
+#include "universe.h"
+
+#include "coordinator.h"
+
+/**
+ * By default, the most memory the buffers of the frame may take, in mebibytes.
+ */
+#define DEFAULT_MEMORY_BUDGET 1024
+
+/**
+ * The bytes of the buffers of a pixel of the frame or of a band: its value and its quantized pixel.
+ */
+#define BYTES_PER_PIXEL (sizeof(double) + sizeof(uint32_t))
+
+/**
+ * The stride of the first pass which estimates the maximum of a streamed frame.
+ *
+ * It costs about a sixteenth of the evaluation of the frame.
+ */
+#define MAXIMUM_ESTIMATION_STRIDE 4
+
+/**
+ * The most parameters a sweep may have.
+ */
+#define MAXIMUM_SWEEP_PARAMETERS 8
+
+/**
+ * How a streamed frame is normalized.
+ */
+typedef enum Normalization {
+    SAMPLED_NORMALIZATION, // By the maximum of a first pass, saturating pixels brighter than it.
+    BOUND_NORMALIZATION, // By the sum of the amplitudes, which no pixel exceeds.
+    FIXED_NORMALIZATION // By a maximum given on the command line.
+} Normalization;
+
+/**
+ * Returns the number of milliseconds elapsed since the start.
+ */
+double get_elapsed_milliseconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/**
+ * Parses a size of the form WIDTHxHEIGHT, whose dimensions are from 1 to UINT16_MAX, like those of a scene.
+ *
+ * Returns 0 if the size was valid.
+ */
+int parse_size(const char *argument, uint16_t *width, uint16_t *height) {
+    char *end;
+    const long parsed_width = strtol(argument, &end, 10);
+    if (end == argument || *end != 'x') {
+        return 1;
+    }
+    const char *height_argument = end + 1;
+    const long parsed_height = strtol(height_argument, &end, 10);
+    if (end == height_argument || *end != '\0') {
+        return 1;
+    }
+    if (parsed_width < 1 || parsed_width > UINT16_MAX || parsed_height < 1 || parsed_height > UINT16_MAX) {
+        return 1;
+    }
+    *width = (uint16_t) parsed_width;
+    *height = (uint16_t) parsed_height;
+    return 0;
+}
+
+/**
+ * What is rendered: a rectangle of the frame of a scene, band by band.
+ */
+typedef struct Render {
+    const Scene *scene;
+    int frame_width;
+    int frame_height;
+    Region region; // The whole frame, unless a tile is rendered.
+    int band_height; // The height of the Universe, which is the height of the region unless it is streamed.
+} Render;
+
+/**
+ * Moves the Oscillators of the Universe to where those of the scene are relative to the rectangle of the frame it shows.
+ *
+ * The rectangle has the dimensions of the Universe and its top-left pixel at (left, top) in the frame.
+ */
+void place_scene_oscillators(Universe *universe, const Render * const render, const int left, const int top) {
+    // Offsets are whole pixels, so every pixel is evaluated exactly as it would be in the whole frame.
+    const int offset_x = left + universe->width / 2 - render->frame_width / 2;
+    const int offset_y = top + universe->height / 2 - render->frame_height / 2;
+    const OscillatorStore *oscillators = render->scene->oscillators;
+    for (size_t i = 0; i < oscillators->count; i++) {
+        universe->oscillators->center_x[i] = oscillators->center_x[i] - offset_x;
+        universe->oscillators->center_y[i] = oscillators->center_y[i] - offset_y;
+    }
+    universe->rebuild_requested = 1;
+}
+
+/**
+ * Makes the Universe show the band of rows of the region which starts at the top of the region plus the offset.
+ *
+ * Only the last band may be shorter, so the value matrix is reallocated at most twice per pass.
+ */
+void show_band(Universe *universe, const Render * const render, const int offset) {
+    const Region *region = &render->region;
+    const int rows = region->height - offset < render->band_height ? region->height - offset : render->band_height;
+    if (region->width != universe->width || rows != universe->height) {
+        resize_universe(universe, (uint16_t) region->width, (uint16_t) rows);
+    }
+    place_scene_oscillators(universe, render, region->left, region->top + offset);
+}
+
+/**
+ * Returns the maximum value of the region at the pixels of the frame whose coordinates are multiples of MAXIMUM_ESTIMATION_STRIDE.
+ *
+ * The left and the top of the region must be such multiples too.
+ */
+double estimate_maximum(Universe *universe, const Render * const render) {
+    double estimate = 0.0;
+    for (int offset = 0; offset < render->region.height; offset += render->band_height) {
+        show_band(universe, render, offset);
+        ensure_cached_geometry(universe);
+        evaluate_samples(universe, MAXIMUM_ESTIMATION_STRIDE, 0, universe->value_matrix);
+        for (int y = 0; y < universe->height; y += MAXIMUM_ESTIMATION_STRIDE) {
+            for (int x = 0; x < universe->width; x += MAXIMUM_ESTIMATION_STRIDE) {
+                estimate = maximum(estimate, universe->value_matrix[y][x]);
+            }
+        }
+    }
+    return estimate;
+}
+
+/**
+ * Returns a bound on the values of the frame, which are sums of waves no greater than their amplitudes.
+ */
+double get_amplitude_bound(const Scene *scene) {
+    double bound = 0.0;
+    for (size_t i = 0; i < scene->oscillators->count; i++) {
+        bound += scene->oscillators->amplitude[i];
+    }
+    return bound;
+}
+
+/**
+ * Evaluates the region band by band, writing each band to the ImageWriter before evaluating the next one.
+ *
+ * The pixel buffer must hold a band. Returns 0 if every band was written.
+ */
+int stream_bands(Universe *universe, uint32_t *pixels, const Render * const render, ImageWriter *writer,
+                 const double maximum_intensity) {
+    for (int offset = 0; offset < render->region.height; offset += render->band_height) {
+        show_band(universe, render, offset);
+        update_universe_value_matrix(universe);
+        quantize_values_to_maximum(universe->value_matrix, universe->width, universe->height, 1, maximum_intensity, pixels);
+        for (int y = 0; y < universe->height; y++) {
+            write_image_row(writer, pixels + (size_t) y * universe->width);
+        }
+        if (writer->failed) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Writes the region of the frame to the path band by band, normalized by the maximum.
+ *
+ * Returns 0 if the image was written.
+ */
+int write_region(Universe *universe, uint32_t *pixels, const Render * const render, const char *path,
+                 const ImageFormat format, const double maximum_intensity) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return 1;
+    }
+    ImageWriter *writer = create_image_writer(file, format, render->region.width, render->region.height);
+    if (writer == NULL) {
+        fclose(file);
+        return 1;
+    }
+    int failed = stream_bands(universe, pixels, render, writer, maximum_intensity);
+    failed = finish_image_writer(writer) || failed;
+    failed = fclose(file) != 0 || failed;
+    return failed;
+}
+
+/**
+ * Streams the region of the frame to the path, in the format of its extension.
+ *
+ * Returns 0 if the image was written.
+ */
+int stream_region(Universe *universe, uint32_t *pixels, const Render * const render, const char *path,
+                  const ImageFormat format, const Normalization normalization, double maximum_intensity) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (normalization == SAMPLED_NORMALIZATION) {
+        maximum_intensity = estimate_maximum(universe, render);
+        printf("Estimated the maximum as %g in %.1f ms\n", maximum_intensity, get_elapsed_milliseconds(&start));
+    } else if (normalization == BOUND_NORMALIZATION) {
+        maximum_intensity = get_amplitude_bound(render->scene);
+        printf("Bounded the maximum by %g\n", maximum_intensity);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const int failed = write_region(universe, pixels, render, path, format, maximum_intensity);
+    if (!failed) {
+        printf("Rendered and wrote %dx%d in bands of %d rows on %zu threads in %.1f ms\n", render->region.width,
+               render->region.height, render->band_height, universe->thread_pool->thread_count,
+               get_elapsed_milliseconds(&start));
+    }
+    return failed;
+}
+
+/**
+ * Writes the estimated maximum of the region to the path, as text which preserves every bit of it.
+ *
+ * Returns 0 if it was written.
+ */
+int write_estimated_maximum(Universe *universe, const Render * const render, const char *path) {
+    const double estimate = estimate_maximum(universe, render);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 1;
+    }
+    int failed = fprintf(file, "%a\n", estimate) < 0;
+    failed = fclose(file) != 0 || failed;
+    return failed;
+}
+
+/**
+ * Returns the height of the bands of a region which fit in the memory budget, or the height of the region if it fits.
+ *
+ * Returns 0 if not even a row fits.
+ */
+int get_band_height(const size_t memory_budget, const int width, const int height) {
+    const size_t band_capacity = memory_budget / (width * BYTES_PER_PIXEL);
+    if (band_capacity >= (size_t) height) {
+        return height;
+    }
+    int band_height = (int) band_capacity;
+    if (band_height >= MAXIMUM_ESTIMATION_STRIDE) {
+        // Bands start on rows of the first pass, so that it samples the same pixels as a pass over the whole frame.
+        band_height -= band_height % MAXIMUM_ESTIMATION_STRIDE;
+    }
+    return band_height;
+}
+
+/**
+ * A variant of the scene template of a sweep, and how rendering it went.
+ */
+typedef struct SweepScene {
+    Scene *scene;
+    int width;
+    int height;
+    double *values; // The values of the parameters of the template.
+    char *output_path;
+    double milliseconds; // How long rendering and writing the scene took.
+    int failed;
+} SweepScene;
+
+/**
+ * A thread of a sweep, which renders a scene at a time and keeps its Universe for the next one.
+ */
+typedef struct SweepWorker {
+    Universe *universe; // NULL until the worker renders its first scene.
+    uint32_t *pixels;
+    size_t pixel_capacity;
+} SweepWorker;
+
+typedef struct Sweep {
+    SweepScene *scenes;
+    SweepWorker *workers;
+    size_t *idle_workers; // The workers which are not rendering a scene, as a stack.
+    size_t idle_worker_count;
+    pthread_mutex_t mutex; // Guards the idle workers.
+    CachedGeometry *geometry; // Shared by the Universes of every worker, and large enough for every scene.
+    size_t memory_budget; // The memory the buffers of each worker may take, in bytes.
+    Normalization normalization;
+    double maximum_intensity; // The maximum of a fixed normalization.
+    size_t convolution_threshold; // Of the Universes of every worker.
+    ImageFormat format;
+} Sweep;
+
+/**
+ * Returns the offset the caches must cover for the scene, as ensure_cached_geometry would require for its frame.
+ *
+ * The bands of the frame require no more, as they are inside of it.
+ */
+int get_scene_geometry_maximum(const Scene *scene, const int width, const int height) {
+    double required = width > height ? width : height;
+    for (size_t i = 0; i < scene->oscillators->count; i++) {
+        required = maximum(required, fabs(scene->oscillators->center_x[i]) + width / 2 + 1.0);
+        required = maximum(required, fabs(scene->oscillators->center_y[i]) + height / 2 + 1.0);
+    }
+    return (int) minimum(ceil(required), MAXIMUM_CACHED_GEOMETRY_OFFSET);
+}
+
+/**
+ * Renders a scene of the sweep on an idle worker, recording how long it took.
+ */
+void render_sweep_scene(void *context, size_t index) {
+    Sweep *sweep = context;
+    SweepScene *sweep_scene = &sweep->scenes[index];
+    pthread_mutex_lock(&sweep->mutex);
+    SweepWorker *worker = &sweep->workers[sweep->idle_workers[--sweep->idle_worker_count]];
+    pthread_mutex_unlock(&sweep->mutex);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const int width = sweep_scene->width;
+    const int height = sweep_scene->height;
+    Render render = {sweep_scene->scene, width, height, {0, 0, width, height},
+                     get_band_height(sweep->memory_budget, width, height)};
+    const size_t pixel_count = (size_t) width * render.band_height;
+    if (render.band_height != 0 && pixel_count > worker->pixel_capacity) {
+        free(worker->pixels);
+        worker->pixels = malloc(pixel_count * sizeof(uint32_t));
+        worker->pixel_capacity = worker->pixels != NULL ? pixel_count : 0;
+    }
+    if (render.band_height != 0 && worker->universe == NULL) {
+        worker->universe = create_universe_sharing_geometry((uint16_t) width, (uint16_t) render.band_height, sweep->geometry);
+        // A scene is drawn once, so Layers would never be reused.
+        worker->universe->layer_cache_budget = 0;
+        worker->universe->convolution_threshold = sweep->convolution_threshold;
+    }
+    Universe *universe = worker->universe;
+    int failed = render.band_height == 0 || worker->pixels == NULL;
+    if (!failed) {
+        universe->dissipation_model = sweep_scene->scene->dissipation_model;
+        while (universe->oscillators->count > 0) {
+            universe_remove_oscillator(universe, universe->oscillators->count - 1);
+        }
+        const OscillatorStore *oscillators = sweep_scene->scene->oscillators;
+        for (size_t i = 0; i < oscillators->count && !failed; i++) {
+            const size_t added = universe_add_oscillator(universe, oscillators->center_x[i], oscillators->center_y[i],
+                                                         oscillators->amplitude[i], oscillators->wavelength[i]);
+            failed = added == universe->oscillators->count;
+        }
+    }
+    if (!failed && render.band_height == height) {
+        // Rendered like a frame which fits in memory is rendered on its own, so that the images are the same.
+        universe->evaluation_mode = AUTOMATIC_EVALUATION;
+        show_band(universe, &render, 0);
+        update_universe_value_matrix(universe);
+        if (sweep->normalization == FIXED_NORMALIZATION) {
+            quantize_values_to_maximum(universe->value_matrix, width, height, 1, sweep->maximum_intensity, worker->pixels);
+        } else {
+            quantize_values(universe->value_matrix, width, height, 1, 0.0, worker->pixels);
+        }
+        failed = write_image_file(sweep_scene->output_path, worker->pixels, width, height);
+    } else if (!failed) {
+        universe->evaluation_mode = DIRECT_EVALUATION;
+        double maximum_intensity = sweep->maximum_intensity;
+        if (sweep->normalization == SAMPLED_NORMALIZATION) {
+            maximum_intensity = estimate_maximum(universe, &render);
+        } else if (sweep->normalization == BOUND_NORMALIZATION) {
+            maximum_intensity = get_amplitude_bound(sweep_scene->scene);
+        }
+        failed = write_region(universe, worker->pixels, &render, sweep_scene->output_path, sweep->format,
+                              maximum_intensity);
+    }
+    sweep_scene->failed = failed;
+    sweep_scene->milliseconds = get_elapsed_milliseconds(&start);
+    if (failed) {
+        printf("Could not write %s\n", sweep_scene->output_path);
+    }
+    pthread_mutex_lock(&sweep->mutex);
+    sweep->idle_workers[sweep->idle_worker_count++] = (size_t) (worker - sweep->workers);
+    pthread_mutex_unlock(&sweep->mutex);
+}
+
+/**
+ * Reads the whole file at the path into a string, which the caller frees, or returns NULL if it could not be read.
+ */
+char *read_text_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    char *text = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        const long size = ftell(file);
+        text = size >= 0 ? malloc((size_t) size + 1) : NULL;
+        rewind(file);
+        if (text != NULL && fread(text, 1, (size_t) size, file) == (size_t) size) {
+            text[size] = '\0';
+        } else {
+            free(text);
+            text = NULL;
+        }
+    }
+    fclose(file);
+    return text;
+}
+
+/**
+ * Writes the path of a variant of a sweep, which is the output path with the index of the variant before its extension.
+ */
+char *get_sweep_output_path(const char *output_path, const size_t index, const size_t count) {
+    const char *extension = strrchr(output_path, '.');
+    const int stem_length = (int) (extension - output_path);
+    int digits = 4;
+    for (size_t limit = 10000; limit < count; limit *= 10) {
+        digits++;
+    }
+    const size_t size = strlen(output_path) + digits + 2;
+    char *path = malloc(size);
+    snprintf(path, size, "%.*s-%0*zu%s", stem_length, output_path, digits, index, extension);
+    return path;
+}
+
+/**
+ * Writes the manifest of a sweep: a tab-separated table of the output, the parameters, and the time of each scene.
+ *
+ * Returns 0 if it was written.
+ */
+int write_sweep_manifest(const char *path, const Sweep *sweep, const size_t scene_count,
+                         const SceneParameter *parameters, const size_t parameter_count) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 1;
+    }
+    fprintf(file, "scene\toutput");
+    for (size_t i = 0; i < parameter_count; i++) {
+        fprintf(file, "\t%s", parameters[i].name);
+    }
+    fprintf(file, "\toscillators\twidth\theight\tmilliseconds\tstatus\n");
+    for (size_t i = 0; i < scene_count; i++) {
+        const SweepScene *scene = &sweep->scenes[i];
+        fprintf(file, "%zu\t%s", i, scene->output_path);
+        for (size_t j = 0; j < parameter_count; j++) {
+            fprintf(file, "\t%.17g", scene->values[j]);
+        }
+        fprintf(file, "\t%zu\t%d\t%d\t%.1f\t%s\n", scene->scene->oscillators->count, scene->width, scene->height,
+                scene->milliseconds, scene->failed ? "failed" : "ok");
+    }
+    return fclose(file) != 0;
+}
+
+/**
+ * Returns the convolution threshold set by -c, or measures it for a frame of the specified dimensions if it is 0.
+ *
+ * Measuring takes longer than rendering most single frames, so it is only done when asked for with -c measure.
+ */
+size_t get_convolution_threshold(const size_t threshold, const int width, const int height) {
+    if (threshold != 0) {
+        return threshold;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const size_t measured = benchmark_convolution_threshold((uint16_t) width, (uint16_t) height, get_geometry_cache_directory());
+    printf("Convolution pays off above %zu Oscillators with the same wavelength, measured in %.1f ms\n", measured,
+           get_elapsed_milliseconds(&start));
+    return measured;
+}
+
+/**
+ * Renders every variant of a scene template, each on a single thread of a pool, and writes the manifest of the sweep.
+ *
+ * The size given on the command line, if any, overrides the sizes of the variants. Returns 0 if every scene was written.
+ */
+int run_sweep(const char *template_path, const SceneParameter *parameters, const size_t parameter_count,
+              const char *output_path, const uint16_t width, const uint16_t height, const size_t thread_count,
+              const size_t memory_budget, const Normalization normalization, const double maximum_intensity,
+              const size_t convolution_threshold) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    char *template = read_text_file(template_path);
+    if (template == NULL) {
+        printf("Could not read %s\n", template_path);
+        return 1;
+    }
+    const size_t scene_count = count_scene_variants(parameters, parameter_count);
+    Sweep sweep;
+    sweep.scenes = calloc(scene_count, sizeof(SweepScene));
+    int failed = 0;
+    int geometry_maximum = 0;
+    size_t loaded_count = 0;
+    for (size_t i = 0; i < scene_count && !failed; i++) {
+        SweepScene *sweep_scene = &sweep.scenes[i];
+        sweep_scene->values = malloc(parameter_count * sizeof(double));
+        get_scene_variant(parameters, parameter_count, i, sweep_scene->values);
+        char *text = expand_scene_template(template, parameters, parameter_count, sweep_scene->values);
+        if (text == NULL) {
+            printf("%s names a parameter which is not swept\n", template_path);
+            failed = 1;
+            break;
+        }
+        char name[4096];
+        snprintf(name, sizeof(name), "%s (scene %zu)", template_path, i);
+        FILE *file = fmemopen(text, strlen(text), "r");
+        sweep_scene->scene = file != NULL ? read_scene(file, name) : NULL;
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(text);
+        if (sweep_scene->scene == NULL) {
+            failed = 1;
+            break;
+        }
+        loaded_count++;
+        const Scene *scene = sweep_scene->scene;
+        // Scenes only hold sizes the renderer supports.
+        sweep_scene->width = width != 0 ? width : scene->width != 0 ? scene->width : DEFAULT_WIDTH;
+        sweep_scene->height = height != 0 ? height : scene->height != 0 ? scene->height : DEFAULT_HEIGHT;
+        sweep_scene->output_path = get_sweep_output_path(output_path, i, scene_count);
+        geometry_maximum = (int) maximum(geometry_maximum,
+                                         get_scene_geometry_maximum(scene, sweep_scene->width, sweep_scene->height));
+    }
+    free(template);
+    if (!failed) {
+        ThreadPool *pool = create_thread_pool(thread_count);
+        // The caches cover every scene before any is rendered, so that the workers only read them.
+        sweep.geometry = create_cached_geometry(get_geometry_cache_directory(), geometry_maximum);
+        warm_cached_geometry(sweep.geometry, pool);
+        sweep.workers = calloc(pool->thread_count, sizeof(SweepWorker));
+        sweep.idle_workers = malloc(pool->thread_count * sizeof(size_t));
+        sweep.idle_worker_count = pool->thread_count;
+        for (size_t i = 0; i < pool->thread_count; i++) {
+            sweep.idle_workers[i] = i;
+        }
+        pthread_mutex_init(&sweep.mutex, NULL);
+        sweep.memory_budget = memory_budget / pool->thread_count;
+        sweep.normalization = normalization;
+        sweep.maximum_intensity = maximum_intensity;
+        // Measured once, for the largest of the scenes which are rendered in memory, as those are the ones which convolve.
+        int largest = -1;
+        for (size_t i = 0; i < scene_count; i++) {
+            const int scene_width = sweep.scenes[i].width;
+            const int scene_height = sweep.scenes[i].height;
+            if (get_band_height(sweep.memory_budget, scene_width, scene_height) == scene_height &&
+                (largest == -1 || (size_t) scene_width * scene_height >
+                                  (size_t) sweep.scenes[largest].width * sweep.scenes[largest].height)) {
+                largest = (int) i;
+            }
+        }
+        sweep.convolution_threshold = DEFAULT_CONVOLUTION_THRESHOLD;
+        if (largest != -1) {
+            sweep.convolution_threshold = get_convolution_threshold(convolution_threshold, sweep.scenes[largest].width,
+                                                                    sweep.scenes[largest].height);
+        }
+        get_image_format(output_path, &sweep.format);
+        printf("Loaded %zu scenes and cached offsets up to %d pixels in %.1f ms\n", scene_count, sweep.geometry->maximum,
+               get_elapsed_milliseconds(&start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        // Scenes are taken in order by whichever thread is free, so threads which draw small scenes draw more of them.
+        run_parallel(pool, render_sweep_scene, &sweep, scene_count);
+        size_t failed_count = 0;
+        for (size_t i = 0; i < scene_count; i++) {
+            failed_count += sweep.scenes[i].failed;
+        }
+        printf("Rendered %zu scenes on %zu threads in %.1f ms\n", scene_count - failed_count, pool->thread_count,
+               get_elapsed_milliseconds(&start));
+
+        // The manifest is the output path with the extension of a table.
+        const int stem_length = (int) (strrchr(output_path, '.') - output_path);
+        char *manifest_path = malloc(stem_length + sizeof(".tsv"));
+        sprintf(manifest_path, "%.*s.tsv", stem_length, output_path);
+        if (write_sweep_manifest(manifest_path, &sweep, scene_count, parameters, parameter_count)) {
+            printf("Could not write %s\n", manifest_path);
+            failed = 1;
+        } else {
+            printf("Wrote the manifest to %s\n", manifest_path);
+        }
+        free(manifest_path);
+        failed = failed || failed_count != 0;
+
+        for (size_t i = 0; i < pool->thread_count; i++) {
+            if (sweep.workers[i].universe != NULL) {
+                delete_universe(sweep.workers[i].universe);
+            }
+            free(sweep.workers[i].pixels);
+        }
+        pthread_mutex_destroy(&sweep.mutex);
+        free(sweep.workers);
+        free(sweep.idle_workers);
+        delete_cached_geometry(sweep.geometry);
+        delete_thread_pool(pool);
+    }
+    for (size_t i = 0; i < scene_count; i++) {
+        if (i < loaded_count) {
+            delete_scene(sweep.scenes[i].scene);
+        }
+        free(sweep.scenes[i].values);
+        free(sweep.scenes[i].output_path);
+    }
+    free(sweep.scenes);
+    return failed;
+}
+
+void print_usage(const char *program) {
+    printf("Usage: %s [-t threads] [-s WIDTHxHEIGHT] [-m MEBIBYTES] [-n sampled|bound] [-w workers [-g tile] [-k seconds]\n"
+           "       [-x worker]] [-r LEFT,TOP,WIDTH,HEIGHT [-M maximum | -e]] [-p NAME=FIRST:LAST:STEP]... [-c oscillators|measure]\n"
+           "       SCENE OUTPUT\n",
+           program);
+    printf("OUTPUT is a .png or a .ppm file. By default, every processor is used and the size of the scene is kept.\n");
+    printf("Frames whose buffers exceed the memory budget, %d MiB by default, are streamed in bands, normalized by\n",
+           DEFAULT_MEMORY_BUDGET);
+    printf("the maximum of a sampled first pass or by the bound of the amplitudes.\n");
+    printf("With -w, tiles of the frame are rendered by that many worker processes, each with the threads of -t.\n");
+    printf("With -r, only a rectangle of the frame is rendered, normalized by -M, or its maximum is estimated with -e.\n");
+    printf("With -p, SCENE is a template in which ${NAME} is replaced by each value of the parameter, and a scene is\n");
+    printf("rendered on each thread for every combination of the values, numbered after OUTPUT, with a manifest.\n");
+    printf("Frames in memory convolve groups of Oscillators with the same wavelength larger than -c, %zu by default,\n",
+           DEFAULT_CONVOLUTION_THRESHOLD);
+    printf("or larger than the threshold measured once by a benchmark with -c measure.\n");
+}
+
+/**
+ * Parses a positive number of the option, printing what it is if it is invalid.
+ *
+ * Returns 0 if the number was valid.
+ */
+int parse_positive_option(const char *argument, const char *description, long *number) {
+    char *end;
+    *number = strtol(argument, &end, 10);
+    if (end == argument || *end != '\0' || *number < 1) {
+        printf("Invalid %s %s\n", description, argument);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t thread_count = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    long memory_budget = DEFAULT_MEMORY_BUDGET;
+    Normalization normalization = SAMPLED_NORMALIZATION;
+    long worker_count = 0;
+    long tile_size = DEFAULT_TILE_SIZE;
+    long timeout = 0;
+    const char *executable = NULL;
+    int has_region = 0;
+    Region region;
+    int estimating = 0;
+    double maximum_intensity = 0.0;
+    long convolution_threshold = (long) DEFAULT_CONVOLUTION_THRESHOLD;
+    SceneParameter parameters[MAXIMUM_SWEEP_PARAMETERS];
+    size_t parameter_count = 0;
+    int option;
+    long parsed;
+    while ((option = getopt(argc, argv, "t:s:m:n:w:g:k:x:r:M:ep:c:")) != -1) {
+        if (option == 't') {
+            if (parse_positive_option(optarg, "thread count", &parsed)) {
+                return 1;
+            }
+            thread_count = (size_t) parsed;
+        } else if (option == 's') {
+            if (parse_size(optarg, &width, &height)) {
+                printf("Invalid size %s, whose dimensions must be from 1 to %d\n", optarg, UINT16_MAX);
+                return 1;
+            }
+        } else if (option == 'm') {
+            if (parse_positive_option(optarg, "memory budget", &memory_budget)) {
+                return 1;
+            }
+        } else if (option == 'n' && strcmp(optarg, "sampled") == 0) {
+            normalization = SAMPLED_NORMALIZATION;
+        } else if (option == 'n' && strcmp(optarg, "bound") == 0) {
+            normalization = BOUND_NORMALIZATION;
+        } else if (option == 'w') {
+            if (parse_positive_option(optarg, "worker count", &worker_count)) {
+                return 1;
+            }
+        } else if (option == 'g') {
+            if (parse_positive_option(optarg, "tile size", &tile_size)) {
+                return 1;
+            }
+        } else if (option == 'k') {
+            if (parse_positive_option(optarg, "timeout", &timeout)) {
+                return 1;
+            }
+        } else if (option == 'x') {
+            executable = optarg;
+        } else if (option == 'r') {
+            if (parse_region(optarg, &region)) {
+                printf("Invalid region %s\n", optarg);
+                return 1;
+            }
+            has_region = 1;
+        } else if (option == 'M') {
+            char *end;
+            maximum_intensity = strtod(optarg, &end);
+            if (end == optarg || *end != '\0' || !(maximum_intensity >= 0.0) || !isfinite(maximum_intensity)) {
+                printf("Invalid maximum %s\n", optarg);
+                return 1;
+            }
+            normalization = FIXED_NORMALIZATION;
+        } else if (option == 'e') {
+            estimating = 1;
+        } else if (option == 'p') {
+            if (parameter_count == MAXIMUM_SWEEP_PARAMETERS || parse_scene_parameter(optarg, &parameters[parameter_count])) {
+                printf("Invalid parameter %s\n", optarg);
+                return 1;
+            }
+            parameter_count++;
+        } else if (option == 'c' && strcmp(optarg, "measure") == 0) {
+            convolution_threshold = 0;
+        } else if (option == 'c') {
+            if (parse_positive_option(optarg, "convolution threshold", &convolution_threshold)) {
+                return 1;
+            }
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 2 || (worker_count != 0 && (has_region || estimating)) || (estimating && !has_region) ||
+        (parameter_count != 0 && (worker_count != 0 || has_region))) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *scene_path = argv[optind];
+    const char *output_path = argv[optind + 1];
+    ImageFormat format;
+    if (!estimating && get_image_format(output_path, &format)) {
+        printf("Cannot tell the format of %s from its extension\n", output_path);
+        return 1;
+    }
+    if (parameter_count != 0) {
+        return run_sweep(scene_path, parameters, parameter_count, output_path, width, height, thread_count,
+                         (size_t) memory_budget << 20, normalization, maximum_intensity, (size_t) convolution_threshold);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Scene *scene = load_scene(scene_path);
+    if (scene == NULL) {
+        return 1;
+    }
+    if (width == 0) {
+        // Scenes only hold sizes the renderer supports.
+        width = scene->width != 0 ? (uint16_t) scene->width : DEFAULT_WIDTH;
+        height = scene->height != 0 ? (uint16_t) scene->height : DEFAULT_HEIGHT;
+    }
+    // Tiles start on pixels of the first pass, so that their estimates sample the same pixels as the whole frame.
+    tile_size = (long) maximum(MAXIMUM_ESTIMATION_STRIDE, tile_size - tile_size % MAXIMUM_ESTIMATION_STRIDE);
+    if (worker_count != 0 && width <= tile_size && height <= tile_size) {
+        printf("The frame fits in a single tile, rendering it without workers\n");
+        worker_count = 0;
+    }
+    if (worker_count != 0) {
+        char own_executable[4096];
+        const ssize_t length = readlink("/proc/self/exe", own_executable, sizeof(own_executable) - 1);
+        if (executable == NULL && length <= 0) {
+            printf("Cannot find the executable of the workers, which -x sets\n");
+            delete_scene(scene);
+            return 1;
+        }
+        own_executable[length > 0 ? length : 0] = '\0';
+        Coordination coordination;
+        coordination.executable = executable != NULL ? executable : own_executable;
+        coordination.scene_path = scene_path;
+        coordination.frame_width = width;
+        coordination.frame_height = height;
+        coordination.tile_size = (int) tile_size;
+        coordination.worker_count = (size_t) worker_count;
+        coordination.thread_count = thread_count;
+        coordination.memory_budget = memory_budget;
+        coordination.timeout = (int) timeout;
+        coordination.estimating = normalization == SAMPLED_NORMALIZATION;
+        coordination.maximum_intensity = normalization == BOUND_NORMALIZATION ? get_amplitude_bound(scene) : maximum_intensity;
+        const int failed = coordinate_render(&coordination, output_path, format);
+        if (failed) {
+            printf("Could not write %s\n", output_path);
+        } else {
+            printf("Rendered and wrote %dx%d in %.1f ms\n", width, height, get_elapsed_milliseconds(&start));
+        }
+        delete_scene(scene);
+        return failed;
+    }
+
+    if (!has_region) {
+        region = (Region) {0, 0, width, height};
+    } else if (region.left + region.width > width || region.top + region.height > height) {
+        printf("The region is not inside the %dx%d frame\n", width, height);
+        delete_scene(scene);
+        return 1;
+    }
+    const int band_height = get_band_height((size_t) memory_budget << 20, region.width, region.height);
+    if (band_height == 0) {
+        printf("The memory budget cannot hold a row of %d pixels\n", region.width);
+        delete_scene(scene);
+        return 1;
+    }
+    const int streaming = band_height < region.height;
+    Render render = {scene, width, height, region, band_height};
+    Universe *universe = create_universe((uint16_t) region.width, (uint16_t) render.band_height,
+                                         get_geometry_cache_directory());
+    universe->dissipation_model = scene->dissipation_model;
+    // A single frame is drawn, so Layers would never be reused: every Oscillator is evaluated directly, on every thread.
+    universe->layer_cache_budget = 0;
+    universe->thread_pool = create_thread_pool(thread_count);
+    const OscillatorStore *oscillators = scene->oscillators;
+    for (size_t i = 0; i < oscillators->count; i++) {
+        const size_t index = universe_add_oscillator(universe, oscillators->center_x[i], oscillators->center_y[i],
+                                                     oscillators->amplitude[i], oscillators->wavelength[i]);
+        if (index == universe->oscillators->count) {
+            printf("Could not allocate the Oscillators\n");
+            return 1;
+        }
+    }
+    Controller *controller = create_controller(universe);
+    // Frames are never drawn again, so none are cached.
+    Display *display = create_headless_display((uint16_t) region.width, (uint16_t) render.band_height, 0);
+    printf("Loaded %zu Oscillators in %.1f ms\n", oscillators->count, get_elapsed_milliseconds(&start));
+
+    int failed;
+    if (estimating) {
+        universe->evaluation_mode = DIRECT_EVALUATION;
+        failed = write_estimated_maximum(universe, &render, output_path);
+    } else if (streaming || has_region || normalization == FIXED_NORMALIZATION) {
+        // The grids of convolution are several times larger than the band, so every Oscillator is evaluated directly.
+        universe->evaluation_mode = DIRECT_EVALUATION;
+        failed = stream_region(universe, display->pixels, &render, output_path, format, normalization, maximum_intensity);
+    } else {
+        universe->convolution_threshold = get_convolution_threshold((size_t) convolution_threshold, width, height);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        write_waves(display, controller, universe);
+        printf("Rendered %dx%d on %zu threads in %.1f ms\n", width, height, universe->thread_pool->thread_count,
+               get_elapsed_milliseconds(&start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        failed = write_image_file(output_path, display->pixels, width, height);
+        if (!failed) {
+            printf("Wrote %s in %.1f ms\n", output_path, get_elapsed_milliseconds(&start));
+        }
+    }
+    if (failed) {
+        printf("Could not write %s\n", output_path);
+    }
+
+    delete_display(display);
+    free(controller);
+    delete_universe(universe);
+    delete_scene(scene);
+    return failed;
+}
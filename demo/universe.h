@@ -0,0 +1,2707 @@
+// The engine of the demo: the Universe, its evaluation, and the Display frames are drawn through.
+//
+// It is shared by the interactive demo and by the headless renderer, so it does
+// not depend on SDL: frames are presented on a window through the presenter of
+// the Display, which window.h provides for the demo.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cached-geometry.h"
+#include "cluster-tree.h"
+#include "constants.h"
+#include "dissipation.h"
+#include "fdtd.h"
+#include "fft.h"
+#include "frame-cache.h"
+#include "geometry.h"
+#include "oscillator-store.h"
+#include "spatial-index.h"
+#include "thread-pool.h"
+#include "video-capture.h"
+
+/**
+ * The width of the window when it is created, in pixels.
+ */
+#define DEFAULT_WIDTH 500
+
+/**
+ * The height of the window when it is created, in pixels.
+ */
+#define DEFAULT_HEIGHT 500
+
+/**
+ * The window may not be resized to less than this width and height, in pixels.
+ */
+#define MINIMUM_SIZE 64
+
+#define FRAMES_PER_SEC 10
+
+/**
+ * By default, the maximum number of bytes used by the cached Layers of the Oscillators.
+ *
+ * Oscillators beyond this budget are evaluated directly.
+ */
+static const size_t LAYER_CACHE_BUDGET = 256 * 1024 * 1024;
+
+/**
+ * The maximum number of bytes used by the finished frames kept for states which are drawn again, unless
+ * WAVES_FRAME_CACHE sets another number of mebibytes.
+ */
+static const size_t DEFAULT_FRAME_CACHE_BUDGET = 64 * 1024 * 1024;
+
+static const double MINIMUM_AMPLITUDE = 0.1;
+static const double DEFAULT_AMPLITUDE = 1.0;
+static const double MAXIMUM_AMPLITUDE = 2.0;
+
+static const double AMPLITUDE_TICK = 0.1;
+
+/**
+ * How far the arrow keys move the selected Oscillator, in pixels.
+ */
+static const double MOVEMENT_TICK = 1.0;
+
+/**
+ * How far the arrow keys move the selected Oscillator while Shift is held, in pixels.
+ */
+static const double FINE_MOVEMENT_TICK = 0.125;
+
+/**
+ * How far Control and the arrow keys pan the view, in pixels of the window.
+ */
+static const int PAN_TICK = 32;
+
+/**
+ * The view can be zoomed in or out by up to this many factors of two.
+ */
+#define MAXIMUM_ZOOM 3
+
+/**
+ * How close to an Oscillator a click must be to select it, in pixels.
+ */
+static const double SELECTION_RADIUS = 8.0;
+
+/**
+ * By default, cutting off distant waves may change the image by at most half a quantization step.
+ *
+ * This bounds the sum of the waves cut off at a pixel, so each Oscillator gets a share of it.
+ */
+static const double DEFAULT_CUTOFF_ERROR = 0.5;
+
+/**
+ * By default, each far-field approximation of a cluster may change the image by at most half a quantization step.
+ */
+static const double DEFAULT_CLUSTERING_ERROR = 0.5;
+
+static const double MINIMUM_CLUSTERING_ERROR = 0.0625;
+static const double MAXIMUM_CLUSTERING_ERROR = 16.0;
+
+/**
+ * By default, interpolating the waves of a tile may change the image by at most half a quantization step.
+ */
+static const double DEFAULT_INTERPOLATION_ERROR = 0.5;
+
+static const double MINIMUM_INTERPOLATION_ERROR = 0.0625;
+static const double MAXIMUM_INTERPOLATION_ERROR = 16.0;
+
+/**
+ * Interpolated tiles are sampled every 2, 4, or 8 pixels.
+ */
+#define MAXIMUM_INTERPOLATION_SPACING 8
+
+/**
+ * A tile of samples has a sample before and two samples after the tile along each axis, for the cubic interpolation.
+ */
+#define INTERPOLATION_SAMPLES_SIZE (SPATIAL_INDEX_TILE_SIZE + 3 * MAXIMUM_INTERPOLATION_SPACING)
+
+/**
+ * The number of Oscillators above which convolution is used until the benchmark measures it.
+ */
+static const size_t DEFAULT_CONVOLUTION_THRESHOLD = 256;
+
+/**
+ * The number of Oscillators evaluated directly by the convolution benchmark.
+ */
+static const size_t CONVOLUTION_BENCHMARK_OSCILLATORS = 16;
+
+/**
+ * How many times the convolution benchmark measures each way of evaluating, keeping the fastest.
+ */
+static const int CONVOLUTION_BENCHMARK_RUNS = 3;
+
+/**
+ * The largest dimension the demo measures the convolution threshold at.
+ *
+ * The cost of convolving and the cost of evaluating an Oscillator directly
+ * both grow with the number of pixels, so the threshold only grows with the
+ * logarithm of the size, and a capped size measures it quickly.
+ */
+static const uint16_t CONVOLUTION_BENCHMARK_SIZE = 512;
+
+/**
+ * The number of steps of the simulation per frame.
+ */
+static const int SIMULATION_STEPS_PER_FRAME = 20;
+
+/**
+ * The value added to the field by an Oscillator with unit amplitude at its crests.
+ */
+static const float SIMULATION_SOURCE_STRENGTH = 0.1f;
+
+/**
+ * Simulated values this many times the root mean square of the field are drawn at full intensity.
+ */
+static const double SIMULATION_DISPLAY_RANGE = 3.0;
+
+/**
+ * The number of neighboring positions of the selected Oscillator whose Layers are precomputed.
+ */
+#define SPECULATION_SLOTS 4
+
+/**
+ * Precomputed Layers are computed this many rows at a time, between checks for cancellation.
+ */
+#define SPECULATION_CHUNK_ROWS 16
+
+/**
+ * Pixels beyond the caches are evaluated this many at a time.
+ */
+#define EVALUATED_SPAN_CHUNK 256
+
+/**
+ * By default, frames drawn while the user interacts should take at most this long, in milliseconds.
+ */
+static const uint32_t DEFAULT_FRAME_BUDGET = 1000 / FRAMES_PER_SEC;
+
+static const uint32_t MINIMUM_FRAME_BUDGET = 10;
+static const uint32_t MAXIMUM_FRAME_BUDGET = 1000;
+
+typedef struct Point {
+    double x;
+    double y;
+} Point;
+
+static const Point ORIGIN = {0.0, 0.0};
+
+/**
+ * Returns whether or not the Point is at the center of a pixel, where the two-dimensional caches apply.
+ */
+static inline int is_on_pixel(const Point point) {
+    return point.x == floor(point.x) && point.y == floor(point.y);
+}
+
+/**
+ * The contribution of an Oscillator to the value matrix.
+ *
+ * A Layer records the state with which its Oscillator is currently accumulated
+ * into the value matrix, so that changes can be applied incrementally.
+ *
+ * If the Layer has storage, it also caches the unit-amplitude contribution.
+ * The undissipated wave term is only valid for the center and the wavelength
+ * it was computed with, and the values for the dissipation model they were
+ * attenuated with. As long as the wave term is valid, changing the amplitude
+ * or the dissipation model only requires a single pass over the Layer.
+ *
+ * Layers without storage are evaluated directly whenever they change.
+ */
+typedef struct Layer {
+    double **wave; // The undissipated wave term, NULL if the Layer has no storage.
+    double **values; // The wave term after dissipation, NULL if the Layer has no storage.
+    int computed; // Whether or not the Layer has been evaluated at least once.
+    Point center;
+    double wavelength;
+    DissipationModel dissipation_model;
+    double amplitude; // The amplitude this Layer is currently accumulated into the value matrix with.
+    double cutoff_radius; // Only pixels within this distance of the center are accumulated.
+} Layer;
+
+/**
+ * How Oscillators without cached Layers are evaluated.
+ */
+typedef enum EvaluationMode {
+    AUTOMATIC_EVALUATION, // Convolution for groups of Oscillators above the convolution threshold.
+    DIRECT_EVALUATION,
+    CONVOLUTION_EVALUATION,
+    NUMBER_OF_EVALUATION_MODES // Helper value
+} EvaluationMode;
+
+static inline char *evaluation_mode_to_string(EvaluationMode mode) {
+    if (mode == AUTOMATIC_EVALUATION) {
+        return "automatic";
+    } else if (mode == DIRECT_EVALUATION) {
+        return "direct";
+    } else if (mode == CONVOLUTION_EVALUATION) {
+        return "convolution";
+    } else {
+        return "unknown";
+    }
+}
+
+/**
+ * How the value matrix is produced from the Oscillators.
+ */
+typedef enum Engine {
+    SUPERPOSITION_ENGINE, // Circular waves summed analytically.
+    SIMULATION_ENGINE, // The wave equation integrated in time, with the Oscillators as sources.
+    NUMBER_OF_ENGINES // Helper value
+} Engine;
+
+static inline char *engine_to_string(Engine engine) {
+    if (engine == SUPERPOSITION_ENGINE) {
+        return "superposition";
+    } else if (engine == SIMULATION_ENGINE) {
+        return "simulation";
+    } else {
+        return "unknown";
+    }
+}
+
+/**
+ * The state used to evaluate Oscillators with the same wavelength by FFT convolution.
+ *
+ * The field of such Oscillators is the convolution of an image with their
+ * amplitudes at their centers with the dissipated wave of a single Oscillator.
+ * The grid is large enough for the circular convolution to equal the linear
+ * one over the value matrix.
+ */
+typedef struct Convolution {
+    size_t width;
+    size_t height;
+    FFTPlan *row_plan;
+    FFTPlan *column_plan;
+    double complex *kernel; // The transform of the dissipated wave, indexed by offset modulo the grid size.
+    int kernel_computed;
+    double kernel_wavelength;
+    DissipationModel kernel_model;
+    double complex *grid;
+    double complex *buffer;
+} Convolution;
+
+/**
+ * Precomputes the Layers of the selected Oscillator at the positions the arrow keys would move it to.
+ *
+ * A background thread computes the waves and their values, on a ThreadPool of
+ * its own, while the main thread is idle. When the Oscillator is moved to one
+ * of these positions, its Layer swaps in the precomputed matrices instead of
+ * computing them. Moving it anywhere else, or posting a new request, cancels
+ * the work in progress and discards what was computed.
+ */
+typedef struct Speculation {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t request_posted;
+    pthread_cond_t work_stopped;
+    ThreadPool *pool;
+    int busy; // Whether or not the thread is computing, in which case it owns the matrices.
+    int pending; // Whether or not a request is waiting for the thread.
+    atomic_int cancelled;
+    int stopping;
+    Point origin; // The position the neighbors of the request are around.
+    Point centers[SPECULATION_SLOTS];
+    double wavelength;
+    DissipationModel model;
+    const CachedGeometry *geometry; // The caches of the Universe, which must not grow while the thread computes.
+    uint16_t width; // The dimensions of the matrices, which match the Universe.
+    uint16_t height;
+    double **waves[SPECULATION_SLOTS];
+    double **values[SPECULATION_SLOTS];
+    int ready[SPECULATION_SLOTS];
+} Speculation;
+
+typedef struct Universe {
+    uint16_t width;
+    uint16_t height;
+    double **value_matrix;
+    CachedGeometry *geometry; // The caches of the Universe, which only it grows.
+    int shares_geometry; // Whether or not the caches belong to the caller, in which case they never grow.
+    int view_x; // The position of the center of the view in the plane. Oscillators are stored relative to it.
+    int view_y;
+    int zoom; // The view magnifies the plane by 2^zoom, so negative levels show more of it.
+    double **zoomed_matrix; // The values of frames zoomed out, at their pixels. NULL until the view is first zoomed out.
+    DissipationModel dissipation_model;
+    OscillatorStore *oscillators;
+    Layer *layers; // The Layer of each Oscillator, parallel to the OscillatorStore.
+    size_t layer_capacity;
+    size_t layer_cache_budget; // The maximum number of bytes used by the storage of the Layers.
+    Layer *retired_layers; // Layers of deleted Oscillators which still contribute to the value matrix.
+    size_t retired_layer_count;
+    int cutoff_enabled; // Whether or not uncached Oscillators are cut off where they become negligible.
+    double cutoff_error; // The maximum error introduced by cutting off, in quantization steps.
+    double cutoff_tolerance; // The maximum value of a wave beyond its cutoff radius.
+    size_t cutoff_share_count; // How many Oscillators the cutoff error was shared among, at least as many as there are.
+    int clustering_enabled; // Whether or not distant clusters of uncached Oscillators are approximated.
+    double clustering_error; // The maximum error of each far-field approximation, in quantization steps.
+    double clustering_tolerance; // The maximum error of each far-field approximation.
+    int interpolation_enabled; // Whether or not uncached Oscillators are interpolated between samples where they are smooth.
+    double interpolation_error; // The maximum error of interpolating a tile, in quantization steps.
+    double interpolation_tolerance; // The maximum error of interpolating a tile.
+    int rebuild_requested; // Whether or not the value matrix must be rebuilt on the next update.
+    SpatialIndex *spatial_index; // Maps tiles of the value matrix to the uncached Oscillators which affect them.
+    EvaluationMode evaluation_mode;
+    size_t convolution_threshold; // The group size above which automatic evaluation uses convolution.
+    Convolution *convolution; // NULL until the first convolution.
+    Engine engine;
+    ThreadPool *thread_pool; // Steps the simulation and evaluates uncached Oscillators. NULL until the first simulation.
+    FDTDSimulation *simulation; // NULL until the first simulation.
+    Speculation *speculation; // NULL unless speculation is enabled.
+    int verbose; // Whether or not how each frame was evaluated and how long it took is printed.
+} Universe;
+
+static const DissipationModel DEFAULT_UNIVERSE_DISSIPATION_MODEL = NO_DISSIPATION;
+
+typedef enum HighlightMode {
+    HIGHLIGHT_NONE, HIGHLIGHT_DOT
+} HighlightMode;
+
+/**
+ * The structure responsible for modifying an Universe from user input.
+ */
+typedef struct Controller {
+    Universe *universe;
+    size_t selection;
+    HighlightMode highlight;
+    int rendering; // Whether or not we are rendering.
+    int dragging; // Whether or not the selected Oscillator follows the mouse.
+    uint32_t frame_budget; // How long frames drawn while the user interacts should take, in milliseconds.
+    int progressive; // Whether or not frames start at the coarsest resolution and are refined until input arrives.
+} Controller;
+
+struct Display;
+
+/**
+ * Presents the pixels of the Display, quantized with the stride, on its window.
+ */
+typedef void (*FramePresenter)(struct Display *display, const Controller *controller, const Universe *universe, int stride);
+
+/**
+ * The buffers frames are drawn through, and the window they are presented on.
+ *
+ * Frames are quantized into the pixel buffer and handed to the presenter, which
+ * scales them to the window, so frames computed at a reduced resolution only use
+ * the top-left part of the buffer. Finished superposition frames are also kept
+ * in a FrameCache, so that states which are drawn again are presented without
+ * being computed.
+ *
+ * A headless Display has no window or presenter: frames are only quantized into
+ * its pixel buffer.
+ */
+typedef struct Display {
+    void *window; // Whatever the presenter draws to, which its creator releases. NULL if the Display is headless.
+    FramePresenter present; // NULL if the Display is headless.
+    uint16_t width; // The dimensions of the pixel buffer, which match the Universe.
+    uint16_t height;
+    uint32_t *pixels; // Width by height pixels, row by row.
+    FrameCache *frame_cache; // Full resolution frames keyed by the hash of the state of the Universe.
+    VideoCapture *capture; // Records the presented frames. NULL unless recording.
+} Display;
+
+/**
+ * Creates a matrix of doubles with the specified dimensions filled with zeros.
+ */
+static inline double **create_matrix(const uint16_t width, const uint16_t height) {
+    double **matrix = malloc(height * sizeof(double *));
+    if (matrix) {
+        for (uint16_t y = 0; y < height; y++) {
+            matrix[y] = calloc(width, sizeof(double));
+        }
+    }
+    return matrix;
+}
+
+static inline void delete_matrix(double **matrix, const uint16_t height) {
+    for (uint16_t y = 0; y < height; y++) {
+        free(matrix[y]);
+    }
+    free(matrix);
+}
+
+/**
+ * Moves the contents of a matrix so that each element takes the value of the element dx columns and dy rows after it.
+ *
+ * Rows are moved by rotating their pointers. The elements which have nothing
+ * to take are set to zero. The shift must be smaller than the matrix.
+ */
+static inline void shift_matrix(double **matrix, const uint16_t width, const uint16_t height, const int dx, const int dy) {
+    double **rows = malloc(height * sizeof(double *));
+    for (int y = 0; y < height; y++) {
+        rows[y] = matrix[((y + dy) % height + height) % height];
+    }
+    memcpy(matrix, rows, height * sizeof(double *));
+    free(rows);
+    for (int y = 0; y < height; y++) {
+        double *row = matrix[y];
+        if (y + dy < 0 || y + dy >= height) {
+            memset(row, 0, width * sizeof(double));
+        } else if (dx > 0) {
+            memmove(row, row + dx, (width - dx) * sizeof(double));
+            memset(row + width - dx, 0, dx * sizeof(double));
+        } else if (dx < 0) {
+            memmove(row - dx, row, (width + dx) * sizeof(double));
+            memset(row, 0, -dx * sizeof(double));
+        }
+    }
+}
+
+/**
+ * Initializes a Layer which has not been evaluated yet and does not contribute to the value matrix.
+ */
+static inline void init_layer(Layer *layer, DissipationModel model) {
+    layer->wave = NULL;
+    layer->values = NULL;
+    layer->computed = 0;
+    layer->center = ORIGIN;
+    layer->wavelength = 0.0;
+    layer->dissipation_model = model;
+    layer->amplitude = 0.0;
+    layer->cutoff_radius = INFINITY;
+}
+
+/**
+ * Allocates the storage of a Layer.
+ */
+static inline void allocate_layer_storage(const Universe * const universe, Layer *layer) {
+    layer->wave = create_matrix(universe->width, universe->height);
+    layer->values = create_matrix(universe->width, universe->height);
+}
+
+static inline void free_layer_storage(Layer *layer, const uint16_t height) {
+    if (layer->wave != NULL) {
+        delete_matrix(layer->wave, height);
+        delete_matrix(layer->values, height);
+        layer->wave = NULL;
+        layer->values = NULL;
+    }
+}
+
+/**
+ * Returns how many Layers may have storage without exceeding the layer cache budget.
+ */
+static inline size_t get_layer_storage_limit(const Universe * const universe) {
+    const size_t layer_size = 2 * (size_t) universe->width * universe->height * sizeof(double);
+    return universe->layer_cache_budget / layer_size;
+}
+
+/**
+ * Evaluates the undissipated wave term of an Oscillator into the columns [left, right) of the rows [top, bottom) of a matrix.
+ *
+ * The matrix has the specified dimensions and is centered on the origin.
+ */
+static inline void compute_wave_region(const CachedGeometry * const geometry, double **wave, const uint16_t width, const uint16_t height,
+                                       const Point center, const double wavelength, const int left, const int top, const int right,
+                                       const int bottom) {
+    if (is_on_pixel(center)) {
+        const int first_offset_x = -width / 2 - (int) center.x;
+        for (int y = top; y < bottom; y++) {
+            double *wave_row = wave[y];
+            const int offset_y = y - height / 2 - (int) center.y;
+            // The pixels [begin, end) are in the cache, and the ones around them are evaluated.
+            int begin = left;
+            int end = wavelength == DEFAULT_WAVELENGTH ? right : left;
+            clip_span_to_cache(geometry, &begin, &end, first_offset_x, offset_y);
+            evaluate_sin_of_distances(wave_row + left, begin - left, first_offset_x + left, 1.0, offset_y, wavelength);
+            for (int x = begin; x < end; x++) {
+                wave_row[x] = fetch_sin_of_distance(geometry, abs(first_offset_x + x), abs(offset_y));
+            }
+            evaluate_sin_of_distances(wave_row + end, right - end, first_offset_x + end, 1.0, offset_y, wavelength);
+            for (int x = left; x < right; x++) {
+                wave_row[x] = (wave_row[x] + 1.0) / 2.0;
+            }
+        }
+    } else {
+        const double first_offset_x = -width / 2 - center.x;
+        const double farthest_x = maximum(fabs(first_offset_x + left), fabs(first_offset_x + right - 1));
+        for (int y = top; y < bottom; y++) {
+            double *wave_row = wave[y];
+            const double offset_y = y - height / 2 - center.y;
+            const double farthest_radius = sqrt(square(farthest_x) + square(offset_y));
+            if (wavelength == DEFAULT_WAVELENGTH && is_radius_in_radial_tables(geometry, farthest_radius)) {
+                for (int x = left; x < right; x++) {
+                    const double radius = sqrt(square(first_offset_x + x) + square(offset_y));
+                    wave_row[x] = (sin_of_radius(geometry, radius, wavelength) + 1.0) / 2.0;
+                }
+            } else {
+                evaluate_sin_of_distances(wave_row + left, right - left, first_offset_x + left, 1.0, offset_y, wavelength);
+                for (int x = left; x < right; x++) {
+                    wave_row[x] = (wave_row[x] + 1.0) / 2.0;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Evaluates the undissipated wave term for the center and the wavelength of the Layer into its storage.
+ *
+ * This invalidates the values of the Layer, so it must not be accumulated into the value matrix when this is called.
+ */
+static inline void compute_layer_wave(const Universe * const universe, Layer *layer) {
+    compute_wave_region(universe->geometry, layer->wave, universe->width, universe->height, layer->center, layer->wavelength,
+                        0, 0, universe->width, universe->height);
+}
+
+/**
+ * Attenuates the columns [left, right) of the rows [top, bottom) of the wave term of an Oscillator into a matrix of values.
+ */
+static inline void attenuate_wave_region(const CachedGeometry * const geometry, double **wave, double **values, const uint16_t width,
+                                         const uint16_t height, const Point center, DissipationModel model, const int left, const int top,
+                                         const int right, const int bottom) {
+    const int on_pixel = is_on_pixel(center);
+    for (int y = top; y < bottom; y++) {
+        const double offset_y = y - height / 2 - center.y;
+        for (int x = left; x < right; x++) {
+            const double offset_x = x - width / 2 - center.x;
+            const double factor = on_pixel ? attenuation_of_offset(geometry, model, (int) offset_x, (int) offset_y) :
+                                  attenuation_of_radius(geometry, model, sqrt(square(offset_x) + square(offset_y)));
+            values[y][x] = wave[y][x] * factor;
+        }
+    }
+}
+
+/**
+ * Computes the Layer of a slot of the request, a few rows at a time so that cancellation is noticed quickly.
+ */
+static inline void compute_speculative_layer(void *context, size_t slot) {
+    Speculation *speculation = context;
+    const uint16_t width = speculation->width;
+    const uint16_t height = speculation->height;
+    for (int begin = 0; begin < height; begin += SPECULATION_CHUNK_ROWS) {
+        if (atomic_load(&speculation->cancelled)) {
+            return;
+        }
+        const int end = begin + SPECULATION_CHUNK_ROWS < height ? begin + SPECULATION_CHUNK_ROWS : height;
+        compute_wave_region(speculation->geometry, speculation->waves[slot], width, height, speculation->centers[slot],
+                            speculation->wavelength, 0, begin, width, end);
+        attenuate_wave_region(speculation->geometry, speculation->waves[slot], speculation->values[slot], width, height,
+                              speculation->centers[slot], speculation->model, 0, begin, width, end);
+    }
+    speculation->ready[slot] = 1;
+}
+
+static inline void *run_speculation(void *argument) {
+    Speculation *speculation = argument;
+    pthread_mutex_lock(&speculation->mutex);
+    while (!speculation->stopping) {
+        if (!speculation->pending) {
+            pthread_cond_wait(&speculation->request_posted, &speculation->mutex);
+            continue;
+        }
+        speculation->pending = 0;
+        speculation->busy = 1;
+        pthread_mutex_unlock(&speculation->mutex);
+        run_parallel(speculation->pool, compute_speculative_layer, speculation, SPECULATION_SLOTS);
+        pthread_mutex_lock(&speculation->mutex);
+        speculation->busy = 0;
+        pthread_cond_broadcast(&speculation->work_stopped);
+    }
+    pthread_mutex_unlock(&speculation->mutex);
+    return NULL;
+}
+
+/**
+ * Creates a Speculation of Layers with the specified dimensions whose ThreadPool uses the processors the main thread does not.
+ */
+static inline Speculation *create_speculation(const CachedGeometry * const geometry, const uint16_t width, const uint16_t height) {
+    Speculation *speculation = malloc(sizeof(Speculation));
+    pthread_mutex_init(&speculation->mutex, NULL);
+    pthread_cond_init(&speculation->request_posted, NULL);
+    pthread_cond_init(&speculation->work_stopped, NULL);
+    const size_t processor_count = get_processor_count();
+    speculation->pool = create_thread_pool(processor_count > 1 ? processor_count - 1 : 1);
+    speculation->busy = 0;
+    speculation->pending = 0;
+    atomic_init(&speculation->cancelled, 0);
+    speculation->stopping = 0;
+    speculation->origin = ORIGIN;
+    speculation->wavelength = 0.0;
+    speculation->model = NO_DISSIPATION;
+    speculation->geometry = geometry;
+    speculation->width = width;
+    speculation->height = height;
+    for (int i = 0; i < SPECULATION_SLOTS; i++) {
+        speculation->waves[i] = create_matrix(width, height);
+        speculation->values[i] = create_matrix(width, height);
+        speculation->ready[i] = 0;
+    }
+    if (pthread_create(&speculation->thread, NULL, run_speculation, speculation)) {
+        speculation->stopping = 1;
+    }
+    return speculation;
+}
+
+/**
+ * Cancels the work in progress and waits for the thread to stop. Must be called with the mutex locked.
+ */
+static inline void stop_speculation(Speculation *speculation) {
+    atomic_store(&speculation->cancelled, 1);
+    speculation->pending = 0;
+    while (speculation->busy) {
+        pthread_cond_wait(&speculation->work_stopped, &speculation->mutex);
+    }
+}
+
+static inline void delete_speculation(Speculation *speculation) {
+    pthread_mutex_lock(&speculation->mutex);
+    stop_speculation(speculation);
+    const int started = !speculation->stopping;
+    speculation->stopping = 1;
+    pthread_cond_signal(&speculation->request_posted);
+    pthread_mutex_unlock(&speculation->mutex);
+    if (started) {
+        pthread_join(speculation->thread, NULL);
+    }
+    delete_thread_pool(speculation->pool);
+    for (int i = 0; i < SPECULATION_SLOTS; i++) {
+        delete_matrix(speculation->waves[i], speculation->height);
+        delete_matrix(speculation->values[i], speculation->height);
+    }
+    pthread_mutex_destroy(&speculation->mutex);
+    pthread_cond_destroy(&speculation->request_posted);
+    pthread_cond_destroy(&speculation->work_stopped);
+    free(speculation);
+}
+
+/**
+ * Requests the Layers around the origin, unless they were already requested.
+ */
+static inline void speculate(Speculation *speculation, const Point origin, const double wavelength, DissipationModel model) {
+    pthread_mutex_lock(&speculation->mutex);
+    const int requested = speculation->busy || speculation->pending || speculation->ready[0];
+    const int same = speculation->origin.x == origin.x && speculation->origin.y == origin.y &&
+                     speculation->wavelength == wavelength && speculation->model == model;
+    if (!speculation->stopping && !(requested && same)) {
+        stop_speculation(speculation);
+        const Point offsets[SPECULATION_SLOTS] = {{0.0, -MOVEMENT_TICK}, {MOVEMENT_TICK, 0.0}, {0.0, MOVEMENT_TICK}, {-MOVEMENT_TICK, 0.0}};
+        for (int i = 0; i < SPECULATION_SLOTS; i++) {
+            speculation->centers[i].x = origin.x + offsets[i].x;
+            speculation->centers[i].y = origin.y + offsets[i].y;
+            speculation->ready[i] = 0;
+        }
+        speculation->origin = origin;
+        speculation->wavelength = wavelength;
+        speculation->model = model;
+        atomic_store(&speculation->cancelled, 0);
+        speculation->pending = 1;
+        pthread_cond_signal(&speculation->request_posted);
+    }
+    pthread_mutex_unlock(&speculation->mutex);
+}
+
+/**
+ * Cancels the request and, if one of its Layers matches the arguments, swaps it into the matrices.
+ *
+ * The matrices passed in take the place of the precomputed ones. Returns whether or not a Layer was swapped in.
+ */
+static inline int take_speculative_layer(Speculation *speculation, const Point center, const double wavelength, DissipationModel model,
+                                         double ***wave, double ***values) {
+    pthread_mutex_lock(&speculation->mutex);
+    stop_speculation(speculation);
+    int taken = 0;
+    for (int i = 0; i < SPECULATION_SLOTS; i++) {
+        const int matches = speculation->centers[i].x == center.x && speculation->centers[i].y == center.y &&
+                            speculation->wavelength == wavelength && speculation->model == model;
+        if (speculation->ready[i] && matches && !taken) {
+            double **swapped_wave = *wave;
+            double **swapped_values = *values;
+            *wave = speculation->waves[i];
+            *values = speculation->values[i];
+            speculation->waves[i] = swapped_wave;
+            speculation->values[i] = swapped_values;
+            taken = 1;
+        }
+        speculation->ready[i] = 0;
+    }
+    pthread_mutex_unlock(&speculation->mutex);
+    return taken;
+}
+
+/**
+ * Creates a Universe without Oscillators which reads caches owned by the caller.
+ *
+ * Several Universes may share the caches, as reading them is thread-safe. The
+ * caches must already cover every offset the Universe reads, as it never grows
+ * them, and must outlive it.
+ */
+static inline Universe *create_universe_sharing_geometry(const uint16_t width, const uint16_t height, CachedGeometry *geometry) {
+    Universe *universe = malloc(sizeof(Universe));
+
+    universe->width = width;
+    universe->height = height;
+
+    // Initialize the value matrix and the caches which cover it
+    universe->value_matrix = create_matrix(width, height);
+    universe->geometry = geometry;
+    universe->shares_geometry = 1;
+
+    // Initialize the view
+    universe->view_x = 0;
+    universe->view_y = 0;
+    universe->zoom = 0;
+    universe->zoomed_matrix = NULL;
+
+    universe->dissipation_model = DEFAULT_UNIVERSE_DISSIPATION_MODEL;
+
+    // Initialize the Oscillators and their Layers
+    universe->oscillators = create_oscillator_store();
+    universe->layers = NULL;
+    universe->layer_capacity = 0;
+    universe->layer_cache_budget = LAYER_CACHE_BUDGET;
+    universe->retired_layers = NULL;
+    universe->retired_layer_count = 0;
+
+    // Initialize the cutoff and the SpatialIndex
+    universe->cutoff_enabled = 0;
+    universe->cutoff_error = DEFAULT_CUTOFF_ERROR;
+    universe->cutoff_tolerance = 0.0;
+    universe->cutoff_share_count = 0;
+    universe->clustering_enabled = 0;
+    universe->clustering_error = DEFAULT_CLUSTERING_ERROR;
+    universe->clustering_tolerance = 0.0;
+    universe->interpolation_enabled = 0;
+    universe->interpolation_error = DEFAULT_INTERPOLATION_ERROR;
+    universe->interpolation_tolerance = 0.0;
+    universe->rebuild_requested = 0;
+    universe->spatial_index = create_spatial_index(-width / 2, -height / 2, width, height, SPATIAL_INDEX_TILE_SIZE);
+
+    universe->evaluation_mode = AUTOMATIC_EVALUATION;
+    universe->convolution_threshold = DEFAULT_CONVOLUTION_THRESHOLD;
+    universe->convolution = NULL;
+    universe->engine = SUPERPOSITION_ENGINE;
+    universe->thread_pool = NULL;
+    universe->simulation = NULL;
+    universe->speculation = NULL;
+    universe->verbose = 0;
+    return universe;
+}
+
+/**
+ * Creates a Universe without Oscillators.
+ *
+ * Its caches are persisted in the geometry cache directory, unless it is NULL.
+ */
+static inline Universe *create_universe(const uint16_t width, const uint16_t height, const char *geometry_cache_directory) {
+    CachedGeometry *geometry = create_cached_geometry(geometry_cache_directory, width > height ? width : height);
+    Universe *universe = create_universe_sharing_geometry(width, height, geometry);
+    universe->shares_geometry = 0;
+    return universe;
+}
+
+static inline Convolution *create_convolution(const uint16_t width, const uint16_t height) {
+    Convolution *convolution = malloc(sizeof(Convolution));
+    convolution->width = next_fft_size(2 * (size_t) width - 1);
+    convolution->height = next_fft_size(2 * (size_t) height - 1);
+    convolution->row_plan = create_fft_plan(convolution->width);
+    convolution->column_plan = create_fft_plan(convolution->height);
+    const size_t size = convolution->width * convolution->height;
+    convolution->kernel = malloc(size * sizeof(double complex));
+    convolution->kernel_computed = 0;
+    convolution->kernel_wavelength = 0.0;
+    convolution->kernel_model = NO_DISSIPATION;
+    convolution->grid = malloc(size * sizeof(double complex));
+    const size_t length = convolution->width > convolution->height ? convolution->width : convolution->height;
+    convolution->buffer = malloc(2 * length * sizeof(double complex));
+    return convolution;
+}
+
+static inline void delete_convolution(Convolution *convolution) {
+    delete_fft_plan(convolution->row_plan);
+    delete_fft_plan(convolution->column_plan);
+    free(convolution->kernel);
+    free(convolution->grid);
+    free(convolution->buffer);
+    free(convolution);
+}
+
+static inline void delete_universe(Universe *universe) {
+    for (size_t i = 0; i < universe->oscillators->count; i++) {
+        free_layer_storage(&universe->layers[i], universe->height);
+    }
+    for (size_t i = 0; i < universe->retired_layer_count; i++) {
+        free_layer_storage(&universe->retired_layers[i], universe->height);
+    }
+    free(universe->layers);
+    free(universe->retired_layers);
+    delete_oscillator_store(universe->oscillators);
+    delete_matrix(universe->value_matrix, universe->height);
+    if (universe->zoomed_matrix != NULL) {
+        delete_matrix(universe->zoomed_matrix, universe->height);
+    }
+    delete_spatial_index(universe->spatial_index);
+    if (universe->convolution != NULL) {
+        delete_convolution(universe->convolution);
+    }
+    if (universe->simulation != NULL) {
+        delete_fdtd_simulation(universe->simulation);
+    }
+    if (universe->thread_pool != NULL) {
+        delete_thread_pool(universe->thread_pool);
+    }
+    if (universe->speculation != NULL) {
+        delete_speculation(universe->speculation);
+    }
+    if (!universe->shares_geometry) {
+        delete_cached_geometry(universe->geometry);
+    }
+    free(universe);
+}
+
+/**
+ * Grows the caches of the Universe to cover the offsets from the Oscillators to the pixels of the frame.
+ *
+ * The caches cover at least the dimensions of the value matrix, so that every
+ * Oscillator in view is covered, and grow in chunks as Oscillators move away or
+ * the view is zoomed out. Speculation is stopped while they grow, as no other
+ * thread may use them meanwhile. Shared caches are sized by their owner instead.
+ */
+static inline void ensure_cached_geometry(const Universe * const universe) {
+    const OscillatorStore *store = universe->oscillators;
+    const double scale = universe->zoom < 0 ? 1 << -universe->zoom : 1;
+    double required = universe->width > universe->height ? universe->width : universe->height;
+    for (size_t index = 0; index < store->count; index++) {
+        required = maximum(required, fabs(store->center_x[index]) + scale * (universe->width / 2) + 1.0);
+        required = maximum(required, fabs(store->center_y[index]) + scale * (universe->height / 2) + 1.0);
+    }
+    const int maximum = (int) minimum(ceil(required), MAXIMUM_CACHED_GEOMETRY_OFFSET);
+    if (maximum > universe->geometry->maximum && !universe->shares_geometry) {
+        if (universe->speculation != NULL) {
+            pthread_mutex_lock(&universe->speculation->mutex);
+            stop_speculation(universe->speculation);
+            pthread_mutex_unlock(&universe->speculation->mutex);
+        }
+        clock_t start = clock();
+        if (grow_cached_geometry(universe->geometry, maximum)) {
+            printf("Could not cache offsets up to %d pixels\n", maximum);
+            return;
+        }
+        const int ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
+        printf("Took %d ms to cache offsets up to %d pixels.\n", ms, universe->geometry->maximum);
+    }
+}
+
+/**
+ * Changes the dimensions of the value matrix of the Universe.
+ *
+ * Everything sized by the dimensions is released and the value matrix is
+ * rebuilt on the next update. The simulation starts over.
+ */
+static inline void resize_universe(Universe *universe, const uint16_t width, const uint16_t height) {
+    // Speculation reads the caches of the cached geometry, which may be resized.
+    const int speculating = universe->speculation != NULL;
+    if (speculating) {
+        delete_speculation(universe->speculation);
+        universe->speculation = NULL;
+    }
+    for (size_t i = 0; i < universe->oscillators->count; i++) {
+        free_layer_storage(&universe->layers[i], universe->height);
+        universe->layers[i].computed = 0;
+    }
+    for (size_t i = 0; i < universe->retired_layer_count; i++) {
+        free_layer_storage(&universe->retired_layers[i], universe->height);
+    }
+    free(universe->retired_layers);
+    universe->retired_layers = NULL;
+    universe->retired_layer_count = 0;
+    delete_matrix(universe->value_matrix, universe->height);
+    if (universe->zoomed_matrix != NULL) {
+        delete_matrix(universe->zoomed_matrix, universe->height);
+        universe->zoomed_matrix = NULL;
+    }
+    delete_spatial_index(universe->spatial_index);
+    if (universe->convolution != NULL) {
+        delete_convolution(universe->convolution);
+        universe->convolution = NULL;
+    }
+    if (universe->simulation != NULL) {
+        delete_fdtd_simulation(universe->simulation);
+        universe->simulation = NULL;
+    }
+
+    universe->width = width;
+    universe->height = height;
+    universe->value_matrix = create_matrix(width, height);
+    universe->spatial_index = create_spatial_index(-width / 2, -height / 2, width, height, SPATIAL_INDEX_TILE_SIZE);
+    universe->rebuild_requested = 1;
+    ensure_cached_geometry(universe);
+    if (speculating) {
+        universe->speculation = create_speculation(universe->geometry, width, height);
+    }
+}
+
+/**
+ * Adds an Oscillator to the Universe.
+ *
+ * Returns the index of the new Oscillator, or the number of Oscillators if it could not be added.
+ */
+static inline size_t universe_add_oscillator(Universe *universe, double x, double y, double amplitude, double wavelength) {
+    const size_t index = add_oscillator(universe->oscillators, x, y, amplitude, wavelength);
+    if (index == universe->oscillators->count) {
+        return index;
+    }
+    if (universe->layer_capacity < universe->oscillators->capacity) {
+        Layer *layers = realloc(universe->layers, universe->oscillators->capacity * sizeof(Layer));
+        if (layers == NULL) {
+            remove_oscillator(universe->oscillators, index);
+            return universe->oscillators->count;
+        }
+        universe->layers = layers;
+        universe->layer_capacity = universe->oscillators->capacity;
+    }
+    init_layer(&universe->layers[index], universe->dissipation_model);
+    return index;
+}
+
+/**
+ * Removes an Oscillator from the Universe by moving the last Oscillator into its place.
+ *
+ * Its contribution is removed from the value matrix on the next update.
+ */
+static inline void universe_remove_oscillator(Universe *universe, size_t index) {
+    const size_t new_count = universe->retired_layer_count + 1;
+    universe->retired_layers = realloc(universe->retired_layers, new_count * sizeof(Layer));
+    universe->retired_layers[universe->retired_layer_count] = universe->layers[index];
+    universe->retired_layer_count = new_count;
+    universe->layers[index] = universe->layers[universe->oscillators->count - 1];
+    remove_oscillator(universe->oscillators, index);
+}
+
+static inline Controller *create_controller(Universe *universe) {
+    Controller *controller = malloc(sizeof(Controller));
+    controller->universe = universe;
+    controller->selection = 0;
+    controller->highlight = HIGHLIGHT_DOT;
+    controller->rendering = 1;
+    controller->dragging = 0;
+    controller->frame_budget = DEFAULT_FRAME_BUDGET;
+    controller->progressive = 0;
+    return controller;
+}
+
+/**
+ * Creates a headless Display of the specified dimensions, whose frame cache keeps at most frame_cache_budget bytes.
+ */
+static inline Display *create_headless_display(const uint16_t width, const uint16_t height, const size_t frame_cache_budget) {
+    Display *display = malloc(sizeof(Display));
+    display->window = NULL;
+    display->present = NULL;
+    display->width = width;
+    display->height = height;
+    display->pixels = calloc((size_t) width * height, sizeof(uint32_t));
+    display->frame_cache = create_frame_cache(frame_cache_budget);
+    display->capture = NULL;
+    return display;
+}
+
+/**
+ * Replaces the pixel buffer of the Display with one of the specified dimensions.
+ *
+ * Cached frames are kept, as their sizes tell them apart.
+ */
+static inline void resize_display(Display *display, const uint16_t width, const uint16_t height) {
+    free(display->pixels);
+    display->width = width;
+    display->height = height;
+    display->pixels = calloc((size_t) width * height, sizeof(uint32_t));
+}
+
+/**
+ * Releases the Display, whose window must be released by whoever created it.
+ */
+static inline void delete_display(Display *display) {
+    if (display->capture != NULL) {
+        stop_video_capture(display->capture);
+        delete_video_capture(display->capture);
+    }
+    free(display->pixels);
+    delete_frame_cache(display->frame_cache);
+    free(display);
+}
+
+/**
+ * Returns whether or not the Layer was evaluated with the center and the wavelength of the Oscillator.
+ */
+static inline int is_layer_wave_valid(const Layer * const layer, const OscillatorStore * const store, size_t index) {
+    return layer->computed &&
+           layer->center.x == store->center_x[index] &&
+           layer->center.y == store->center_y[index] &&
+           layer->wavelength == store->wavelength[index];
+}
+
+/**
+ * Returns the cutoff radius of an uncached Oscillator with the specified amplitude.
+ */
+static inline double get_cutoff_radius(const Universe * const universe, DissipationModel model, const double amplitude) {
+    if (!universe->cutoff_enabled || amplitude <= 0.0) {
+        return INFINITY;
+    }
+    return cutoff_radius(model, universe->cutoff_tolerance / amplitude);
+}
+
+/**
+ * Chooses the cutoff and clustering tolerances for the Oscillators of the Universe.
+ *
+ * All waves are non-negative, so the maximum intensity is at least the first
+ * crest of any Oscillator in view. It is also at least the average intensity,
+ * and the average of a wave term over a view spanning a wavelength is more
+ * than a quarter, which bounds it for many distant Oscillators.
+ *
+ * Any number of Oscillators may be cut off at a pixel, so the cutoff error is
+ * shared among them: each wave is cut off where it is below the tolerance
+ * divided by a power of two no less than the number of Oscillators. Cutting
+ * off then changes the normalized image by at most cutoff_error quantization
+ * steps until the Oscillators outnumber that power of two, which is when the
+ * value matrix is rebuilt. Clustering changes it by at most clustering_error
+ * per cluster approximated at a pixel, and interpolation by at most
+ * interpolation_error per interpolated tile.
+ */
+static inline void update_error_tolerances(Universe *universe) {
+    const OscillatorStore *store = universe->oscillators;
+    const DissipationModel model = universe->dissipation_model;
+    double crest_bound = 0.0;
+    double average_bound = 0.0;
+    for (size_t i = 0; i < store->count; i++) {
+        if (fabs(store->center_x[i]) < universe->width / 2 && fabs(store->center_y[i]) < universe->height / 2) {
+            const double crest = store->amplitude[i] * attenuation(model, store->wavelength[i] / 4.0);
+            crest_bound = maximum(crest_bound, crest);
+        }
+        // The farthest pixel of the view is at one of its corners.
+        const double farthest_x = fabs(store->center_x[i]) + universe->width / 2;
+        const double farthest_y = fabs(store->center_y[i]) + universe->height / 2;
+        average_bound += store->amplitude[i] * attenuation(model, sqrt(square(farthest_x) + square(farthest_y))) / 4.0;
+    }
+    const double maximum_intensity_bound = maximum(crest_bound, average_bound);
+    // Doubling the share as Oscillators are added only rebuilds the value matrix a logarithmic number of times.
+    size_t share_count = 1;
+    while (share_count < store->count) {
+        share_count *= 2;
+    }
+    universe->cutoff_share_count = share_count;
+    universe->cutoff_tolerance = universe->cutoff_error * maximum_intensity_bound / 255.0 / share_count;
+    universe->clustering_tolerance = universe->clustering_error * maximum_intensity_bound / 255.0;
+    universe->interpolation_tolerance = universe->interpolation_error * maximum_intensity_bound / 255.0;
+}
+
+/**
+ * Restricts the range [*begin, *end) of a row to the pixels within the radius of an oscillator.
+ *
+ * first_offset_x is the horizontal offset of the first pixel of the row from the oscillator.
+ */
+static inline void clip_span_to_radius(int *begin, int *end, const double first_offset_x, const double offset_y, const double radius) {
+    if (isinf(radius)) {
+        return;
+    }
+    const double remaining = square(radius) - square(offset_y);
+    if (remaining < 0.0) {
+        *end = *begin;
+        return;
+    }
+    const double half_width = sqrt(remaining);
+    *begin = (int) maximum(*begin, ceil(-half_width - first_offset_x));
+    *end = (int) minimum(*end, floor(half_width - first_offset_x) + 1);
+    if (*end < *begin) {
+        *end = *begin;
+    }
+}
+
+/**
+ * Adds factor times the dissipated wave of an oscillator to count pixels of a row, step pixels apart from first.
+ *
+ * The sine is evaluated rather than looked up, a chunk of pixels at a time so that it is vectorized.
+ */
+static inline void accumulate_evaluated_wave_span(const CachedGeometry * const geometry, double *row, const int first, const int count,
+                                                  const double first_offset_x, const double offset_y, const int step,
+                                                  const double wavelength, DissipationModel model, const double factor) {
+    double sines[EVALUATED_SPAN_CHUNK];
+    for (int done = 0; done < count; done += EVALUATED_SPAN_CHUNK) {
+        const int chunk = count - done < EVALUATED_SPAN_CHUNK ? count - done : EVALUATED_SPAN_CHUNK;
+        const int chunk_first = first + done * step;
+        evaluate_sin_of_distances(sines, chunk, first_offset_x + chunk_first, step, offset_y, wavelength);
+        for (int i = 0; i < chunk; i++) {
+            const int x = chunk_first + i * step;
+            const double radius = sqrt(square(first_offset_x + x) + square(offset_y));
+            row[x] += factor * (sines[i] + 1.0) / 2.0 * attenuation_of_radius(geometry, model, radius);
+        }
+    }
+}
+
+/**
+ * Adds factor times the dissipated wave of an oscillator to the range [begin, end) of a row, evaluating it at each pixel.
+ *
+ * Only every step-th pixel of the range is evaluated, starting from begin.
+ * Whole offsets are looked up in the two-dimensional caches and fractional ones
+ * in the radial tables. The pixels the caches do not cover are evaluated.
+ */
+static inline void accumulate_wave_span(const CachedGeometry * const geometry, double *row, const int begin, const int end,
+                                        const double first_offset_x, const double offset_y, const int step, const double wavelength,
+                                        DissipationModel model, const double factor) {
+    if (end <= begin) {
+        return;
+    }
+    const int count = (end - begin + step - 1) / step;
+    if (first_offset_x != floor(first_offset_x) || offset_y != floor(offset_y)) {
+        const double farthest_x = maximum(fabs(first_offset_x + begin), fabs(first_offset_x + begin + (count - 1) * step));
+        if (wavelength == DEFAULT_WAVELENGTH && is_radius_in_radial_tables(geometry, sqrt(square(farthest_x) + square(offset_y)))) {
+            for (int x = begin; x < end; x += step) {
+                const double radius = sqrt(square(first_offset_x + x) + square(offset_y));
+                const double wave_value = (sin_of_radius(geometry, radius, wavelength) + 1.0) / 2.0;
+                row[x] += factor * wave_value * attenuation_of_radius(geometry, model, radius);
+            }
+        } else {
+            accumulate_evaluated_wave_span(geometry, row, begin, count, first_offset_x, offset_y, step, wavelength,
+                                           model, factor);
+        }
+        return;
+    }
+    // The pixels of the span from covered_first to covered_last, counted in steps, are in the two-dimensional caches.
+    int covered_begin = begin;
+    int covered_end = wavelength == DEFAULT_WAVELENGTH ? end : begin;
+    clip_span_to_cache(geometry, &covered_begin, &covered_end, (int) first_offset_x, (int) offset_y);
+    const int covered = covered_end > covered_begin;
+    const int covered_first = covered ? (covered_begin - begin + step - 1) / step : count;
+    const int covered_last = covered ? (covered_end - begin + step - 1) / step : count;
+    accumulate_evaluated_wave_span(geometry, row, begin, covered_first, first_offset_x, offset_y, step, wavelength,
+                                   model, factor);
+    for (int i = covered_first; i < covered_last; i++) {
+        const int offset_x = (int) first_offset_x + begin + i * step;
+        const double wave_value = (fetch_sin_of_distance(geometry, abs(offset_x), abs((int) offset_y)) + 1.0) / 2.0;
+        row[begin + i * step] += factor * wave_value * attenuation_of_offset(geometry, model, offset_x, (int) offset_y);
+    }
+    accumulate_evaluated_wave_span(geometry, row, begin + covered_last * step, count - covered_last, first_offset_x, offset_y,
+                                   step, wavelength, model, factor);
+}
+
+/**
+ * Adds factor times the dissipated wave of an oscillator within the radius to the value matrix, evaluating it at each pixel.
+ */
+static inline void accumulate_wave(const Universe * const universe, const Point center, const double wavelength,
+                                   DissipationModel model, const double radius, const double factor) {
+    const double first_offset_x = -universe->width / 2 - center.x;
+    for (uint16_t y = 0; y < universe->height; y++) {
+        const double offset_y = y - universe->height / 2 - center.y;
+        int begin = 0;
+        int end = universe->width;
+        clip_span_to_radius(&begin, &end, first_offset_x, offset_y, radius);
+        accumulate_wave_span(universe->geometry, universe->value_matrix[y], begin, end, first_offset_x, offset_y, 1,
+                             wavelength, model, factor);
+    }
+}
+
+/**
+ * The Oscillators accumulate_oscillators evaluates, shared by the rows of tiles it evaluates.
+ */
+typedef struct TileRowAccumulation {
+    const Universe *universe;
+    const size_t *indices;
+    const double *center_x;
+    const double *center_y;
+    const double *radii;
+    DissipationModel model;
+} TileRowAccumulation;
+
+/**
+ * Adds the Oscillators which the SpatialIndex maps to the tiles of a row of tiles to their rows of the value matrix.
+ *
+ * Rows of tiles cover disjoint rows of the value matrix, so they may be evaluated concurrently.
+ */
+static inline void accumulate_tile_row(void *context, size_t tile_row) {
+    const TileRowAccumulation *accumulation = context;
+    const Universe *universe = accumulation->universe;
+    const OscillatorStore *store = universe->oscillators;
+    const SpatialIndex *index = universe->spatial_index;
+    const int tile_top = (int) tile_row * index->tile_size;
+    const int tile_bottom = (int) minimum(tile_top + index->tile_size, universe->height);
+    for (int tile_column = 0; tile_column < index->columns; tile_column++) {
+        const int tile_left = tile_column * index->tile_size;
+        const int tile_right = (int) minimum(tile_left + index->tile_size, universe->width);
+        const size_t tile = tile_row * index->columns + tile_column;
+        for (size_t entry = index->offsets[tile]; entry < index->offsets[tile + 1]; entry++) {
+            const size_t i = index->entries[entry];
+            const size_t oscillator = accumulation->indices[i];
+            const double first_offset_x = -universe->width / 2 - accumulation->center_x[i];
+            for (int y = tile_top; y < tile_bottom; y++) {
+                const double offset_y = y - universe->height / 2 - accumulation->center_y[i];
+                int span_begin = tile_left;
+                int span_end = tile_right;
+                clip_span_to_radius(&span_begin, &span_end, first_offset_x, offset_y, accumulation->radii[i]);
+                accumulate_wave_span(universe->geometry, universe->value_matrix[y], span_begin, span_end, first_offset_x,
+                                     offset_y, 1, store->wavelength[oscillator], accumulation->model,
+                                     store->amplitude[oscillator]);
+            }
+        }
+    }
+}
+
+/**
+ * Adds the Oscillators with the specified indices to the value matrix, evaluating them at each pixel.
+ *
+ * The value matrix is evaluated tile by tile, and each tile only evaluates the
+ * Oscillators which the SpatialIndex maps to it. If the Universe has a
+ * ThreadPool, rows of tiles are evaluated on it. The Layers of the Oscillators
+ * are updated to record their cutoff radii.
+ */
+static inline void accumulate_oscillators(const Universe * const universe, const size_t *indices, const size_t count, DissipationModel model) {
+    const OscillatorStore *store = universe->oscillators;
+    if (count == 0) {
+        return;
+    }
+    double *center_x = malloc(count * sizeof(double));
+    double *center_y = malloc(count * sizeof(double));
+    double *radii = malloc(count * sizeof(double));
+    if (center_x == NULL || center_y == NULL || radii == NULL) {
+        printf("Could not allocate the disks of the Oscillators, evaluating all Oscillators at every tile.\n");
+        for (size_t i = 0; i < count; i++) {
+            const Point center = {store->center_x[indices[i]], store->center_y[indices[i]]};
+            accumulate_wave(universe, center, store->wavelength[indices[i]], model, INFINITY, store->amplitude[indices[i]]);
+            universe->layers[indices[i]].cutoff_radius = INFINITY;
+        }
+        free(center_x);
+        free(center_y);
+        free(radii);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        center_x[i] = store->center_x[indices[i]];
+        center_y[i] = store->center_y[indices[i]];
+        radii[i] = get_cutoff_radius(universe, model, store->amplitude[indices[i]]);
+    }
+    SpatialIndex *index = universe->spatial_index;
+    if (build_spatial_index(index, center_x, center_y, radii, count)) {
+        printf("Could not build the spatial index, evaluating all Oscillators at every tile.\n");
+        for (size_t i = 0; i < count; i++) {
+            const Point center = {center_x[i], center_y[i]};
+            accumulate_wave(universe, center, store->wavelength[indices[i]], model, INFINITY, store->amplitude[indices[i]]);
+            radii[i] = INFINITY;
+        }
+    } else {
+        TileRowAccumulation accumulation = {universe, indices, center_x, center_y, radii, model};
+        if (universe->thread_pool != NULL) {
+            run_parallel(universe->thread_pool, accumulate_tile_row, &accumulation, (size_t) index->rows);
+        } else {
+            for (int tile_row = 0; tile_row < index->rows; tile_row++) {
+                accumulate_tile_row(&accumulation, (size_t) tile_row);
+            }
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        universe->layers[indices[i]].cutoff_radius = radii[i];
+    }
+    free(center_x);
+    free(center_y);
+    free(radii);
+}
+
+/**
+ * Returns whether or not the far-field expansion of the node is accurate enough for the tile.
+ *
+ * Besides the error of the expansion, which is relative to the wave term, the
+ * attenuation is evaluated at the center of the node instead of at each source.
+ */
+static inline int is_far_field_accurate(const Universe * const universe, const ClusterNode * const node, DissipationModel model,
+                                        const double wave_number, const double nearest_distance, const double half_extent) {
+    const double bound = far_field_error_bound(node, wave_number, nearest_distance, half_extent);
+    if (isinf(bound)) {
+        return 0;
+    }
+    // The attenuation functions are convex where they decrease, so sources closer than the center differ the most.
+    const double nearest_attenuation = attenuation(model, nearest_distance - node->radius);
+    const double center_attenuation = attenuation(model, nearest_distance);
+    const double error = node->amplitude * (nearest_attenuation * bound + nearest_attenuation - center_attenuation);
+    return error <= universe->clustering_tolerance;
+}
+
+/**
+ * Adds the far-field expansion of a node, built for the center of the tile, to the tile.
+ */
+static inline void accumulate_far_field(const Universe * const universe, const ClusterTree * const tree, const ClusterNode * const node,
+                                        DissipationModel model, const double wave_number,
+                                        const int tile_left, const int tile_top, const int tile_right, const int tile_bottom) {
+    const double target_x = (tile_left + tile_right - 1) / 2.0 - universe->width / 2;
+    const double target_y = (tile_top + tile_bottom - 1) / 2.0 - universe->height / 2;
+    FarField far_field;
+    compute_far_field(tree, node, wave_number, target_x, target_y, &far_field);
+    for (int y = tile_top; y < tile_bottom; y++) {
+        double *row = universe->value_matrix[y];
+        const int offset_y = y - universe->height / 2 - node->center_y;
+        for (int x = tile_left; x < tile_right; x++) {
+            const int offset_x = x - universe->width / 2 - node->center_x;
+            const double wave_value = evaluate_far_field(&far_field, wave_number, offset_x, offset_y);
+            row[x] += wave_value * attenuation_of_offset(universe->geometry, model, offset_x, offset_y);
+        }
+    }
+}
+
+/**
+ * Adds the Oscillators of a ClusterTree with the wavelength to the value matrix, tile by tile.
+ *
+ * For each tile, the tree is descended until a node is far enough for its
+ * far-field expansion to be within the clustering tolerance, or until a leaf,
+ * whose Oscillators are evaluated directly with their cutoff radii.
+ *
+ * Returns the number of far-field expansions used.
+ */
+static inline size_t accumulate_cluster_tree(const Universe * const universe, const ClusterTree * const tree,
+                                             const double wavelength, DissipationModel model) {
+    const double wave_number = TAU / wavelength;
+    const int tile_size = SPATIAL_INDEX_TILE_SIZE;
+    size_t *stack = malloc(tree->node_count * sizeof(size_t));
+    size_t expansion_count = 0;
+    for (int tile_top = 0; tile_top < universe->height; tile_top += tile_size) {
+        const int tile_bottom = (int) minimum(tile_top + tile_size, universe->height);
+        for (int tile_left = 0; tile_left < universe->width; tile_left += tile_size) {
+            const int tile_right = (int) minimum(tile_left + tile_size, universe->width);
+            // The corners of the tile, relative to the origin.
+            const double left = tile_left - universe->width / 2;
+            const double right = tile_right - 1 - universe->width / 2;
+            const double top = tile_top - universe->height / 2;
+            const double bottom = tile_bottom - 1 - universe->height / 2;
+            const double half_extent = sqrt(square(right - left) + square(bottom - top)) / 2.0;
+            size_t stack_size = 0;
+            stack[stack_size++] = 0;
+            while (stack_size > 0) {
+                const ClusterNode *node = &tree->nodes[stack[--stack_size]];
+                const double dx = maximum(maximum(left - node->center_x, 0.0), node->center_x - right);
+                const double dy = maximum(maximum(top - node->center_y, 0.0), node->center_y - bottom);
+                const double nearest_distance = sqrt(square(dx) + square(dy));
+                if (is_cluster_leaf(node)) {
+                    for (size_t i = node->first; i < node->first + node->count; i++) {
+                        const size_t index = tree->order[i];
+                        const double radius = universe->layers[index].cutoff_radius;
+                        const double first_offset_x = -universe->width / 2 - tree->x[i];
+                        for (int y = tile_top; y < tile_bottom; y++) {
+                            const double offset_y = y - universe->height / 2 - tree->y[i];
+                            int span_begin = tile_left;
+                            int span_end = tile_right;
+                            clip_span_to_radius(&span_begin, &span_end, first_offset_x, offset_y, radius);
+                            accumulate_wave_span(universe->geometry, universe->value_matrix[y], span_begin, span_end,
+                                                 first_offset_x, offset_y, 1, wavelength, model, tree->amplitude[i]);
+                        }
+                    }
+                } else if (is_far_field_accurate(universe, node, model, wave_number, nearest_distance, half_extent)) {
+                    accumulate_far_field(universe, tree, node, model, wave_number, tile_left, tile_top, tile_right, tile_bottom);
+                    expansion_count++;
+                } else {
+                    for (int i = 0; i < 4; i++) {
+                        if (node->children[i] != -1) {
+                            stack[stack_size++] = (size_t) node->children[i];
+                        }
+                    }
+                }
+            }
+        }
+    }
+    free(stack);
+    return expansion_count;
+}
+
+/**
+ * Adds the Oscillators with the specified indices to the value matrix, approximating distant clusters.
+ *
+ * The Oscillators are grouped by wavelength and each group gets a ClusterTree.
+ * The Layers of the Oscillators are updated to record their cutoff radii,
+ * which only apply where they are evaluated directly.
+ */
+static inline void cluster_oscillators(const Universe * const universe, const size_t *indices, const size_t count, DissipationModel model) {
+    const OscillatorStore *store = universe->oscillators;
+    for (size_t i = 0; i < count; i++) {
+        universe->layers[indices[i]].cutoff_radius = get_cutoff_radius(universe, model, store->amplitude[indices[i]]);
+    }
+    size_t *pending = malloc(count * sizeof(size_t));
+    memcpy(pending, indices, count * sizeof(size_t));
+    size_t pending_count = count;
+    size_t *group = malloc(count * sizeof(size_t));
+    size_t expansion_count = 0;
+    while (pending_count > 0) {
+        const double wavelength = store->wavelength[pending[0]];
+        size_t group_count = 0;
+        size_t remaining_count = 0;
+        for (size_t i = 0; i < pending_count; i++) {
+            if (store->wavelength[pending[i]] == wavelength) {
+                group[group_count++] = pending[i];
+            } else {
+                pending[remaining_count++] = pending[i];
+            }
+        }
+        pending_count = remaining_count;
+        ClusterTree *tree = build_cluster_tree(store->center_x, store->center_y, store->amplitude, group, group_count);
+        expansion_count += accumulate_cluster_tree(universe, tree, wavelength, model);
+        delete_cluster_tree(tree);
+    }
+    if (universe->verbose) {
+        printf("Clustered %zu Oscillators using %zu far-field expansions\n", count, expansion_count);
+    }
+    free(pending);
+    free(group);
+}
+
+/**
+ * Computes the Catmull-Rom weights of the samples at -1, 0, 1, and 2 for interpolating at the fraction.
+ */
+static inline void get_cubic_weights(const double fraction, double weights[4]) {
+    const double t = fraction;
+    weights[0] = (-t * t * t + 2.0 * t * t - t) / 2.0;
+    weights[1] = (3.0 * t * t * t - 5.0 * t * t + 2.0) / 2.0;
+    weights[2] = (-3.0 * t * t * t + 4.0 * t * t + t) / 2.0;
+    weights[3] = (t * t * t - t * t) / 2.0;
+}
+
+/**
+ * Computes the transform of the dissipated wave of an Oscillator with the wavelength.
+ */
+static inline void compute_convolution_kernel(const CachedGeometry * const geometry, Convolution *convolution, const uint16_t width,
+                                              const uint16_t height, const double wavelength, DissipationModel model) {
+    double complex *kernel = convolution->kernel;
+    memset(kernel, 0, convolution->width * convolution->height * sizeof(double complex));
+    for (int offset_y = 1 - height; offset_y < height; offset_y++) {
+        // Negative offsets wrap around to the end of the grid.
+        double complex *row = kernel + ((offset_y + convolution->height) % convolution->height) * convolution->width;
+        for (int offset_x = 1 - width; offset_x < width; offset_x++) {
+            const double wave_value = (sin_of_distance(geometry, offset_x, offset_y, wavelength) + 1.0) / 2.0;
+            row[(offset_x + convolution->width) % convolution->width] = wave_value * attenuation_of_offset(geometry, model, offset_x, offset_y);
+        }
+    }
+    fft_2d(convolution->row_plan, convolution->column_plan, kernel, convolution->buffer, 0);
+    convolution->kernel_computed = 1;
+    convolution->kernel_wavelength = wavelength;
+    convolution->kernel_model = model;
+}
+
+/**
+ * Adds the Oscillators with the specified indices to the value matrix by FFT convolution.
+ *
+ * All the Oscillators must have the wavelength and their centers must be on pixels of the value matrix.
+ * The cost does not depend on the number of Oscillators.
+ */
+static inline void convolve_oscillators(Universe *universe, const size_t *indices, const size_t count,
+                                        const double wavelength, DissipationModel model) {
+    if (universe->convolution == NULL) {
+        universe->convolution = create_convolution(universe->width, universe->height);
+    }
+    Convolution *convolution = universe->convolution;
+    if (!convolution->kernel_computed || convolution->kernel_wavelength != wavelength || convolution->kernel_model != model) {
+        compute_convolution_kernel(universe->geometry, convolution, universe->width, universe->height, wavelength, model);
+    }
+    const OscillatorStore *store = universe->oscillators;
+    double complex *grid = convolution->grid;
+    const size_t size = convolution->width * convolution->height;
+    memset(grid, 0, size * sizeof(double complex));
+    for (size_t i = 0; i < count; i++) {
+        const size_t x = (size_t) (store->center_x[indices[i]] + universe->width / 2);
+        const size_t y = (size_t) (store->center_y[indices[i]] + universe->height / 2);
+        grid[y * convolution->width + x] += store->amplitude[indices[i]];
+        universe->layers[indices[i]].cutoff_radius = INFINITY;
+    }
+    fft_2d(convolution->row_plan, convolution->column_plan, grid, convolution->buffer, 0);
+    for (size_t i = 0; i < size; i++) {
+        grid[i] *= convolution->kernel[i];
+    }
+    fft_2d(convolution->row_plan, convolution->column_plan, grid, convolution->buffer, 1);
+    const double normalization = 1.0 / size;
+    for (uint16_t y = 0; y < universe->height; y++) {
+        double *row = universe->value_matrix[y];
+        const double complex *grid_row = grid + y * convolution->width;
+        for (uint16_t x = 0; x < universe->width; x++) {
+            row[x] += creal(grid_row[x]) * normalization;
+        }
+    }
+}
+
+/**
+ * Bounds the error of interpolating the dissipated wave of an Oscillator between samples spacing pixels apart.
+ *
+ * The samples used are between nearest_distance and farthest_distance from
+ * the Oscillator. There, the derivatives of the wave term along an axis are
+ * bounded by powers of g = k + 2 / r and those of the attenuation by powers of
+ * a = rate + 2 / r, so the n-th derivative of the dissipated wave is at most
+ * amplitude * attenuation * ((a + g)^n + a^n) / 2. Catmull-Rom interpolation
+ * along a line errs by at most spacing^3 M3 / 24 + spacing^4 M4 / 384, and
+ * interpolating the rows along the columns adds 1.25 times the error of the rows.
+ */
+static inline double interpolation_error_bound(DissipationModel model, const double wave_number, const double amplitude,
+                                               const double spacing, const double nearest_distance, const double farthest_distance) {
+    // The attenuation functions are not smooth at DISSIPATION_START.
+    if (nearest_distance <= (model == NO_DISSIPATION ? 1.0 : DISSIPATION_START)) {
+        return INFINITY;
+    }
+    const double rate = maximum(attenuation_rate(model, nearest_distance), attenuation_rate(model, farthest_distance));
+    const double a = rate + 2.0 / nearest_distance;
+    const double g = wave_number + 2.0 / nearest_distance;
+    const double third = (pow(a + g, 3.0) + pow(a, 3.0)) / 2.0;
+    const double fourth = (pow(a + g, 4.0) + pow(a, 4.0)) / 2.0;
+    const double line_error = pow(spacing, 3.0) * third / 24.0 + pow(spacing, 4.0) * fourth / 384.0;
+    return 2.25 * amplitude * attenuation(model, nearest_distance) * line_error;
+}
+
+typedef struct InterpolationCandidate {
+    double bound;
+    size_t entry;
+} InterpolationCandidate;
+
+static inline int compare_interpolation_candidates(const void *a, const void *b) {
+    const double first = ((const InterpolationCandidate *) a)->bound;
+    const double second = ((const InterpolationCandidate *) b)->bound;
+    return (first > second) - (first < second);
+}
+
+/**
+ * Chooses which Oscillators of a tile are interpolated between samples spacing pixels apart.
+ *
+ * The Oscillators with the smallest error bounds are chosen while their sum
+ * fits the interpolation tolerance. Their entries are moved to the beginning
+ * of the candidates. Returns their number.
+ */
+static inline size_t choose_interpolated_oscillators(const Universe * const universe, const double *center_x, const double *center_y,
+                                                     const double *radii, const size_t *indices, InterpolationCandidate *candidates,
+                                                     const size_t count, DissipationModel model, const int spacing,
+                                                     const int tile_left, const int tile_top, const int tile_right, const int tile_bottom) {
+    const OscillatorStore *store = universe->oscillators;
+    // The samples span from a sample before the tile to two samples after it.
+    const double left = tile_left - spacing - universe->width / 2;
+    const double top = tile_top - spacing - universe->height / 2;
+    const double right = tile_right + 2 * spacing - universe->width / 2;
+    const double bottom = tile_bottom + 2 * spacing - universe->height / 2;
+    for (size_t c = 0; c < count; c++) {
+        const size_t i = candidates[c].entry;
+        const double nearest_x = maximum(0.0, maximum(left - center_x[i], center_x[i] - right));
+        const double nearest_y = maximum(0.0, maximum(top - center_y[i], center_y[i] - bottom));
+        const double farthest_x = maximum(fabs(left - center_x[i]), fabs(right - center_x[i]));
+        const double farthest_y = maximum(fabs(top - center_y[i]), fabs(bottom - center_y[i]));
+        const double nearest_distance = sqrt(square(nearest_x) + square(nearest_y));
+        const double farthest_distance = sqrt(square(farthest_x) + square(farthest_y));
+        // Waves which are cut off within the samples are not smooth.
+        if (farthest_distance > radii[i]) {
+            candidates[c].bound = INFINITY;
+        } else {
+            const size_t index = indices[i];
+            candidates[c].bound = interpolation_error_bound(model, TAU / store->wavelength[index], store->amplitude[index],
+                                                            spacing, nearest_distance, farthest_distance);
+        }
+    }
+    qsort(candidates, count, sizeof(InterpolationCandidate), compare_interpolation_candidates);
+    double error = 0.0;
+    size_t chosen = 0;
+    while (chosen < count && error + candidates[chosen].bound <= universe->interpolation_tolerance) {
+        error += candidates[chosen].bound;
+        chosen++;
+    }
+    return chosen;
+}
+
+/**
+ * Adds the Oscillators with the specified indices to the value matrix, interpolating them where they are smooth.
+ *
+ * The value matrix is evaluated tile by tile, as by accumulate_oscillators().
+ * In each tile, the Oscillators whose waves are smooth enough are evaluated
+ * every few pixels and interpolated with separable cubic interpolation, while
+ * the others, such as those whose centers are near, are evaluated at each
+ * pixel. The spacing of the samples minimizes the number of evaluations, and
+ * the error of interpolating a tile is within the interpolation tolerance.
+ * Incremental updates subtract exact waves, so this error remains until the
+ * next rebuild, but does not grow.
+ */
+static inline void interpolate_oscillators(const Universe * const universe, const size_t *indices, const size_t count, DissipationModel model) {
+    const OscillatorStore *store = universe->oscillators;
+    if (count == 0) {
+        return;
+    }
+    double *center_x = malloc(count * sizeof(double));
+    double *center_y = malloc(count * sizeof(double));
+    double *radii = malloc(count * sizeof(double));
+    if (center_x == NULL || center_y == NULL || radii == NULL) {
+        free(center_x);
+        free(center_y);
+        free(radii);
+        accumulate_oscillators(universe, indices, count, model);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        center_x[i] = store->center_x[indices[i]];
+        center_y[i] = store->center_y[indices[i]];
+        radii[i] = get_cutoff_radius(universe, model, store->amplitude[indices[i]]);
+    }
+    SpatialIndex *index = universe->spatial_index;
+    if (build_spatial_index(index, center_x, center_y, radii, count)) {
+        free(center_x);
+        free(center_y);
+        free(radii);
+        accumulate_oscillators(universe, indices, count, model);
+        return;
+    }
+    InterpolationCandidate *candidates = malloc(count * sizeof(InterpolationCandidate));
+    if (candidates == NULL) {
+        free(center_x);
+        free(center_y);
+        free(radii);
+        accumulate_oscillators(universe, indices, count, model);
+        return;
+    }
+    // The samples of a tile and their interpolation along the rows.
+    double samples[INTERPOLATION_SAMPLES_SIZE][INTERPOLATION_SAMPLES_SIZE];
+    double rows[INTERPOLATION_SAMPLES_SIZE][SPATIAL_INDEX_TILE_SIZE];
+    size_t interpolated_count = 0;
+    size_t entry_count = 0;
+    for (int tile_row = 0; tile_row < index->rows; tile_row++) {
+        const int tile_top = tile_row * index->tile_size;
+        const int tile_bottom = (int) minimum(tile_top + index->tile_size, universe->height);
+        for (int tile_column = 0; tile_column < index->columns; tile_column++) {
+            const int tile_left = tile_column * index->tile_size;
+            const int tile_right = (int) minimum(tile_left + index->tile_size, universe->width);
+            const int tile_width = tile_right - tile_left;
+            const int tile_height = tile_bottom - tile_top;
+            const size_t tile = (size_t) tile_row * index->columns + tile_column;
+            const size_t tile_count = index->offsets[tile + 1] - index->offsets[tile];
+            for (size_t c = 0; c < tile_count; c++) {
+                candidates[c].entry = index->entries[index->offsets[tile] + c];
+            }
+            // Choose the spacing which needs the fewest evaluations.
+            size_t best_cost = tile_count * tile_width * tile_height;
+            int spacing = 1;
+            for (int s = 2; s <= MAXIMUM_INTERPOLATION_SPACING && tile_count > 0; s *= 2) {
+                const size_t chosen = choose_interpolated_oscillators(universe, center_x, center_y, radii, indices, candidates,
+                                                                      tile_count, model, s, tile_left, tile_top,
+                                                                      tile_right, tile_bottom);
+                const size_t sample_count = (size_t) ((tile_width + s - 1) / s + 3) * ((tile_height + s - 1) / s + 3);
+                const size_t cost = chosen * sample_count + (tile_count - chosen) * tile_width * tile_height;
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    spacing = s;
+                }
+            }
+            size_t chosen = 0;
+            if (spacing > 1) {
+                chosen = choose_interpolated_oscillators(universe, center_x, center_y, radii, indices, candidates, tile_count,
+                                                         model, spacing, tile_left, tile_top, tile_right, tile_bottom);
+                // Sample the chosen Oscillators, starting a sample before the tile.
+                const int columns = (tile_width + spacing - 1) / spacing + 3;
+                const int sample_rows = (tile_height + spacing - 1) / spacing + 3;
+                for (int j = 0; j < sample_rows; j++) {
+                    memset(samples[j], 0, columns * spacing * sizeof(double));
+                }
+                for (size_t c = 0; c < chosen; c++) {
+                    const size_t i = candidates[c].entry;
+                    const double first_offset_x = tile_left - spacing - universe->width / 2 - center_x[i];
+                    for (int j = 0; j < sample_rows; j++) {
+                        const double offset_y = tile_top + (j - 1) * spacing - universe->height / 2 - center_y[i];
+                        accumulate_wave_span(universe->geometry, samples[j], 0, columns * spacing, first_offset_x,
+                                             offset_y, spacing, store->wavelength[indices[i]], model,
+                                             store->amplitude[indices[i]]);
+                    }
+                }
+                // Interpolate along the rows of samples, and then along the columns.
+                double weights[MAXIMUM_INTERPOLATION_SPACING][4];
+                for (int t = 0; t < spacing; t++) {
+                    get_cubic_weights((double) t / spacing, weights[t]);
+                }
+                for (int j = 0; j < sample_rows; j++) {
+                    for (int x = 0; x < tile_width; x++) {
+                        const double *w = weights[x % spacing];
+                        const double *sample = samples[j] + x / spacing * spacing;
+                        rows[j][x] = w[0] * sample[0] + w[1] * sample[spacing] + w[2] * sample[2 * spacing] +
+                                     w[3] * sample[3 * spacing];
+                    }
+                }
+                for (int y = 0; y < tile_height; y++) {
+                    const double *w = weights[y % spacing];
+                    const int j = y / spacing;
+                    double *row = universe->value_matrix[tile_top + y] + tile_left;
+                    for (int x = 0; x < tile_width; x++) {
+                        row[x] += w[0] * rows[j][x] + w[1] * rows[j + 1][x] + w[2] * rows[j + 2][x] + w[3] * rows[j + 3][x];
+                    }
+                }
+            }
+            // Evaluate the other Oscillators at each pixel.
+            for (size_t c = chosen; c < tile_count; c++) {
+                const size_t i = candidates[c].entry;
+                const double first_offset_x = -universe->width / 2 - center_x[i];
+                for (int y = tile_top; y < tile_bottom; y++) {
+                    const double offset_y = y - universe->height / 2 - center_y[i];
+                    int span_begin = tile_left;
+                    int span_end = tile_right;
+                    clip_span_to_radius(&span_begin, &span_end, first_offset_x, offset_y, radii[i]);
+                    accumulate_wave_span(universe->geometry, universe->value_matrix[y], span_begin, span_end,
+                                         first_offset_x, offset_y, 1, store->wavelength[indices[i]], model,
+                                         store->amplitude[indices[i]]);
+                }
+            }
+            interpolated_count += chosen;
+            entry_count += tile_count;
+        }
+    }
+    if (universe->verbose) {
+        printf("Interpolated %zu of %zu tile evaluations\n", interpolated_count, entry_count);
+    }
+    for (size_t i = 0; i < count; i++) {
+        universe->layers[indices[i]].cutoff_radius = radii[i];
+    }
+    free(candidates);
+    free(center_x);
+    free(center_y);
+    free(radii);
+}
+
+/**
+ * Returns whether or not the center of the Oscillator is on a pixel of the value matrix.
+ *
+ * Only these Oscillators can be convolved, as shifting the kernel by a fraction
+ * of a pixel is far less accurate than evaluating the wave directly.
+ */
+static inline int is_oscillator_on_pixel(const Universe * const universe, size_t index) {
+    const double x = universe->oscillators->center_x[index] + universe->width / 2;
+    const double y = universe->oscillators->center_y[index] + universe->height / 2;
+    return x >= 0 && x < universe->width && y >= 0 && y < universe->height && x == floor(x) && y == floor(y);
+}
+
+/**
+ * Adds the Oscillators in the range [begin, end) to the value matrix and records them in their Layers.
+ *
+ * Oscillators centered on pixels of the value matrix are grouped by wavelength,
+ * and groups are convolved according to the evaluation mode. All other
+ * Oscillators are evaluated directly, tile by tile, clustering distant ones if
+ * clustering is enabled.
+ */
+static inline void evaluate_oscillators(Universe *universe, const size_t begin, const size_t end, DissipationModel model) {
+    const OscillatorStore *store = universe->oscillators;
+    const size_t count = end - begin;
+    size_t *direct = malloc(count * sizeof(size_t));
+    size_t direct_count = 0;
+    size_t *pending = malloc(count * sizeof(size_t));
+    size_t pending_count = 0;
+    size_t *group = malloc(count * sizeof(size_t));
+    for (size_t i = begin; i < end; i++) {
+        if (universe->evaluation_mode != DIRECT_EVALUATION && is_oscillator_on_pixel(universe, i)) {
+            pending[pending_count++] = i;
+        } else {
+            direct[direct_count++] = i;
+        }
+    }
+    while (pending_count > 0) {
+        // Split the pending Oscillators into those with the wavelength of the first one and the others.
+        const double wavelength = store->wavelength[pending[0]];
+        size_t group_count = 0;
+        size_t remaining_count = 0;
+        for (size_t i = 0; i < pending_count; i++) {
+            if (store->wavelength[pending[i]] == wavelength) {
+                group[group_count++] = pending[i];
+            } else {
+                pending[remaining_count++] = pending[i];
+            }
+        }
+        pending_count = remaining_count;
+        if (universe->evaluation_mode == CONVOLUTION_EVALUATION || group_count >= universe->convolution_threshold) {
+            convolve_oscillators(universe, group, group_count, wavelength, model);
+            if (universe->verbose) {
+                printf("Convolved %zu Oscillators\n", group_count);
+            }
+        } else {
+            memcpy(direct + direct_count, group, group_count * sizeof(size_t));
+            direct_count += group_count;
+        }
+    }
+    if (universe->clustering_enabled && direct_count > 0) {
+        cluster_oscillators(universe, direct, direct_count, model);
+    } else if (universe->interpolation_enabled) {
+        interpolate_oscillators(universe, direct, direct_count, model);
+    } else {
+        accumulate_oscillators(universe, direct, direct_count, model);
+    }
+    for (size_t i = begin; i < end; i++) {
+        Layer *layer = &universe->layers[i];
+        layer->computed = 1;
+        layer->center.x = store->center_x[i];
+        layer->center.y = store->center_y[i];
+        layer->wavelength = store->wavelength[i];
+        layer->dissipation_model = model;
+        layer->amplitude = store->amplitude[i];
+    }
+    free(direct);
+    free(pending);
+    free(group);
+}
+
+/**
+ * Returns the processor time used by the calling thread, in seconds.
+ *
+ * Unlike clock(), this is not inflated by the other threads of the process.
+ */
+static inline double get_thread_time() {
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Measures how many Oscillators with the same wavelength make convolution faster than direct evaluation.
+ *
+ * Only the processor time of the calling thread is measured, so it may run
+ * beside other work. The caches of the Universe it measures are persisted in
+ * the geometry cache directory, unless it is NULL.
+ */
+static inline size_t benchmark_convolution_threshold(const uint16_t width, const uint16_t height, const char *geometry_cache_directory) {
+    Universe *universe = create_universe(width, height, geometry_cache_directory);
+    size_t indices[CONVOLUTION_BENCHMARK_OSCILLATORS];
+    for (size_t i = 0; i < CONVOLUTION_BENCHMARK_OSCILLATORS; i++) {
+        // Spread the Oscillators along the diagonal of the value matrix.
+        const int x = (int) (i * width / CONVOLUTION_BENCHMARK_OSCILLATORS) - width / 2;
+        const int y = (int) (i * height / CONVOLUTION_BENCHMARK_OSCILLATORS) - height / 2;
+        indices[i] = universe_add_oscillator(universe, x, y, DEFAULT_AMPLITUDE, DEFAULT_WAVELENGTH);
+    }
+    // The first runs fill the parts of the caches they read and compute the kernel, which is cached across frames.
+    accumulate_oscillators(universe, indices, CONVOLUTION_BENCHMARK_OSCILLATORS, NO_DISSIPATION);
+    convolve_oscillators(universe, indices, CONVOLUTION_BENCHMARK_OSCILLATORS, DEFAULT_WAVELENGTH, NO_DISSIPATION);
+    double direct_time = INFINITY;
+    double convolution_time = INFINITY;
+    for (int run = 0; run < CONVOLUTION_BENCHMARK_RUNS; run++) {
+        double start = get_thread_time();
+        accumulate_oscillators(universe, indices, CONVOLUTION_BENCHMARK_OSCILLATORS, NO_DISSIPATION);
+        direct_time = minimum(direct_time, (get_thread_time() - start) / CONVOLUTION_BENCHMARK_OSCILLATORS);
+        start = get_thread_time();
+        convolve_oscillators(universe, indices, CONVOLUTION_BENCHMARK_OSCILLATORS, DEFAULT_WAVELENGTH, NO_DISSIPATION);
+        convolution_time = minimum(convolution_time, get_thread_time() - start);
+    }
+    delete_universe(universe);
+    if (direct_time <= 0.0) {
+        return DEFAULT_CONVOLUTION_THRESHOLD;
+    }
+    return (size_t) ceil(convolution_time / direct_time);
+}
+
+/**
+ * Measures the convolution threshold on a thread of its own, so that frames are not delayed by it.
+ */
+typedef struct ConvolutionBenchmark {
+    pthread_t thread;
+    int started; // Whether or not the thread was created, which it was not if the threshold is the default.
+    uint16_t width;
+    uint16_t height;
+    size_t threshold; // Written by the thread before it sets finished.
+    atomic_int finished;
+} ConvolutionBenchmark;
+
+static inline void *run_convolution_benchmark(void *argument) {
+    ConvolutionBenchmark *benchmark = argument;
+    benchmark->threshold = benchmark_convolution_threshold(benchmark->width, benchmark->height, NULL);
+    atomic_store(&benchmark->finished, 1);
+    return NULL;
+}
+
+/**
+ * Starts measuring the convolution threshold of a Universe of the specified dimensions in the background.
+ *
+ * Dimensions above CONVOLUTION_BENCHMARK_SIZE are measured at that size.
+ */
+static inline ConvolutionBenchmark *start_convolution_benchmark(const uint16_t width, const uint16_t height) {
+    ConvolutionBenchmark *benchmark = malloc(sizeof(ConvolutionBenchmark));
+    benchmark->width = width < CONVOLUTION_BENCHMARK_SIZE ? width : CONVOLUTION_BENCHMARK_SIZE;
+    benchmark->height = height < CONVOLUTION_BENCHMARK_SIZE ? height : CONVOLUTION_BENCHMARK_SIZE;
+    benchmark->threshold = DEFAULT_CONVOLUTION_THRESHOLD;
+    atomic_init(&benchmark->finished, 0);
+    benchmark->started = !pthread_create(&benchmark->thread, NULL, run_convolution_benchmark, benchmark);
+    if (!benchmark->started) {
+        atomic_store(&benchmark->finished, 1);
+    }
+    return benchmark;
+}
+
+/**
+ * Returns whether or not the ConvolutionBenchmark has measured the threshold.
+ */
+static inline int is_convolution_benchmark_finished(ConvolutionBenchmark *benchmark) {
+    return atomic_load(&benchmark->finished);
+}
+
+/**
+ * Waits for the ConvolutionBenchmark to finish, releases it, and returns the threshold it measured.
+ */
+static inline size_t finish_convolution_benchmark(ConvolutionBenchmark *benchmark) {
+    if (benchmark->started) {
+        pthread_join(benchmark->thread, NULL);
+    }
+    const size_t threshold = benchmark->threshold;
+    free(benchmark);
+    return threshold;
+}
+
+/**
+ * Attenuates a range of a row of a Layer and updates its contribution to the value matrix.
+ *
+ * The row is attenuated in place, from the wave term into the values, and the
+ * matrix row goes from old_amplitude times the old values to new_amplitude
+ * times the new values.
+ *
+ * If attenuation_row is not NULL, the offsets must be whole and all their
+ * absolute values in the range must be covered by it. Otherwise, the
+ * attenuation is interpolated from the radial tables at each pixel.
+ */
+static inline void dissipate_layer_row_range(const CachedGeometry * const geometry, const double *wave, double *values, double *matrix_row,
+                                             const int begin, const int end, const double first_offset_x, const double offset_y,
+                                             const double *attenuation_row, DissipationModel model,
+                                             const double old_amplitude, const double new_amplitude) {
+    if (attenuation_row != NULL) {
+        // Branch-free, as abs() compiles to arithmetic.
+        for (int i = begin; i < end; i++) {
+            const double value = wave[i] * attenuation_row[abs((int) first_offset_x + i)];
+            matrix_row[i] += new_amplitude * value - old_amplitude * values[i];
+            values[i] = value;
+        }
+    } else {
+        for (int i = begin; i < end; i++) {
+            const double value = wave[i] * attenuation_of_radius(geometry, model, sqrt(square(first_offset_x + i) + square(offset_y)));
+            matrix_row[i] += new_amplitude * value - old_amplitude * values[i];
+            values[i] = value;
+        }
+    }
+}
+
+/**
+ * Attenuates the wave term of the Layer with the model in a single table-driven pass.
+ *
+ * The contribution of the Layer to the value matrix is updated in the same pass.
+ */
+static inline void dissipate_layer(const Universe * const universe, Layer *layer, DissipationModel model, const double amplitude) {
+    const double first_offset_x = -universe->width / 2 - layer->center.x;
+    // The range of the row covered by the attenuation tables.
+    const int cache_maximum = universe->geometry->offset_table_maximum;
+    const int covered_begin = (int) minimum(maximum(-cache_maximum - first_offset_x, 0), universe->width);
+    const int covered_end = (int) maximum(minimum(cache_maximum + 1 - first_offset_x, universe->width), covered_begin);
+    // The attenuation tables only hold whole offsets.
+    const int on_pixel = is_on_pixel(layer->center);
+    for (uint16_t y = 0; y < universe->height; y++) {
+        const double offset_y = y - universe->height / 2 - layer->center.y;
+        const double *wave = layer->wave[y];
+        double *values = layer->values[y];
+        double *matrix_row = universe->value_matrix[y];
+        const double *table_row = on_pixel ? attenuation_row(universe->geometry, model, (int) offset_y) : NULL;
+        if (table_row == NULL) {
+            dissipate_layer_row_range(universe->geometry, wave, values, matrix_row, 0, universe->width, first_offset_x, offset_y, NULL, model, layer->amplitude, amplitude);
+        } else {
+            dissipate_layer_row_range(universe->geometry, wave, values, matrix_row, 0, covered_begin, first_offset_x, offset_y, NULL, model, layer->amplitude, amplitude);
+            dissipate_layer_row_range(universe->geometry, wave, values, matrix_row, covered_begin, covered_end, first_offset_x, offset_y, table_row, model, layer->amplitude, amplitude);
+            dissipate_layer_row_range(universe->geometry, wave, values, matrix_row, covered_end, universe->width, first_offset_x, offset_y, NULL, model, layer->amplitude, amplitude);
+        }
+    }
+    layer->dissipation_model = model;
+    layer->amplitude = amplitude;
+}
+
+/**
+ * Adds the Layer multiplied by the factor to the value matrix of the Universe.
+ *
+ * This is a single multiply-add pass, so it is much cheaper than computing the Layer.
+ */
+static inline void accumulate_layer(const Universe * const universe, const Layer * const layer, const double factor) {
+    for (uint16_t y = 0; y < universe->height; y++) {
+        double *row = universe->value_matrix[y];
+        const double *layer_row = layer->values[y];
+        for (uint16_t x = 0; x < universe->width; x++) {
+            row[x] += factor * layer_row[x];
+        }
+    }
+}
+
+/**
+ * Makes the contribution of the Layer to the value matrix match the amplitude.
+ */
+static inline void set_layer_amplitude(const Universe * const universe, Layer *layer, const double amplitude) {
+    if (layer->amplitude != amplitude) {
+        if (layer->values != NULL) {
+            accumulate_layer(universe, layer, amplitude - layer->amplitude);
+        } else {
+            accumulate_wave(universe, layer->center, layer->wavelength, layer->dissipation_model, layer->cutoff_radius,
+                            amplitude - layer->amplitude);
+        }
+        layer->amplitude = amplitude;
+    }
+}
+
+/**
+ * Makes the contribution of the Layer to the value matrix match the Oscillator at the index.
+ *
+ * Only the wave terms of Oscillators which moved, changed their wavelength, or
+ * were created are evaluated again. Dissipation model changes are applied with
+ * one table-driven multiply pass and amplitude changes as scaled deltas of the
+ * cached Layers.
+ */
+static inline void update_layer(const Universe * const universe, Layer *layer, size_t index, int may_have_storage) {
+    const OscillatorStore *store = universe->oscillators;
+    const DissipationModel model = universe->dissipation_model;
+    const double amplitude = store->amplitude[index];
+    const int has_storage = layer->values != NULL;
+    // Only Layers without storage are cut off, so that cached Layers can switch models with a single pass.
+    const double radius = has_storage || may_have_storage ? INFINITY : get_cutoff_radius(universe, model, amplitude);
+    if (!is_layer_wave_valid(layer, store, index) || (!has_storage && layer->cutoff_radius != radius)) {
+        set_layer_amplitude(universe, layer, 0.0);
+        if (!has_storage && may_have_storage) {
+            allocate_layer_storage(universe, layer);
+        }
+        layer->computed = 1;
+        layer->center.x = store->center_x[index];
+        layer->center.y = store->center_y[index];
+        layer->wavelength = store->wavelength[index];
+        layer->cutoff_radius = radius;
+        Speculation *speculation = universe->speculation;
+        if (layer->values != NULL && speculation != NULL &&
+            take_speculative_layer(speculation, layer->center, layer->wavelength, model, &layer->wave, &layer->values)) {
+            layer->dissipation_model = model;
+            set_layer_amplitude(universe, layer, amplitude);
+        } else if (layer->values != NULL) {
+            compute_layer_wave(universe, layer);
+            dissipate_layer(universe, layer, model, amplitude);
+        } else {
+            layer->dissipation_model = model;
+            set_layer_amplitude(universe, layer, amplitude);
+        }
+    } else if (layer->dissipation_model != model) {
+        dissipate_layer(universe, layer, model, amplitude);
+    } else {
+        set_layer_amplitude(universe, layer, amplitude);
+    }
+}
+
+/**
+ * Returns how many Oscillators in the range [begin, end) differ from the state recorded in their Layers.
+ */
+static inline size_t count_stale_layers(const Universe * const universe, const size_t begin, const size_t end) {
+    const OscillatorStore *store = universe->oscillators;
+    size_t stale_count = 0;
+    for (size_t index = begin; index < end; index++) {
+        const Layer *layer = &universe->layers[index];
+        if (!is_layer_wave_valid(layer, store, index) ||
+                layer->amplitude != store->amplitude[index] ||
+                layer->dissipation_model != universe->dissipation_model) {
+            stale_count++;
+        }
+    }
+    return stale_count;
+}
+
+/**
+ * Brings the value matrix up to date with the Oscillators of the Universe.
+ *
+ * Changes are applied incrementally through the Layers. However, if most
+ * Oscillators without storage changed, as after a dissipation model switch,
+ * the value matrix is rebuilt, as that evaluates each of them only once and
+ * can use tiles, clustering, or convolution. The rebuild also refreshes the
+ * error tolerances, so it is also done once the Oscillators outnumber the
+ * share of the cutoff error.
+ */
+static inline void update_universe_value_matrix(Universe *universe) {
+    const OscillatorStore *store = universe->oscillators;
+    const size_t storage_limit = get_layer_storage_limit(universe);
+    const size_t cached_count = store->count < storage_limit ? store->count : storage_limit;
+    const size_t uncached_count = store->count - cached_count;
+    // The cutoff tolerance must be shared among more Oscillators once they outnumber its share.
+    const int outgrown = universe->cutoff_enabled && store->count > universe->cutoff_share_count;
+    const int rebuild = universe->rebuild_requested || outgrown ||
+                        2 * count_stale_layers(universe, cached_count, store->count) > uncached_count;
+    ensure_cached_geometry(universe);
+
+    // Remove the contributions of deleted Oscillators, unless the value matrix is about to be cleared.
+    for (size_t i = 0; i < universe->retired_layer_count; i++) {
+        if (!rebuild) {
+            set_layer_amplitude(universe, &universe->retired_layers[i], 0.0);
+        }
+        free_layer_storage(&universe->retired_layers[i], universe->height);
+    }
+    free(universe->retired_layers);
+    universe->retired_layers = NULL;
+    universe->retired_layer_count = 0;
+
+    if (rebuild) {
+        universe->rebuild_requested = 0;
+        update_error_tolerances(universe);
+        for (uint16_t y = 0; y < universe->height; y++) {
+            memset(universe->value_matrix[y], 0, universe->width * sizeof(double));
+        }
+        for (size_t index = 0; index < store->count; index++) {
+            universe->layers[index].amplitude = 0.0;
+        }
+        for (size_t index = 0; index < cached_count; index++) {
+            update_layer(universe, &universe->layers[index], index, 1);
+        }
+        for (size_t index = cached_count; index < store->count; index++) {
+            free_layer_storage(&universe->layers[index], universe->height);
+        }
+        evaluate_oscillators(universe, cached_count, store->count, universe->dissipation_model);
+        if (universe->verbose) {
+            printf("Evaluated %zu Oscillators\n", store->count);
+        }
+    } else {
+        for (size_t index = 0; index < store->count; index++) {
+            update_layer(universe, &universe->layers[index], index, index < cached_count);
+        }
+    }
+}
+
+/**
+ * Adds the contribution of the Layer to a rectangle of the value matrix which it does not cover yet.
+ *
+ * Layers with storage also evaluate the rectangle into it.
+ */
+static inline void add_layer_region(const Universe * const universe, Layer *layer, const int left, const int top, const int right, const int bottom) {
+    if (!layer->computed) {
+        return;
+    }
+    if (layer->values != NULL) {
+        compute_wave_region(universe->geometry, layer->wave, universe->width, universe->height, layer->center, layer->wavelength,
+                            left, top, right, bottom);
+        attenuate_wave_region(universe->geometry, layer->wave, layer->values, universe->width, universe->height, layer->center,
+                              layer->dissipation_model, left, top, right, bottom);
+        for (int y = top; y < bottom; y++) {
+            for (int x = left; x < right; x++) {
+                universe->value_matrix[y][x] += layer->amplitude * layer->values[y][x];
+            }
+        }
+    } else {
+        const double first_offset_x = -universe->width / 2 - layer->center.x;
+        for (int y = top; y < bottom; y++) {
+            const double offset_y = y - universe->height / 2 - layer->center.y;
+            int begin = left;
+            int end = right;
+            clip_span_to_radius(&begin, &end, first_offset_x, offset_y, layer->cutoff_radius);
+            accumulate_wave_span(universe->geometry, universe->value_matrix[y], begin, end, first_offset_x, offset_y, 1,
+                                 layer->wavelength, layer->dissipation_model, layer->amplitude);
+        }
+    }
+}
+
+/**
+ * Moves the view by (dx, dy) pixels of the plane, reusing the values which remain in view.
+ *
+ * The Oscillators are stored relative to the view, so they move by (-dx, -dy).
+ * The value matrix and the Layers are shifted along with them, and only the
+ * strips of pixels which come into view are evaluated. If most pixels come
+ * into view, the value matrix is rebuilt instead.
+ */
+static inline void pan_universe(Universe *universe, const int dx, const int dy) {
+    // The Layers must describe the value matrix for it to be shifted.
+    update_universe_value_matrix(universe);
+    OscillatorStore *store = universe->oscillators;
+    for (size_t index = 0; index < store->count; index++) {
+        store->center_x[index] -= dx;
+        store->center_y[index] -= dy;
+        universe->layers[index].center.x -= dx;
+        universe->layers[index].center.y -= dy;
+    }
+    universe->view_x += dx;
+    universe->view_y += dy;
+    const int width = universe->width;
+    const int height = universe->height;
+    const long exposed = abs(dx) >= width || abs(dy) >= height ? (long) width * height :
+                         (long) abs(dx) * height + (long) abs(dy) * width - (long) abs(dx) * abs(dy);
+    // Rebuilding evaluates the Oscillators without storage with tiles, clustering, or convolution, so it pays off earlier.
+    if (2 * exposed > (long) width * height) {
+        for (size_t index = 0; index < store->count; index++) {
+            universe->layers[index].computed = 0;
+        }
+        universe->rebuild_requested = 1;
+        return;
+    }
+    shift_matrix(universe->value_matrix, universe->width, universe->height, dx, dy);
+    for (size_t index = 0; index < store->count; index++) {
+        Layer *layer = &universe->layers[index];
+        if (layer->values != NULL) {
+            shift_matrix(layer->wave, universe->width, universe->height, dx, dy);
+            shift_matrix(layer->values, universe->width, universe->height, dx, dy);
+        }
+    }
+    // The pixels which came into view are whole rows and part of the columns of the other rows.
+    const int rows_top = dy > 0 ? height - dy : 0;
+    const int rows_bottom = dy > 0 ? height : -dy;
+    const int columns_left = dx > 0 ? width - dx : 0;
+    const int columns_right = dx > 0 ? width : -dx;
+    const int columns_top = dy > 0 ? 0 : -dy;
+    const int columns_bottom = dy > 0 ? height - dy : height;
+    for (size_t index = 0; index < store->count; index++) {
+        add_layer_region(universe, &universe->layers[index], 0, rows_top, width, rows_bottom);
+        add_layer_region(universe, &universe->layers[index], columns_left, columns_top, columns_right, columns_bottom);
+    }
+}
+
+/**
+ * A pass of evaluate_samples, shared by the rows it evaluates.
+ */
+typedef struct SamplePass {
+    const Universe *universe;
+    int stride;
+    int skip_coarser;
+    const double *radii; // The cutoff radius of each Oscillator.
+    double **matrix;
+} SamplePass;
+
+/**
+ * Evaluates every Oscillator at the pixels of a pass on the row at the index times the stride.
+ */
+static inline void evaluate_sample_row(void *context, size_t index) {
+    const SamplePass *pass = context;
+    const Universe *universe = pass->universe;
+    const OscillatorStore *store = universe->oscillators;
+    const DissipationModel model = universe->dissipation_model;
+    const int stride = pass->stride;
+    const int y = (int) index * stride;
+    // On rows of the coarser pass, only the pixels between its samples are evaluated.
+    const int step = pass->skip_coarser && y % (2 * stride) == 0 ? 2 * stride : stride;
+    const int phase = step == stride ? 0 : stride;
+    double *row = pass->matrix[y];
+    for (int x = phase; x < universe->width; x += step) {
+        row[x] = 0.0;
+    }
+    for (size_t i = 0; i < store->count; i++) {
+        const double first_offset_x = -universe->width / 2 - store->center_x[i];
+        const double offset_y = y - universe->height / 2 - store->center_y[i];
+        int begin = 0;
+        int end = universe->width;
+        clip_span_to_radius(&begin, &end, first_offset_x, offset_y, pass->radii[i]);
+        // Round the beginning up to the next pixel of the pass.
+        begin += ((phase - begin) % step + step) % step;
+        accumulate_wave_span(universe->geometry, row, begin, end, first_offset_x, offset_y, step, store->wavelength[i],
+                             model, store->amplitude[i]);
+    }
+}
+
+/**
+ * Evaluates every Oscillator at the pixels of the matrix whose coordinates are multiples of the stride.
+ *
+ * Pixels whose coordinates are also multiples of twice the stride are skipped
+ * if skip_coarser is set, as they were evaluated by a pass at that stride. The
+ * Layers and the value matrix are left as they are, so this costs about as
+ * much as directly evaluating every Oscillator over stride^2 times fewer pixels.
+ * If the Universe has a ThreadPool, rows are evaluated on it.
+ */
+static inline void evaluate_samples(const Universe * const universe, const int stride, const int skip_coarser, double **matrix) {
+    const OscillatorStore *store = universe->oscillators;
+    double *radii = malloc((store->count + 1) * sizeof(double));
+    for (size_t i = 0; i < store->count; i++) {
+        radii[i] = get_cutoff_radius(universe, universe->dissipation_model, store->amplitude[i]);
+    }
+    SamplePass pass = {universe, stride, skip_coarser, radii, matrix};
+    const size_t rows = (size_t) (universe->height + stride - 1) / stride;
+    if (universe->thread_pool != NULL) {
+        run_parallel(universe->thread_pool, evaluate_sample_row, &pass, rows);
+    } else {
+        for (size_t row = 0; row < rows; row++) {
+            evaluate_sample_row(&pass, row);
+        }
+    }
+    free(radii);
+}
+
+/**
+ * Evaluates the frame of the view zoomed out, in which each pixel shows the pixel of the plane 2^-zoom times farther from the center.
+ *
+ * Pixels of the frame which fall on the value matrix are copied from it, so
+ * the value matrix must be up to date. Every Oscillator is evaluated directly
+ * at the other pixels.
+ */
+static inline void update_zoomed_matrix(Universe *universe) {
+    if (universe->zoomed_matrix == NULL) {
+        universe->zoomed_matrix = create_matrix(universe->width, universe->height);
+    }
+    ensure_cached_geometry(universe);
+    const OscillatorStore *store = universe->oscillators;
+    const DissipationModel model = universe->dissipation_model;
+    const int scale = 1 << -universe->zoom;
+    const int width = universe->width;
+    const int height = universe->height;
+    // The pixel (x, y) of the frame is the pixel (first_x + scale * x, first_y + scale * y) of the value matrix.
+    const int first_x = width / 2 - scale * (width / 2);
+    const int first_y = height / 2 - scale * (height / 2);
+    // The columns of the frame which fall on the value matrix, as first_x is not positive.
+    const int covered_begin = (-first_x + scale - 1) / scale;
+    const int covered_end = (width - first_x + scale - 1) / scale;
+    // The row of the plane is sampled every scale pixels.
+    double *row = malloc((size_t) scale * width * sizeof(double));
+    for (int y = 0; y < height; y++) {
+        const int plane_y = first_y + scale * y;
+        const int covered = plane_y >= 0 && plane_y < height;
+        for (int x = 0; x < width; x++) {
+            row[scale * x] = 0.0;
+        }
+        for (size_t i = 0; i < store->count; i++) {
+            const double radius = get_cutoff_radius(universe, model, store->amplitude[i]);
+            const double first_offset_x = first_x - universe->width / 2 - store->center_x[i];
+            const double offset_y = plane_y - universe->height / 2 - store->center_y[i];
+            const int spans[2][2] = {{0, covered ? scale * covered_begin : scale * width}, {scale * covered_end, scale * width}};
+            for (int j = 0; j < (covered ? 2 : 1); j++) {
+                int begin = spans[j][0];
+                int end = spans[j][1];
+                clip_span_to_radius(&begin, &end, first_offset_x, offset_y, radius);
+                // Round the beginning up to the next sample.
+                begin += (scale - begin % scale) % scale;
+                accumulate_wave_span(universe->geometry, row, begin, end, first_offset_x, offset_y, scale,
+                                     store->wavelength[i], model, store->amplitude[i]);
+            }
+        }
+        double *zoomed_row = universe->zoomed_matrix[y];
+        for (int x = 0; x < width; x++) {
+            const int reused = covered && x >= covered_begin && x < covered_end;
+            zoomed_row[x] = reused ? universe->value_matrix[plane_y][first_x + scale * x] : row[scale * x];
+        }
+    }
+    free(row);
+}
+
+/**
+ * Returns how many pixels of the window a pixel of the plane spans.
+ *
+ * Only the superposition engine can be zoomed.
+ */
+static inline double get_view_magnification(const Universe * const universe) {
+    return universe->engine == SUPERPOSITION_ENGINE ? ldexp(1.0, universe->zoom) : 1.0;
+}
+
+/**
+ * Returns the FDTDSimulation of the Universe, creating it if needed.
+ */
+static inline FDTDSimulation *get_universe_simulation(Universe *universe) {
+    if (universe->simulation == NULL) {
+        if (universe->thread_pool == NULL) {
+            universe->thread_pool = create_thread_pool(0);
+        }
+        universe->simulation = create_fdtd_simulation(universe->width, universe->height, universe->thread_pool);
+        printf("Simulating on %zu threads\n", universe->thread_pool->thread_count);
+    }
+    return universe->simulation;
+}
+
+/**
+ * Advances the simulation by the specified number of steps, driving the field at the center of each Oscillator.
+ */
+static inline void step_universe_simulation(Universe *universe, const int steps) {
+    FDTDSimulation *simulation = get_universe_simulation(universe);
+    const OscillatorStore *store = universe->oscillators;
+    for (int i = 0; i < steps; i++) {
+        step_fdtd(simulation);
+        for (size_t index = 0; index < store->count; index++) {
+            // A wave travels courant_number cells per step, so a wavelength takes wavelength / courant_number steps.
+            const double phase = TAU * simulation->courant_number * simulation->step_count / store->wavelength[index];
+            const float value = (float) (store->amplitude[index] * sin(phase)) * SIMULATION_SOURCE_STRENGTH;
+            // Fractional centers drive the four nearest cells with bilinear weights.
+            const double x = store->center_x[index] + universe->width / 2;
+            const double y = store->center_y[index] + universe->height / 2;
+            const int cell_x = (int) floor(x);
+            const int cell_y = (int) floor(y);
+            const float fraction_x = (float) (x - cell_x);
+            const float fraction_y = (float) (y - cell_y);
+            add_to_fdtd_field(simulation, cell_x, cell_y, value * (1.0f - fraction_x) * (1.0f - fraction_y));
+            add_to_fdtd_field(simulation, cell_x + 1, cell_y, value * fraction_x * (1.0f - fraction_y));
+            add_to_fdtd_field(simulation, cell_x, cell_y + 1, value * (1.0f - fraction_x) * fraction_y);
+            add_to_fdtd_field(simulation, cell_x + 1, cell_y + 1, value * fraction_x * fraction_y);
+        }
+    }
+}
+
+/**
+ * Maps the simulated field to the value matrix, with zero in the middle of the range of intensities.
+ *
+ * The field is unbounded near the sources, so it is scaled by its root mean square rather than by its maximum.
+ */
+static inline void copy_simulation_to_value_matrix(Universe *universe) {
+    const FDTDSimulation *simulation = get_universe_simulation(universe);
+    double sum_of_squares = 0.0;
+    for (uint16_t y = 0; y < universe->height; y++) {
+        for (uint16_t x = 0; x < universe->width; x++) {
+            sum_of_squares += square(get_fdtd_value(simulation, x, y));
+        }
+    }
+    const double root_mean_square = sqrt(sum_of_squares / ((double) universe->width * universe->height));
+    const double range = root_mean_square > 0.0 ? SIMULATION_DISPLAY_RANGE * root_mean_square : 1.0;
+    for (uint16_t y = 0; y < universe->height; y++) {
+        for (uint16_t x = 0; x < universe->width; x++) {
+            const double value = get_fdtd_value(simulation, x, y) / range;
+            universe->value_matrix[y][x] = (minimum(maximum(value, -1.0), 1.0) + 1.0) / 2.0;
+        }
+    }
+}
+
+/**
+ * Toggles a wall with two slits across the simulation, a little above its center.
+ */
+static inline void toggle_simulation_slits(Universe *universe) {
+    FDTDSimulation *simulation = get_universe_simulation(universe);
+    const int wall_y = universe->height / 2 - universe->height / 8;
+    const int obstacle = !is_fdtd_obstacle(simulation, 0, wall_y);
+    const int slit_width = (int) (DEFAULT_WAVELENGTH / 2);
+    const int slit_separation = (int) (2 * DEFAULT_WAVELENGTH);
+    for (int y = wall_y; y < wall_y + 4; y++) {
+        for (int x = 0; x < universe->width; x++) {
+            const int offset = abs(abs(x - universe->width / 2) - slit_separation / 2);
+            set_fdtd_obstacle(simulation, x, y, obstacle && offset > slit_width / 2);
+        }
+    }
+    update_fdtd_coefficients(simulation);
+}
+
+static inline uint32_t get_gray_pixel(const uint8_t intensity) {
+    return 0xFF000000u | (uint32_t) intensity << 16 | (uint32_t) intensity << 8 | intensity;
+}
+
+/**
+ * Quantizes the values of a matrix at the pixels whose coordinates are multiples of the stride, normalized by a maximum.
+ *
+ * Values beyond the maximum are clamped to it. The pixel buffer, which has rows
+ * of width pixels, receives one pixel per value, in its top-left part.
+ */
+static inline void quantize_values_to_maximum(double **matrix, const int width, const int height, const int stride,
+                                              const double maximum_intensity, uint32_t *pixels) {
+    for (int i = 0; i < height; i += stride) {
+        uint32_t *row = pixels + (size_t) (i / stride) * width;
+        for (int j = 0; j < width; j += stride) {
+            const double normalized = maximum_intensity > 0.0 ? minimum(maximum(matrix[i][j] / maximum_intensity, 0.0), 1.0) : 0.0;
+            row[j / stride] = get_gray_pixel((uint8_t) (255 * normalized));
+        }
+    }
+}
+
+/**
+ * Quantizes the values of a matrix at the pixels whose coordinates are multiples of the stride, normalized by their maximum.
+ *
+ * The values are normalized by at least minimum_intensity. The pixel buffer,
+ * which has rows of width pixels, receives one pixel per value, in its top-left
+ * part.
+ */
+static inline void quantize_values(double **matrix, const int width, const int height, const int stride, const double minimum_intensity,
+                                   uint32_t *pixels) {
+    double maximum_intensity = minimum_intensity;
+    for (int i = 0; i < height; i += stride) {
+        for (int j = 0; j < width; j += stride) {
+            if (matrix[i][j] > maximum_intensity) {
+                maximum_intensity = matrix[i][j];
+            }
+        }
+    }
+    quantize_values_to_maximum(matrix, width, height, stride, maximum_intensity, pixels);
+}
+
+/**
+ * Presents the pixels of a frame quantized with the stride on the window of the Display. Headless Displays present nothing.
+ */
+static inline void present_frame(Display *display, const Controller * const controller, const Universe * const universe, const int stride) {
+    if (display->present != NULL) {
+        display->present(display, controller, universe, stride);
+    }
+}
+
+/**
+ * Hashes everything the superposition frame of the Universe depends on.
+ */
+static inline uint64_t hash_universe_state(const Universe * const universe) {
+    const OscillatorStore *store = universe->oscillators;
+    uint64_t hash = FRAME_HASH_SEED;
+    hash = hash_bytes(hash, &universe->width, sizeof(universe->width));
+    hash = hash_bytes(hash, &universe->height, sizeof(universe->height));
+    hash = hash_bytes(hash, &universe->dissipation_model, sizeof(universe->dissipation_model));
+    hash = hash_bytes(hash, &universe->evaluation_mode, sizeof(universe->evaluation_mode));
+    // Zooming in only changes how the frame is presented.
+    const int zoom = universe->zoom < 0 ? universe->zoom : 0;
+    hash = hash_bytes(hash, &zoom, sizeof(zoom));
+    // The approximations change the frame slightly, so their settings are part of the state.
+    hash = hash_bytes(hash, &universe->cutoff_enabled, sizeof(universe->cutoff_enabled));
+    hash = hash_bytes(hash, &universe->cutoff_error, sizeof(universe->cutoff_error));
+    hash = hash_bytes(hash, &universe->clustering_enabled, sizeof(universe->clustering_enabled));
+    hash = hash_bytes(hash, &universe->clustering_error, sizeof(universe->clustering_error));
+    hash = hash_bytes(hash, &universe->interpolation_enabled, sizeof(universe->interpolation_enabled));
+    hash = hash_bytes(hash, &universe->interpolation_error, sizeof(universe->interpolation_error));
+    hash = hash_bytes(hash, &store->count, sizeof(store->count));
+    hash = hash_bytes(hash, store->center_x, store->count * sizeof(double));
+    hash = hash_bytes(hash, store->center_y, store->count * sizeof(double));
+    hash = hash_bytes(hash, store->amplitude, store->count * sizeof(double));
+    hash = hash_bytes(hash, store->wavelength, store->count * sizeof(double));
+    return hash;
+}
+
+/**
+ * Presents the cached frame of the current state of the Universe, if there is one.
+ *
+ * The value matrix is left behind, as its Layers record what it holds and
+ * catch up on the next update. Returns whether or not a frame was presented.
+ */
+static inline int present_cached_frame(Display *display, const Controller * const controller, const Universe * const universe) {
+    if (!controller->rendering || universe->engine != SUPERPOSITION_ENGINE) {
+        return 0;
+    }
+    const size_t size = (size_t) display->width * display->height;
+    const uint32_t *pixels = lookup_frame(display->frame_cache, hash_universe_state(universe), size);
+    if (pixels == NULL) {
+        return 0;
+    }
+    memcpy(display->pixels, pixels, size * sizeof(uint32_t));
+    present_frame(display, controller, universe, 1);
+    if (universe->verbose) {
+        printf("Presented a cached frame\n");
+    }
+    return 1;
+}
+
+/**
+ * Updates the Universe if the Controller is rendering, quantizes its frame into the pixels of the Display, and presents it.
+ */
+static inline void write_waves(Display *display, const Controller * const controller, Universe * const universe) {
+    if (present_cached_frame(display, controller, universe)) {
+        return;
+    }
+    clock_t start = clock();
+    int ms;
+    const int simulating = universe->engine == SIMULATION_ENGINE;
+    if (controller->rendering) {
+        if (simulating) {
+            step_universe_simulation(universe, SIMULATION_STEPS_PER_FRAME);
+            copy_simulation_to_value_matrix(universe);
+        } else {
+            update_universe_value_matrix(universe);
+            if (universe->zoom < 0) {
+                update_zoomed_matrix(universe);
+            }
+        }
+
+        ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
+        if (universe->verbose) {
+            printf("Took %d ms to recompute.\n", ms);
+        }
+        start = clock();
+    }
+
+    const int zoomed_out = !simulating && universe->zoom < 0 && universe->zoomed_matrix != NULL;
+    double **frame = zoomed_out ? universe->zoomed_matrix : universe->value_matrix;
+    // The simulated field is already mapped to [0, 1].
+    quantize_values(frame, universe->width, universe->height, 1, simulating ? 1.0 : 0.0, display->pixels);
+    if (simulating) {
+        const FDTDSimulation *simulation = get_universe_simulation(universe);
+        for (uint16_t i = 0; i < universe->height; i++) {
+            for (uint16_t j = 0; j < universe->width; j++) {
+                if (is_fdtd_obstacle(simulation, j, i)) {
+                    display->pixels[(size_t) i * display->width + j] = 0xFF0000FFu;
+                }
+            }
+        }
+    } else if (controller->rendering) {
+        const size_t size = (size_t) display->width * display->height;
+        store_frame(display->frame_cache, hash_universe_state(universe), display->pixels, size);
+    }
+    if (display->present != NULL) {
+        present_frame(display, controller, universe, 1);
+        ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
+        printf("Took %d ms to redraw.\n", ms);
+    }
+}
+
+/**
+ * Draws a frame evaluated at the pixels whose coordinates are multiples of the stride, without updating the value matrix.
+ *
+ * If skip_coarser is set, the samples at twice the stride are reused rather than evaluated again.
+ */
+static inline void write_samples(Display *display, const Controller * const controller, const Universe * const universe,
+                                 double **samples, const int stride, const int skip_coarser) {
+    clock_t start = clock();
+    evaluate_samples(universe, stride, skip_coarser, samples);
+    int ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
+    if (universe->verbose) {
+        printf("Took %d ms to recompute at 1/%d resolution.\n", ms, stride);
+    }
+    start = clock();
+
+    quantize_values(samples, universe->width, universe->height, stride, 0.0, display->pixels);
+    if (display->present != NULL) {
+        present_frame(display, controller, universe, stride);
+        ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
+        printf("Took %d ms to redraw.\n", ms);
+    }
+}
+
+/**
+ * Clamps a dimension of the window to the supported range.
+ */
+static inline uint16_t clamp_dimension(const long value) {
+    if (value < MINIMUM_SIZE) {
+        return MINIMUM_SIZE;
+    }
+    if (value > UINT16_MAX) {
+        return UINT16_MAX;
+    }
+    return (uint16_t) value;
+}
+
+/**
+ * Parses a dimension of the window from the command line.
+ */
+static inline uint16_t parse_dimension(const char *argument, const uint16_t fallback) {
+    char *end;
+    const long value = strtol(argument, &end, 10);
+    if (end == argument || *end != '\0') {
+        printf("Ignoring invalid dimension %s\n", argument);
+        return fallback;
+    }
+    return clamp_dimension(value);
+}
+
+/**
+ * Returns the directory, creating it if needed, or NULL if it cannot be written to.
+ *
+ * The caches of the cached geometry are only evaluated ahead of time to be
+ * persisted, so a directory which cannot be used is reported, once.
+ */
+static inline const char *ensure_geometry_cache_directory(const char *directory) {
+    static int reported = 0;
+    struct stat status;
+    mkdir(directory, 0755);
+    if (stat(directory, &status) != 0 || !S_ISDIR(status.st_mode) || access(directory, W_OK | X_OK) != 0) {
+        if (!reported) {
+            printf("Cannot write to %s, so the caches of distances are not persisted\n", directory);
+            reported = 1;
+        }
+        return NULL;
+    }
+    return directory;
+}
+
+/**
+ * Returns the directory where the caches of the cached geometry are persisted, creating it if needed, or NULL.
+ *
+ * It is WAVES_CACHE_DIR if it is set, so that setting it to nothing disables
+ * the persistent caches, and otherwise the waves directory of the user's cache.
+ */
+static inline const char *get_geometry_cache_directory() {
+    static char directory[4096];
+    const char *configured = getenv("WAVES_CACHE_DIR");
+    if (configured != NULL) {
+        return *configured != '\0' ? ensure_geometry_cache_directory(configured) : NULL;
+    }
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int length;
+    if (cache_home != NULL && *cache_home != '\0') {
+        length = snprintf(directory, sizeof(directory), "%s/waves", cache_home);
+    } else if (home != NULL) {
+        snprintf(directory, sizeof(directory), "%s/.cache", home);
+        mkdir(directory, 0755);
+        length = snprintf(directory, sizeof(directory), "%s/.cache/waves", home);
+    } else {
+        return NULL;
+    }
+    if (length < 0 || (size_t) length >= sizeof(directory)) {
+        return NULL;
+    }
+    return ensure_geometry_cache_directory(directory);
+}
+
+/**
+ * Returns the budget of the frame cache, which is WAVES_FRAME_CACHE mebibytes if it is set, so that 0 disables it.
+ */
+static inline size_t get_frame_cache_budget() {
+    const char *configured = getenv("WAVES_FRAME_CACHE");
+    if (configured == NULL || *configured == '\0') {
+        return DEFAULT_FRAME_CACHE_BUDGET;
+    }
+    char *end;
+    const long mebibytes = strtol(configured, &end, 10);
+    if (*end != '\0' || mebibytes < 0 || (unsigned long) mebibytes > SIZE_MAX >> 20) {
+        printf("Invalid WAVES_FRAME_CACHE %s, caching up to %zu MiB of frames\n", configured, DEFAULT_FRAME_CACHE_BUDGET >> 20);
+        return DEFAULT_FRAME_CACHE_BUDGET;
+    }
+    return (size_t) mebibytes << 20;
+}
@@ -0,0 +1,136 @@
+// The window of the demo, which the frames of a Display are presented on through SDL.
+//
+// The engine only quantizes frames into the pixel buffer of the Display. A
+// Display created here also uploads them to a texture and scales it to the
+// window, highlighting the Oscillators and recording the presented frames.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include "SDL.h"
+
+#include "universe.h"
+
+/**
+ * What the frames of a Display with a window are presented through.
+ */
+typedef struct DisplayWindow {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture; // Of the dimensions of the Display.
+} DisplayWindow;
+
+/**
+ * Copies the part of the pixel buffer shown by the window into a recorded frame, scaled as the window scales it.
+ *
+ * The shown part is stretched over a frame whose dimensions are the evaluated columns and rows times the stride, of
+ * which the recorded frame keeps the dimensions of the Display.
+ */
+static inline void copy_presented_frame(const Display * const display, const SDL_Rect * const shown_frame,
+                                        const int columns, const int rows, const int stride, uint32_t *frame) {
+    const int window_width = columns * stride;
+    const int window_height = rows * stride;
+    for (int y = 0; y < display->height; y++) {
+        const uint32_t *source = display->pixels + (size_t) (shown_frame->y + y * shown_frame->h / window_height) * display->width;
+        uint32_t *target = frame + (size_t) y * display->width;
+        if (shown_frame->w == window_width) {
+            // Frames at full resolution which are not magnified are copied as they are.
+            memcpy(target, source, display->width * sizeof(uint32_t));
+            continue;
+        }
+        for (int x = 0; x < display->width; x++) {
+            target[x] = source[shown_frame->x + x * shown_frame->w / window_width];
+        }
+    }
+}
+
+/**
+ * Scales the pixels of a frame quantized with the stride to the window, highlights the Oscillators, and presents it.
+ *
+ * If the view is zoomed in, only the middle of the frame is shown, magnified.
+ */
+static inline void present_window_frame(Display *display, const Controller * const controller, const Universe * const universe,
+                                        const int stride) {
+    const DisplayWindow *window = display->window;
+    const int columns = (universe->width + stride - 1) / stride;
+    const int rows = (universe->height + stride - 1) / stride;
+    const SDL_Rect frame = {0, 0, columns, rows};
+    const double magnification = get_view_magnification(universe);
+    const int shown_columns = magnification > 1.0 ? (int) (columns / magnification) : columns;
+    const int shown_rows = magnification > 1.0 ? (int) (rows / magnification) : rows;
+    const SDL_Rect shown_frame = {(columns - shown_columns) / 2, (rows - shown_rows) / 2, shown_columns, shown_rows};
+    // Each pixel covers the block of the window whose top-left pixel it was evaluated at.
+    const SDL_Rect window_frame = {0, 0, columns * stride, rows * stride};
+    SDL_UpdateTexture(window->texture, &frame, display->pixels, display->width * sizeof(uint32_t));
+    SDL_RenderCopy(window->renderer, window->texture, &shown_frame, &window_frame);
+    if (display->capture != NULL && display->capture->width == display->width && display->capture->height == display->height) {
+        // The frame is dropped rather than waited for if the writer is behind.
+        uint32_t *recorded_frame = begin_video_frame(display->capture);
+        if (recorded_frame != NULL) {
+            copy_presented_frame(display, &shown_frame, columns, rows, stride, recorded_frame);
+            end_video_frame(display->capture);
+        }
+    }
+
+    if (controller->highlight == HIGHLIGHT_DOT) {
+        // Make a red dot for each Oscillator.
+        SDL_SetRenderDrawColor(window->renderer, 255, 0, 0, 0);
+        const OscillatorStore *store = universe->oscillators;
+        for (size_t index = 0; index < store->count; index++) {
+            SDL_RenderDrawPoint(window->renderer, (int) lround(store->center_x[index] * magnification) + universe->width / 2,
+                                (int) lround(store->center_y[index] * magnification) + universe->height / 2);
+        }
+    }
+
+    SDL_RenderPresent(window->renderer);
+}
+
+/**
+ * Creates a Display of the specified dimensions for the window, or returns NULL if its texture could not be created.
+ *
+ * Its frame cache keeps at most frame_cache_budget bytes of finished frames.
+ */
+static inline Display *create_display(SDL_Window *window, SDL_Renderer *renderer, const uint16_t width, const uint16_t height,
+                                      const size_t frame_cache_budget) {
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (texture == NULL) {
+        return NULL;
+    }
+    DisplayWindow *display_window = malloc(sizeof(DisplayWindow));
+    display_window->window = window;
+    display_window->renderer = renderer;
+    display_window->texture = texture;
+    Display *display = create_headless_display(width, height, frame_cache_budget);
+    display->window = display_window;
+    display->present = present_window_frame;
+    return display;
+}
+
+/**
+ * Replaces the texture and the pixel buffer of the Display with ones of the specified dimensions.
+ *
+ * Cached frames are kept, as their sizes tell them apart. Returns 0 if the texture could be created.
+ */
+static inline int resize_window_display(Display *display, const uint16_t width, const uint16_t height) {
+    DisplayWindow *window = display->window;
+    SDL_Texture *texture = SDL_CreateTexture(window->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                             width, height);
+    if (texture == NULL) {
+        return 1;
+    }
+    SDL_DestroyTexture(window->texture);
+    window->texture = texture;
+    resize_display(display, width, height);
+    return 0;
+}
+
+/**
+ * Releases the Display and its texture, but not the window or the renderer it was created for.
+ */
+static inline void delete_window_display(Display *display) {
+    DisplayWindow *window = display->window;
+    SDL_DestroyTexture(window->texture);
+    free(window);
+    delete_display(display);
+}
@@ -1,66 +1,823 @@
 // Fast calculation of geometric functions.
 //
-// The SIN_OF_DISTANCE_CACHE only covers the default wavelength.
+// A CachedGeometry holds the caches of an engine. Its two-dimensional tables
+// hold the sine of the distance to every whole offset, which only covers the
+// default wavelength, and the radial attenuation of each dissipation model.
+//
+// The radial tables sample the same functions along the distance, several times
+// per pixel, so that they can be interpolated at the fractional distances from
+// oscillators which are not centered on a pixel.
+//
+// The sine caches which cover the default window are generated at build time
+// into constant arrays, so create_cached_geometry only points at them, and the
+// attenuation caches of the same size are allocated next to them. They grow at
+// runtime in chunks of CACHED_GEOMETRY_CHUNK pixels as larger offsets come into
+// use, keeping what was already computed. The parts which were neither generated
+// nor computed yet are filled on first use, a row of the two-dimensional caches or a chunk of the
+// radial tables at a time, by whichever thread reads them first. The rest can be
+// filled ahead of time in parallel by warm_cached_geometry. If a directory is
+// given to create_cached_geometry, larger caches are persisted there and mapped
+// read-only by the next engines and processes which request them. Each file
+// takes up to a few hundred megabytes, so only the GEOMETRY_CACHE_FILE_LIMIT
+// most recently used ones are kept. The
+// two-dimensional caches grow with the square of the offsets they cover, so they
+// are bounded by CACHED_GEOMETRY_BUDGET, and whole offsets beyond them are looked
+// up in the radial tables instead.
+//
+// Offsets beyond every cache, and wavelengths other than the default one, are
+// evaluated by a polynomial approximation of the sine written so that loops over
+// whole rows are vectorized by the compiler.
 //
 // Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
 
 #pragma once
 
+#include <dirent.h>
 #include <math.h>
-#include <stdio.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "constants.h"
+#include "dissipation.h"
+#include "geometry-cache-file.h"
+#include "geometry-tables.h"
 #include "geometry.h"
-#include "logger.h"
+#include "thread-pool.h"
+
+/**
+ * The offset covered by the caches when nothing larger is needed.
+ */
+#define DEFAULT_CACHED_GEOMETRY_MAXIMUM 500
+
+/**
+ * The maximum number of bytes used by the two-dimensional caches together.
+ */
+#define CACHED_GEOMETRY_BUDGET (192 * 1024 * 1024)
+
+/**
+ * The largest offset the caches may be asked to cover, which bounds the size of the radial tables.
+ */
+#define MAXIMUM_CACHED_GEOMETRY_OFFSET 16384
+
+/**
+ * The most persistent files of the caches a directory keeps, removing the least recently used ones.
+ */
+#define GEOMETRY_CACHE_FILE_LIMIT 4
+
+/**
+ * The granularity, in pixels, in which the caches grow.
+ */
+#define CACHED_GEOMETRY_CHUNK 256
+
+/**
+ * The number of samples of the radial tables which are filled together.
+ */
+#define RADIAL_TABLE_CHUNK (CACHED_GEOMETRY_CHUNK * RADIAL_TABLE_RESOLUTION)
+
+/**
+ * Marks a segment of a table which a thread is filling.
+ */
+#define SEGMENT_BEING_FILLED -1
+
+typedef enum TableStorage {
+    GENERATED_TABLES, // The first GENERATED_TABLE_COUNT tables are compiled into the program, and the others allocated.
+    ALLOCATED_TABLES,
+    MAPPED_TABLES // Part of the mapping of the CachedGeometry.
+} TableStorage;
+
+/**
+ * The caches of the geometric functions of an engine.
+ *
+ * Any number of threads may read a CachedGeometry at once, as its tables are
+ * only written while they are filled on first use, which is synchronized by the
+ * ends of their segments. It may only grow while no other thread uses it. The
+ * generated tables and the mapped files are never written, so they are shared by
+ * every CachedGeometry which uses them.
+ */
+typedef struct CachedGeometry {
+    int maximum; // The offset covered by the caches, as requested when creating or growing them.
+    int offset_table_maximum; // The biggest value N such that (n, n) is in the two-dimensional caches.
+    const double *offset_tables[GEOMETRY_TABLE_COUNT]; // N + 1 rows of N + 1 values, in the order of geometry-tables.h.
+    int radial_table_size; // The number of samples of the radial tables, which cover every offset up to the maximum, up to its diagonal.
+    const double *radial_tables[GEOMETRY_TABLE_COUNT];
+    TableStorage offset_table_storage;
+    TableStorage radial_table_storage;
+    char *directory; // The directory of the persistent files of the caches, or NULL if they are not persisted.
+    void *mapping; // The file the caches were mapped from, or NULL.
+    size_t mapping_size;
+    atomic_int *offset_row_ends; // The end of the filled part of each row of the allocated two-dimensional caches, or NULL if they are filled.
+    atomic_int *radial_chunk_ends; // The end of the filled samples of each chunk of the allocated radial tables, or NULL if they are filled.
+} CachedGeometry;
+
+// Defined in the source file written by generate-tables.
+extern const double GENERATED_OFFSET_TABLES[GENERATED_TABLE_COUNT][GENERATED_OFFSET_TABLE_SIZE];
+extern const double GENERATED_RADIAL_TABLES[GENERATED_TABLE_COUNT][GENERATED_RADIAL_TABLE_SIZE];
 
-// The biggest value N such that (n, n) is in the cache.
-#define SIN_OF_DISTANCE_CACHE_MAXIMUM 500
+/**
+ * Returns the first of the tables of a kind which are allocated with the storage.
+ *
+ * The allocated tables are the ones which are freed, and filled on first use.
+ */
+static inline int get_first_allocated_table(const TableStorage storage) {
+    if (storage == ALLOCATED_TABLES) {
+        return 0;
+    }
+    return storage == GENERATED_TABLES ? GENERATED_TABLE_COUNT : GEOMETRY_TABLE_COUNT;
+}
 
-double SIN_OF_DISTANCE_CACHE[SIN_OF_DISTANCE_CACHE_MAXIMUM + 1][SIN_OF_DISTANCE_CACHE_MAXIMUM + 1];
+/**
+ * Returns the sine of TAU times the phase, which is measured in cycles.
+ *
+ * The error is below 1e-11 for phases below 2^50. There are no branches or
+ * calls, so loops over this function are vectorized.
+ */
+static inline double sin_of_phase(double phase) {
+    // Adding and subtracting 1.5 * 2^52 rounds to the nearest integer, leaving half a cycle around zero.
+    double t = phase - ((phase + 6755399441055744.0) - 6755399441055744.0);
+    // The sine is symmetric around a quarter of a cycle, so folding the rest of the half cycle leaves [-1/4, 1/4].
+    t = copysign(0.25 - fabs(fabs(t) - 0.25), t);
+    const double x = TAU * t;
+    const double x2 = x * x;
+    // The Taylor polynomial of degree 15, as |x| is at most pi / 2.
+    return x * (1.0 + x2 * (-1.0 / 6.0 + x2 * (1.0 / 120.0 + x2 * (-1.0 / 5040.0 + x2 * (1.0 / 362880.0 +
+           x2 * (-1.0 / 39916800.0 + x2 * (1.0 / 6227020800.0 + x2 * (-1.0 / 1307674368000.0))))))));
+}
 
-double distance_to_origin(int x, int y) {
-    return sqrt(square(x) + square(y));
+static inline double evaluate_sin_of_distance(int x, int y, double wavelength) {
+    return sin_of_phase(distance_to_origin(x, y) / wavelength);
 }
 
-double evaluate_sin_of_distance(int x, int y, double wavelength) {
-    return sin(distance_to_origin(x, y) * TAU / wavelength);
+/**
+ * Evaluates the sine of the phase of a wave at count pixels of a row, without the caches.
+ *
+ * The pixels are at the horizontal offsets first_x, first_x + step_x, and so on
+ * from the oscillator, and at the vertical offset y.
+ */
+static inline void evaluate_sin_of_distances(double *result, const int count, const double first_x, const double step_x,
+                                             const double y, const double wavelength) {
+    const double y_squared = y * y;
+    for (int i = 0; i < count; i++) {
+        const double x = first_x + i * step_x;
+        result[i] = sin_of_phase(sqrt(x * x + y_squared) / wavelength);
+    }
+}
+
+/**
+ * Claims the filling of a segment of a table up to the end, waiting for any other thread filling it.
+ *
+ * Returns where the filling must begin, or -1 if the segment is already filled.
+ * The claiming thread must store the end into filled_end once it is done.
+ */
+static inline int claim_segment(atomic_int *filled_end, const int end) {
+    while (1) {
+        int begin = atomic_load_explicit(filled_end, memory_order_acquire);
+        if (begin == end) {
+            return -1;
+        }
+        if (begin == SEGMENT_BEING_FILLED) {
+            sched_yield();
+        } else if (atomic_compare_exchange_weak(filled_end, &begin, SEGMENT_BEING_FILLED)) {
+            return begin;
+        }
+    }
+}
+
+/**
+ * Makes sure that a row of the two-dimensional caches is filled.
+ */
+static inline void ensure_offset_row(const CachedGeometry * const geometry, const int y) {
+    if (geometry->offset_row_ends == NULL) {
+        return;
+    }
+    const int end = geometry->offset_table_maximum + 1;
+    const int begin = claim_segment(&geometry->offset_row_ends[y], end);
+    if (begin != -1) {
+        // Only allocated tables are written.
+        double *tables[GEOMETRY_TABLE_COUNT];
+        for (int i = 0; i < GEOMETRY_TABLE_COUNT; i++) {
+            tables[i] = (double *) geometry->offset_tables[i];
+        }
+        fill_offset_tables(tables, get_first_allocated_table(geometry->offset_table_storage), end - 1, y, begin);
+        atomic_store_explicit(&geometry->offset_row_ends[y], end, memory_order_release);
+    }
+}
+
+/**
+ * Makes sure that a row of the sine of the distance in the two-dimensional caches is filled.
+ *
+ * A generated row is already filled, and is not worth filling the other tables for.
+ */
+static inline void ensure_sine_row(const CachedGeometry * const geometry, const int y) {
+    if (get_first_allocated_table(geometry->offset_table_storage) <= SINE_TABLE) {
+        ensure_offset_row(geometry, y);
+    }
 }
 
-double fetch_sin_of_distance(int x, int y) {
-    return SIN_OF_DISTANCE_CACHE[y][x];
+static inline int get_radial_chunk_count(const int table_size) {
+    return (table_size + RADIAL_TABLE_CHUNK - 1) / RADIAL_TABLE_CHUNK;
 }
 
-double sin_of_distance(int x, int y, double wavelength) {
+/**
+ * Makes sure that a chunk of the radial tables is filled.
+ */
+static inline void ensure_radial_chunk(const CachedGeometry * const geometry, const int chunk) {
+    if (geometry->radial_chunk_ends == NULL) {
+        return;
+    }
+    const int size = geometry->radial_table_size;
+    const int end = (chunk + 1) * RADIAL_TABLE_CHUNK < size ? (chunk + 1) * RADIAL_TABLE_CHUNK : size;
+    const int begin = claim_segment(&geometry->radial_chunk_ends[chunk], end);
+    if (begin != -1) {
+        double *tables[GEOMETRY_TABLE_COUNT];
+        for (int i = 0; i < GEOMETRY_TABLE_COUNT; i++) {
+            tables[i] = (double *) geometry->radial_tables[i];
+        }
+        fill_radial_tables(tables, get_first_allocated_table(geometry->radial_table_storage), begin, end);
+        atomic_store_explicit(&geometry->radial_chunk_ends[chunk], end, memory_order_release);
+    }
+}
+
+static inline void warm_geometry_segment(void *context, size_t index) {
+    const CachedGeometry *geometry = context;
+    const size_t row_count = geometry->offset_table_maximum + 1;
+    if (index < row_count) {
+        ensure_offset_row(geometry, (int) index);
+    } else {
+        ensure_radial_chunk(geometry, (int) (index - row_count));
+    }
+}
+
+/**
+ * Fills every part of the caches which was not read yet, in parallel on the ThreadPool, which may be NULL.
+ *
+ * The caches must not grow meanwhile.
+ */
+static inline void warm_cached_geometry(const CachedGeometry * const geometry, ThreadPool *pool) {
+    if (geometry->offset_row_ends != NULL || geometry->radial_chunk_ends != NULL) {
+        const size_t segment_count = geometry->offset_table_maximum + 1 + get_radial_chunk_count(geometry->radial_table_size);
+        run_parallel(pool, warm_geometry_segment, (void *) geometry, segment_count);
+    }
+}
+
+/**
+ * Returns a value of the sine of the distance from the two-dimensional caches, whose row must have been filled.
+ */
+static inline double fetch_sin_of_distance(const CachedGeometry * const geometry, int x, int y) {
+    return geometry->offset_tables[SINE_TABLE][(size_t) y * (geometry->offset_table_maximum + 1) + x];
+}
+
+/**
+ * Linearly interpolates one of the radial tables at a distance it covers.
+ */
+static inline double interpolate_radial_table(const CachedGeometry * const geometry, const int table, double radius) {
+    const double position = radius * RADIAL_TABLE_RESOLUTION;
+    const int index = (int) position;
+    const double fraction = position - index;
+    if (geometry->radial_chunk_ends != NULL && table >= get_first_allocated_table(geometry->radial_table_storage)) {
+        ensure_radial_chunk(geometry, index / RADIAL_TABLE_CHUNK);
+        ensure_radial_chunk(geometry, (index + 1) / RADIAL_TABLE_CHUNK);
+    }
+    const double *samples = geometry->radial_tables[table];
+    return samples[index] + fraction * (samples[index + 1] - samples[index]);
+}
+
+static inline int is_radius_in_radial_tables(const CachedGeometry * const geometry, double radius) {
+    return radius * RADIAL_TABLE_RESOLUTION < geometry->radial_table_size - 1;
+}
+
+static inline int is_offset_in_cache(const CachedGeometry * const geometry, int x, int y) {
+    return x <= geometry->offset_table_maximum && y <= geometry->offset_table_maximum;
+}
+
+/**
+ * Restricts the range [*begin, *end) of a row to the pixels whose whole offsets from an oscillator are in the two-dimensional caches.
+ *
+ * first_offset_x is the horizontal offset of the first pixel of the row from the oscillator.
+ * If any pixel is left, the row of the caches is filled so that it can be fetched.
+ */
+static inline void clip_span_to_cache(const CachedGeometry * const geometry, int *begin, int *end, const int first_offset_x,
+                                      const int offset_y) {
+    const int maximum = geometry->offset_table_maximum;
+    if (abs(offset_y) > maximum) {
+        *end = *begin;
+        return;
+    }
+    *begin = *begin > -maximum - first_offset_x ? *begin : -maximum - first_offset_x;
+    *end = *end < maximum + 1 - first_offset_x ? *end : maximum + 1 - first_offset_x;
+    if (*end < *begin) {
+        *end = *begin;
+    } else if (*end > *begin) {
+        ensure_sine_row(geometry, abs(offset_y));
+    }
+}
+
+static inline double sin_of_distance(const CachedGeometry * const geometry, int x, int y, double wavelength) {
     // Make both values absolute
     x = abs(x);
     y = abs(y);
-    if (wavelength == DEFAULT_WAVELENGTH &&
-            x <= SIN_OF_DISTANCE_CACHE_MAXIMUM &&
-            y <= SIN_OF_DISTANCE_CACHE_MAXIMUM) {
-        return fetch_sin_of_distance(x, y);
+    if (wavelength == DEFAULT_WAVELENGTH && is_offset_in_cache(geometry, x, y)) {
+        ensure_sine_row(geometry, y);
+        return fetch_sin_of_distance(geometry, x, y);
+    } else if (wavelength == DEFAULT_WAVELENGTH && is_radius_in_radial_tables(geometry, distance_to_origin(x, y))) {
+        return interpolate_radial_table(geometry, SINE_TABLE, distance_to_origin(x, y));
     } else {
-        char message[256];
-        // sprintf() returns the number of bytes written to the string.
-        if (sprintf(message, "Failed to fetch (%d, %d) from the cache.", x, y) > 0) {
-            char *tags[] = {"GEOMETRY_CACHE_MISS"};
-            log_message(2, message, tags, 1);
-        }
         return evaluate_sin_of_distance(x, y, wavelength);
     }
 }
 
-void init_sin_of_distance() {
-    for (int y = 0; y < SIN_OF_DISTANCE_CACHE_MAXIMUM; y++) {
-        for (int x = 0; x < SIN_OF_DISTANCE_CACHE_MAXIMUM; x++) {
-            SIN_OF_DISTANCE_CACHE[y][x] = evaluate_sin_of_distance(x, y, DEFAULT_WAVELENGTH);
+/**
+ * Returns the sine of the phase of a wave at a fractional distance from its oscillator.
+ */
+static inline double sin_of_radius(const CachedGeometry * const geometry, double radius, double wavelength) {
+    if (wavelength == DEFAULT_WAVELENGTH && is_radius_in_radial_tables(geometry, radius)) {
+        return interpolate_radial_table(geometry, SINE_TABLE, radius);
+    } else {
+        return sin_of_phase(radius / wavelength);
+    }
+}
+
+/**
+ * Returns the row of the attenuation table of the model for a vertical offset.
+ *
+ * The row is indexed by the absolute horizontal offset. Returns NULL if the
+ * vertical offset is not covered by the cache.
+ */
+static inline const double *attenuation_row(const CachedGeometry * const geometry, DissipationModel model, int y) {
+    y = abs(y);
+    if (y > geometry->offset_table_maximum) {
+        return NULL;
+    }
+    ensure_offset_row(geometry, y);
+    return geometry->offset_tables[ATTENUATION_TABLE(model)] + (size_t) y * (geometry->offset_table_maximum + 1);
+}
+
+/**
+ * Returns the attenuation of the model at a fractional distance from the oscillator.
+ */
+static inline double attenuation_of_radius(const CachedGeometry * const geometry, DissipationModel model, double radius) {
+    if (is_radius_in_radial_tables(geometry, radius)) {
+        return interpolate_radial_table(geometry, ATTENUATION_TABLE(model), radius);
+    }
+    return attenuation(model, radius);
+}
+
+/**
+ * Returns the attenuation of the model at an offset from the oscillator.
+ */
+static inline double attenuation_of_offset(const CachedGeometry * const geometry, DissipationModel model, int x, int y) {
+    x = abs(x);
+    y = abs(y);
+    if (is_offset_in_cache(geometry, x, y)) {
+        ensure_offset_row(geometry, y);
+        return geometry->offset_tables[ATTENUATION_TABLE(model)][(size_t) y * (geometry->offset_table_maximum + 1) + x];
+    }
+    return attenuation_of_radius(geometry, model, distance_to_origin(x, y));
+}
+
+/**
+ * Allocates the tables of the size from first_table onwards.
+ *
+ * Returns 0 if the memory could be allocated. Otherwise, nothing is allocated.
+ */
+static inline int allocate_geometry_tables(double *tables[GEOMETRY_TABLE_COUNT], const int first_table, const size_t size) {
+    int failed = 0;
+    for (int i = first_table; i < GEOMETRY_TABLE_COUNT; i++) {
+        tables[i] = malloc(size * sizeof(double));
+        failed = failed || tables[i] == NULL;
+    }
+    if (failed) {
+        for (int i = first_table; i < GEOMETRY_TABLE_COUNT; i++) {
+            free(tables[i]);
+        }
+    }
+    return failed;
+}
+
+/**
+ * Releases the mapped file of the caches if no tables are part of it anymore.
+ */
+static inline void release_unused_geometry_cache_mapping(CachedGeometry *geometry) {
+    if (geometry->mapping != NULL && geometry->offset_table_storage != MAPPED_TABLES &&
+        geometry->radial_table_storage != MAPPED_TABLES) {
+        munmap(geometry->mapping, geometry->mapping_size);
+        geometry->mapping = NULL;
+        geometry->mapping_size = 0;
+    }
+}
+
+/**
+ * Replaces the tables of one of the kinds of tables of the CachedGeometry, freeing the ones which were allocated.
+ */
+static inline void replace_geometry_tables(CachedGeometry *geometry, const double *current[GEOMETRY_TABLE_COUNT],
+                                           const double * const tables[GEOMETRY_TABLE_COUNT], TableStorage *storage,
+                                           const TableStorage new_storage) {
+    for (int i = 0; i < GEOMETRY_TABLE_COUNT; i++) {
+        if (i >= get_first_allocated_table(*storage)) {
+            free((double *) current[i]);
+        }
+        current[i] = tables[i];
+    }
+    *storage = new_storage;
+    release_unused_geometry_cache_mapping(geometry);
+}
+
+/**
+ * Copies the two-dimensional caches into larger ones, whose new offsets are filled on first use.
+ *
+ * Returns 0 if the memory could be allocated. Otherwise, the caches are left as they were.
+ */
+static inline int grow_two_dimensional_caches(CachedGeometry *geometry, const int new_maximum) {
+    const int old_maximum = geometry->offset_table_maximum;
+    double *tables[GEOMETRY_TABLE_COUNT];
+    atomic_int *row_ends = malloc((new_maximum + 1) * sizeof(atomic_int));
+    if (row_ends == NULL) {
+        return 1;
+    }
+    if (allocate_geometry_tables(tables, 0, (size_t) (new_maximum + 1) * (new_maximum + 1))) {
+        free(row_ends);
+        return 1;
+    }
+    for (int y = 0; y <= new_maximum; y++) {
+        int filled_end = 0;
+        if (y <= old_maximum) {
+            filled_end = geometry->offset_row_ends == NULL ? old_maximum + 1 : atomic_load(&geometry->offset_row_ends[y]);
+        }
+        atomic_init(&row_ends[y], filled_end);
+    }
+    for (int i = 0; i < GEOMETRY_TABLE_COUNT; i++) {
+        for (int y = 0; y <= old_maximum; y++) {
+            memcpy(tables[i] + (size_t) y * (new_maximum + 1), geometry->offset_tables[i] + (size_t) y * (old_maximum + 1),
+                   atomic_load(&row_ends[y]) * sizeof(double));
+        }
+    }
+    replace_geometry_tables(geometry, geometry->offset_tables, (const double * const *) tables,
+                            &geometry->offset_table_storage, ALLOCATED_TABLES);
+    free(geometry->offset_row_ends);
+    geometry->offset_row_ends = row_ends;
+    geometry->offset_table_maximum = new_maximum;
+    return 0;
+}
+
+/**
+ * Copies the radial tables into longer ones, whose new samples are filled on first use.
+ *
+ * Returns 0 if the memory could be allocated. Otherwise, the tables are left as they were.
+ */
+static inline int grow_radial_tables(CachedGeometry *geometry, const int new_size) {
+    const int old_size = geometry->radial_table_size;
+    const int old_chunk_count = get_radial_chunk_count(old_size);
+    const int new_chunk_count = get_radial_chunk_count(new_size);
+    double *tables[GEOMETRY_TABLE_COUNT];
+    atomic_int *chunk_ends = malloc(new_chunk_count * sizeof(atomic_int));
+    if (chunk_ends == NULL) {
+        return 1;
+    }
+    if (allocate_geometry_tables(tables, 0, new_size)) {
+        free(chunk_ends);
+        return 1;
+    }
+    for (int chunk = 0; chunk < new_chunk_count; chunk++) {
+        int filled_end = chunk * RADIAL_TABLE_CHUNK;
+        if (chunk < old_chunk_count) {
+            const int old_end = (chunk + 1) * RADIAL_TABLE_CHUNK < old_size ? (chunk + 1) * RADIAL_TABLE_CHUNK : old_size;
+            filled_end = geometry->radial_chunk_ends == NULL ? old_end : atomic_load(&geometry->radial_chunk_ends[chunk]);
         }
+        atomic_init(&chunk_ends[chunk], filled_end);
+    }
+    for (int i = 0; i < GEOMETRY_TABLE_COUNT; i++) {
+        // Samples which were not filled yet are copied too, but they are filled before they are read.
+        memcpy(tables[i], geometry->radial_tables[i], old_size * sizeof(double));
+    }
+    replace_geometry_tables(geometry, geometry->radial_tables, (const double * const *) tables,
+                            &geometry->radial_table_storage, ALLOCATED_TABLES);
+    free(geometry->radial_chunk_ends);
+    geometry->radial_chunk_ends = chunk_ends;
+    geometry->radial_table_size = new_size;
+    return 0;
+}
+
+/**
+ * Rounds an offset up to the whole chunks the caches grow in, up to MAXIMUM_CACHED_GEOMETRY_OFFSET.
+ */
+static inline int round_cached_geometry_maximum(int maximum) {
+    maximum = (maximum + CACHED_GEOMETRY_CHUNK - 1) / CACHED_GEOMETRY_CHUNK * CACHED_GEOMETRY_CHUNK;
+    return maximum < MAXIMUM_CACHED_GEOMETRY_OFFSET ? maximum : MAXIMUM_CACHED_GEOMETRY_OFFSET;
+}
+
+/**
+ * Returns the offset covered by the two-dimensional caches when the caches cover the maximum.
+ */
+static inline int get_two_dimensional_cache_maximum(const int maximum) {
+    const int budget_maximum = (int) sqrt(CACHED_GEOMETRY_BUDGET / (GEOMETRY_TABLE_COUNT * sizeof(double))) - 1;
+    return maximum < budget_maximum ? maximum : budget_maximum;
+}
+
+/**
+ * Grows the caches to cover the offsets up to the maximum along each axis, if they do not already.
+ *
+ * The caches grow in whole chunks, up to MAXIMUM_CACHED_GEOMETRY_OFFSET, and the
+ * two-dimensional caches only up to the CACHED_GEOMETRY_BUDGET. The values which
+ * were already computed are kept. No other thread may use the caches meanwhile.
+ *
+ * Returns 0 if the memory could be allocated.
+ */
+static inline int grow_cached_geometry(CachedGeometry *geometry, int maximum) {
+    if (maximum <= geometry->maximum) {
+        return 0;
+    }
+    maximum = round_cached_geometry_maximum(maximum);
+    const int cache_maximum = get_two_dimensional_cache_maximum(maximum);
+    int failed = 0;
+    if (cache_maximum > geometry->offset_table_maximum) {
+        failed = grow_two_dimensional_caches(geometry, cache_maximum);
+    }
+    const int table_size = RADIAL_TABLE_SIZE(maximum);
+    if (table_size > geometry->radial_table_size) {
+        failed = grow_radial_tables(geometry, table_size) || failed;
+    }
+    if (failed) {
+        return 1;
+    }
+    geometry->maximum = maximum;
+    return 0;
+}
+
+/**
+ * Makes the caches use generated or mapped tables with their dimensions.
+ */
+static inline void use_geometry_tables(CachedGeometry *geometry, const double * const offset_tables[GEOMETRY_TABLE_COUNT],
+                                       const double * const radial_tables[GEOMETRY_TABLE_COUNT], const TableStorage storage,
+                                       const int maximum, const int cache_maximum, const int table_size) {
+    replace_geometry_tables(geometry, geometry->offset_tables, offset_tables, &geometry->offset_table_storage, storage);
+    replace_geometry_tables(geometry, geometry->radial_tables, radial_tables, &geometry->radial_table_storage, storage);
+    free(geometry->offset_row_ends);
+    free(geometry->radial_chunk_ends);
+    geometry->offset_row_ends = NULL;
+    geometry->radial_chunk_ends = NULL;
+    geometry->maximum = maximum;
+    geometry->offset_table_maximum = cache_maximum;
+    geometry->radial_table_size = table_size;
+}
+
+/**
+ * Makes the caches use the tables generated at build time, next to allocated tables of the same size filled on first use.
+ *
+ * Returns 0 if the memory could be allocated. Otherwise, the caches are left as they were.
+ */
+static inline int use_generated_geometry_tables(CachedGeometry *geometry) {
+    double *offset_tables[GEOMETRY_TABLE_COUNT];
+    double *radial_tables[GEOMETRY_TABLE_COUNT];
+    const int chunk_count = get_radial_chunk_count(GENERATED_RADIAL_TABLE_SIZE);
+    atomic_int *row_ends = malloc((GENERATED_TABLES_MAXIMUM + 1) * sizeof(atomic_int));
+    atomic_int *chunk_ends = malloc(chunk_count * sizeof(atomic_int));
+    if (row_ends == NULL || chunk_ends == NULL) {
+        free(row_ends);
+        free(chunk_ends);
+        return 1;
+    }
+    if (allocate_geometry_tables(offset_tables, GENERATED_TABLE_COUNT, GENERATED_OFFSET_TABLE_SIZE)) {
+        free(row_ends);
+        free(chunk_ends);
+        return 1;
+    }
+    if (allocate_geometry_tables(radial_tables, GENERATED_TABLE_COUNT, GENERATED_RADIAL_TABLE_SIZE)) {
+        for (int i = GENERATED_TABLE_COUNT; i < GEOMETRY_TABLE_COUNT; i++) {
+            free(offset_tables[i]);
+        }
+        free(row_ends);
+        free(chunk_ends);
+        return 1;
+    }
+    for (int i = 0; i < GENERATED_TABLE_COUNT; i++) {
+        offset_tables[i] = (double *) GENERATED_OFFSET_TABLES[i];
+        radial_tables[i] = (double *) GENERATED_RADIAL_TABLES[i];
+    }
+    for (int y = 0; y <= GENERATED_TABLES_MAXIMUM; y++) {
+        atomic_init(&row_ends[y], 0);
+    }
+    for (int chunk = 0; chunk < chunk_count; chunk++) {
+        atomic_init(&chunk_ends[chunk], chunk * RADIAL_TABLE_CHUNK);
+    }
+    use_geometry_tables(geometry, (const double * const *) offset_tables, (const double * const *) radial_tables,
+                        GENERATED_TABLES, GENERATED_TABLES_MAXIMUM, GENERATED_TABLES_MAXIMUM, GENERATED_RADIAL_TABLE_SIZE);
+    geometry->offset_row_ends = row_ends;
+    geometry->radial_chunk_ends = chunk_ends;
+    return 0;
+}
+
+/**
+ * Writes the path of the persistent file of the caches which cover the maximum.
+ *
+ * Returns 0 if the caches are persisted and the path fits.
+ */
+static inline int get_geometry_cache_path(const CachedGeometry * const geometry, char *path, const size_t size,
+                                          const int maximum) {
+    if (geometry->directory == NULL) {
+        return 1;
+    }
+    const int length = snprintf(path, size, "%s/geometry-%d-v%d.cache", geometry->directory, maximum, GEOMETRY_CACHE_FILE_VERSION);
+    return length < 0 || (size_t) length >= size;
+}
+
+/**
+ * Makes the caches use the persistent file which covers the maximum, if there is a valid one.
+ *
+ * The file must also agree with the generated tables and with the first row of
+ * the others as evaluated by this build, so that files written by builds which
+ * evaluated the tables in other ways are not used. Returns 0 if the file was mapped.
+ */
+static inline int map_cached_geometry(CachedGeometry *geometry, const int maximum) {
+    char path[4096];
+    if (get_geometry_cache_path(geometry, path, sizeof(path), maximum)) {
+        return 1;
+    }
+    const int cache_maximum = get_two_dimensional_cache_maximum(maximum);
+    const GeometryCacheHeader expected = make_geometry_cache_header(maximum, cache_maximum, RADIAL_TABLE_SIZE(maximum));
+    const double *offset_tables[GEOMETRY_TABLE_COUNT];
+    const double *radial_tables[GEOMETRY_TABLE_COUNT];
+    size_t mapping_size;
+    void *mapping = map_geometry_cache_file(path, &expected, &mapping_size, offset_tables, radial_tables);
+    if (mapping == NULL) {
+        return 1;
+    }
+    int agrees = 1;
+    for (int i = 0; i < GENERATED_TABLE_COUNT && agrees; i++) {
+        const size_t row_size = (GENERATED_TABLES_MAXIMUM + 1) * sizeof(double);
+        const size_t radial_size = GENERATED_RADIAL_TABLE_SIZE * sizeof(double);
+        agrees = memcmp(offset_tables[i], GENERATED_OFFSET_TABLES[i], row_size) == 0 &&
+                 memcmp(radial_tables[i], GENERATED_RADIAL_TABLES[i], radial_size) == 0;
+    }
+    for (int i = GENERATED_TABLE_COUNT; i < GEOMETRY_TABLE_COUNT && agrees; i++) {
+        for (int x = 0; x <= GENERATED_TABLES_MAXIMUM && agrees; x++) {
+            agrees = offset_tables[i][x] == evaluate_geometry_table(i, distance_to_origin(x, 0));
+        }
+    }
+    if (!agrees) {
+        munmap(mapping, mapping_size);
+        return 1;
+    }
+    // The modification time records the last use, so that this file is the last to be pruned.
+    utimensat(AT_FDCWD, path, NULL, 0);
+    void *previous_mapping = geometry->mapping;
+    const size_t previous_mapping_size = geometry->mapping_size;
+    geometry->mapping = mapping;
+    geometry->mapping_size = mapping_size;
+    use_geometry_tables(geometry, offset_tables, radial_tables, MAPPED_TABLES, maximum, cache_maximum, RADIAL_TABLE_SIZE(maximum));
+    if (previous_mapping != NULL) {
+        munmap(previous_mapping, previous_mapping_size);
+    }
+    return 0;
+}
+
+/**
+ * Writes the caches to their persistent file.
+ *
+ * Returns 0 if the file was written.
+ */
+static inline int persist_cached_geometry(const CachedGeometry * const geometry) {
+    char path[4096];
+    if (get_geometry_cache_path(geometry, path, sizeof(path), geometry->maximum)) {
+        return 1;
+    }
+    const GeometryCacheHeader header = make_geometry_cache_header(geometry->maximum, geometry->offset_table_maximum,
+                                                                  geometry->radial_table_size);
+    return write_geometry_cache_file(path, header, geometry->offset_tables, geometry->radial_tables);
+}
+
+/**
+ * A persistent file of the caches found in their directory.
+ */
+typedef struct GeometryCacheFile {
+    char path[4096];
+    time_t modification_time;
+} GeometryCacheFile;
+
+static inline int compare_geometry_cache_files(const void *a, const void *b) {
+    const time_t first = ((const GeometryCacheFile *) a)->modification_time;
+    const time_t second = ((const GeometryCacheFile *) b)->modification_time;
+    // The most recent files come first.
+    return (first < second) - (first > second);
+}
+
+/**
+ * Removes the persistent files of other versions and all but the GEOMETRY_CACHE_FILE_LIMIT most recently used ones.
+ *
+ * Engines and processes which mapped a removed file keep using it until they unmap it.
+ */
+static inline void prune_persisted_geometry(const CachedGeometry * const geometry) {
+    DIR *directory = geometry->directory != NULL ? opendir(geometry->directory) : NULL;
+    if (directory == NULL) {
+        return;
+    }
+    GeometryCacheFile *files = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        int maximum;
+        int version;
+        int length = 0;
+        if (sscanf(entry->d_name, "geometry-%d-v%d.cache%n", &maximum, &version, &length) != 2 || length == 0 ||
+                entry->d_name[length] != '\0') {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity == 0 ? GEOMETRY_CACHE_FILE_LIMIT * 2 : capacity * 2;
+            GeometryCacheFile *grown = realloc(files, capacity * sizeof(GeometryCacheFile));
+            if (grown == NULL) {
+                break;
+            }
+            files = grown;
+        }
+        GeometryCacheFile *file = &files[count];
+        struct stat status;
+        const int path_length = snprintf(file->path, sizeof(file->path), "%s/%s", geometry->directory, entry->d_name);
+        if (path_length < 0 || (size_t) path_length >= sizeof(file->path) || stat(file->path, &status) != 0) {
+            continue;
+        }
+        if (version != GEOMETRY_CACHE_FILE_VERSION) {
+            remove(file->path);
+            continue;
+        }
+        file->modification_time = status.st_mtime;
+        count++;
+    }
+    closedir(directory);
+    if (count > GEOMETRY_CACHE_FILE_LIMIT) {
+        qsort(files, count, sizeof(GeometryCacheFile), compare_geometry_cache_files);
+        for (size_t i = GEOMETRY_CACHE_FILE_LIMIT; i < count; i++) {
+            remove(files[i].path);
+        }
+    }
+    free(files);
+}
+
+/**
+ * Creates the caches of the cached geometric utilities.
+ *
+ * The caches start from the tables generated at build time and grow to cover
+ * the offsets up to the maximum along each axis, or up to the
+ * CACHED_GEOMETRY_BUDGET for the two-dimensional caches. They grow later through
+ * grow_cached_geometry.
+ *
+ * If the directory is not NULL, caches larger than the generated tables are
+ * mapped from their persistent file there if there is one, and are otherwise
+ * evaluated and then persisted and mapped, pruning the least recently used
+ * files of the directory. If the memory could not be allocated,
+ * the caches only cover the offsets of the generated tables.
+ *
+ * Returns NULL if the CachedGeometry could not be allocated.
+ */
+static inline CachedGeometry *create_cached_geometry(const char *directory, int maximum) {
+    CachedGeometry *geometry = malloc(sizeof(CachedGeometry));
+    if (geometry == NULL) {
+        return NULL;
+    }
+    // There are no tables to free yet.
+    for (int i = 0; i < GEOMETRY_TABLE_COUNT; i++) {
+        geometry->offset_tables[i] = NULL;
+        geometry->radial_tables[i] = NULL;
+    }
+    geometry->offset_table_storage = ALLOCATED_TABLES;
+    geometry->radial_table_storage = ALLOCATED_TABLES;
+    geometry->mapping = NULL;
+    geometry->mapping_size = 0;
+    geometry->offset_row_ends = NULL;
+    geometry->radial_chunk_ends = NULL;
+    geometry->directory = directory != NULL ? strdup(directory) : NULL;
+    if (use_generated_geometry_tables(geometry)) {
+        free(geometry->directory);
+        free(geometry);
+        return NULL;
+    }
+    if (maximum <= GENERATED_TABLES_MAXIMUM || geometry->directory == NULL) {
+        grow_cached_geometry(geometry, maximum);
+        return geometry;
+    }
+    maximum = round_cached_geometry_maximum(maximum);
+    if (map_cached_geometry(geometry, maximum) == 0 || grow_cached_geometry(geometry, maximum)) {
+        return geometry;
+    }
+    warm_cached_geometry(geometry, NULL);
+    // Mapping the file just written shares its pages with the engines and processes which map it later.
+    if (persist_cached_geometry(geometry) == 0) {
+        map_cached_geometry(geometry, maximum);
+        prune_persisted_geometry(geometry);
     }
+    return geometry;
 }
 
 /**
- * A function that must be called in order to initialize the caches of the
- * cached geometric utilities.
+ * Releases the CachedGeometry, which no thread may be using.
  */
-void init_cached_geometry() {
-    init_sin_of_distance();
+static inline void delete_cached_geometry(CachedGeometry *geometry) {
+    const double * const none[GEOMETRY_TABLE_COUNT] = {NULL};
+    replace_geometry_tables(geometry, geometry->offset_tables, none, &geometry->offset_table_storage, ALLOCATED_TABLES);
+    replace_geometry_tables(geometry, geometry->radial_tables, none, &geometry->radial_table_storage, ALLOCATED_TABLES);
+    free(geometry->offset_row_ends);
+    free(geometry->radial_chunk_ends);
+    free(geometry->directory);
+    free(geometry);
 }
@@ -0,0 +1,252 @@
+// A quadtree of sources with far-field expansions of their waves.
+//
+// Far from a cluster of sources with the same wave number k, the sum of their
+// waves (1 + sin(k r)) / 2 is approximated by the wave of the cluster center
+// modulated by a complex amplitude which depends only on the direction. The
+// expansion is built for the center of a tile, including the Fresnel term of
+// the distance, and corrected to first order for the direction of each pixel.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <complex.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "geometry.h"
+
+/**
+ * Nodes with at most this many sources are not split.
+ */
+#define CLUSTER_TREE_LEAF_SIZE 8
+
+typedef struct ClusterNode {
+    int center_x; // The center is a pixel so that offsets from it to pixels are integers.
+    int center_y;
+    double radius; // The maximum distance from the center to a source of the node.
+    double amplitude; // The sum of the amplitudes of the sources of the node.
+    size_t first; // The sources of the node are [first, first + count) in the order of the tree.
+    size_t count;
+    long children[4]; // The indices of the children, or -1.
+} ClusterNode;
+
+typedef struct ClusterTree {
+    ClusterNode *nodes; // The root is the first node.
+    size_t node_count;
+    size_t node_capacity;
+    size_t source_count;
+    size_t *order; // The source indices in the order of the tree.
+    double *x; // The sources, in the order of the tree.
+    double *y;
+    double *amplitude;
+} ClusterTree;
+
+/**
+ * The far-field expansion of a cluster for a target region.
+ */
+typedef struct FarField {
+    double direction_x; // The direction from the center of the cluster to the center of the region.
+    double direction_y;
+    double complex s; // The complex amplitude in the direction of the center of the region.
+    double complex s_x; // The derivatives of the complex amplitude with respect to the direction.
+    double complex s_y;
+    double amplitude;
+} FarField;
+
+static inline size_t add_cluster_node(ClusterTree *tree, size_t first, size_t count) {
+    if (tree->node_count == tree->node_capacity) {
+        tree->node_capacity = tree->node_capacity == 0 ? 16 : 2 * tree->node_capacity;
+        tree->nodes = realloc(tree->nodes, tree->node_capacity * sizeof(ClusterNode));
+    }
+    ClusterNode *node = &tree->nodes[tree->node_count];
+    node->first = first;
+    node->count = count;
+    for (int i = 0; i < 4; i++) {
+        node->children[i] = -1;
+    }
+    return tree->node_count++;
+}
+
+/**
+ * Moves the sources of the range for which the predicate holds to its beginning.
+ *
+ * Returns the number of such sources.
+ */
+static inline size_t partition_cluster_sources(ClusterTree *tree, size_t first, size_t count, int by_y, double split) {
+    size_t boundary = first;
+    for (size_t i = first; i < first + count; i++) {
+        const double coordinate = by_y ? tree->y[i] : tree->x[i];
+        if (coordinate < split) {
+            size_t index = tree->order[i];
+            tree->order[i] = tree->order[boundary];
+            tree->order[boundary] = index;
+            double x = tree->x[i];
+            tree->x[i] = tree->x[boundary];
+            tree->x[boundary] = x;
+            double y = tree->y[i];
+            tree->y[i] = tree->y[boundary];
+            tree->y[boundary] = y;
+            double amplitude = tree->amplitude[i];
+            tree->amplitude[i] = tree->amplitude[boundary];
+            tree->amplitude[boundary] = amplitude;
+            boundary++;
+        }
+    }
+    return boundary - first;
+}
+
+static inline void build_cluster_node(ClusterTree *tree, size_t node_index) {
+    const size_t first = tree->nodes[node_index].first;
+    const size_t count = tree->nodes[node_index].count;
+    double left = tree->x[first];
+    double right = left;
+    double top = tree->y[first];
+    double bottom = top;
+    double amplitude = 0.0;
+    for (size_t i = first; i < first + count; i++) {
+        left = tree->x[i] < left ? tree->x[i] : left;
+        right = tree->x[i] > right ? tree->x[i] : right;
+        top = tree->y[i] < top ? tree->y[i] : top;
+        bottom = tree->y[i] > bottom ? tree->y[i] : bottom;
+        amplitude += tree->amplitude[i];
+    }
+    const int center_x = (int) floor((left + right) / 2.0);
+    const int center_y = (int) floor((top + bottom) / 2.0);
+    double radius = 0.0;
+    for (size_t i = first; i < first + count; i++) {
+        radius = maximum(radius, distance(center_x, center_y, tree->x[i], tree->y[i]));
+    }
+    ClusterNode *node = &tree->nodes[node_index];
+    node->center_x = center_x;
+    node->center_y = center_y;
+    node->radius = radius;
+    node->amplitude = amplitude;
+    if (count <= CLUSTER_TREE_LEAF_SIZE || (left == right && top == bottom)) {
+        return;
+    }
+    // Split the range into quadrants, in the order of the children. The bounds are distinct along at least one axis.
+    const double split_x = left < right ? (left + right) / 2.0 : INFINITY;
+    const double split_y = top < bottom ? (top + bottom) / 2.0 : INFINITY;
+    const size_t west = partition_cluster_sources(tree, first, count, 0, split_x);
+    const size_t north_west = partition_cluster_sources(tree, first, west, 1, split_y);
+    const size_t north_east = partition_cluster_sources(tree, first + west, count - west, 1, split_y);
+    const size_t starts[4] = {first, first + north_west, first + west, first + west + north_east};
+    const size_t counts[4] = {north_west, west - north_west, north_east, count - west - north_east};
+    for (int i = 0; i < 4; i++) {
+        if (counts[i] > 0) {
+            const size_t child = add_cluster_node(tree, starts[i], counts[i]);
+            // Adding nodes may move the array, so the node is indexed again.
+            tree->nodes[node_index].children[i] = (long) child;
+            build_cluster_node(tree, child);
+        }
+    }
+}
+
+/**
+ * Builds a ClusterTree over count sources, which must be at least one.
+ */
+static inline ClusterTree *build_cluster_tree(const double *x, const double *y, const double *amplitude, const size_t *indices, size_t count) {
+    ClusterTree *tree = malloc(sizeof(ClusterTree));
+    tree->nodes = NULL;
+    tree->node_count = 0;
+    tree->node_capacity = 0;
+    tree->source_count = count;
+    tree->order = malloc(count * sizeof(size_t));
+    tree->x = malloc(count * sizeof(double));
+    tree->y = malloc(count * sizeof(double));
+    tree->amplitude = malloc(count * sizeof(double));
+    for (size_t i = 0; i < count; i++) {
+        tree->order[i] = indices[i];
+        tree->x[i] = x[indices[i]];
+        tree->y[i] = y[indices[i]];
+        tree->amplitude[i] = amplitude[indices[i]];
+    }
+    build_cluster_node(tree, add_cluster_node(tree, 0, count));
+    return tree;
+}
+
+static inline void delete_cluster_tree(ClusterTree *tree) {
+    free(tree->nodes);
+    free(tree->order);
+    free(tree->x);
+    free(tree->y);
+    free(tree->amplitude);
+    free(tree);
+}
+
+static inline int is_cluster_leaf(const ClusterNode * const node) {
+    for (int i = 0; i < 4; i++) {
+        if (node->children[i] != -1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Bounds the relative error of the far-field expansion of the node.
+ *
+ * The expansion is built for a region whose points are at least nearest_distance
+ * from the center of the node and at most half_extent from the point the
+ * expansion is built for. The error of the sum of the waves is at most the
+ * amplitude of the node times the returned value.
+ */
+static inline double far_field_error_bound(const ClusterNode * const node, double wave_number, double nearest_distance, double half_extent) {
+    const double radius = node->radius;
+    if (nearest_distance <= 2.0 * radius) {
+        return INFINITY;
+    }
+    // The neglected terms of the distance, plus the Fresnel term evaluated at the center of the region.
+    const double distance_error = square(radius) * radius / (2.0 * square(nearest_distance - radius)) +
+                                  2.0 * square(radius) * half_extent / square(nearest_distance);
+    // The second order term of the expansion in the direction.
+    const double direction_error = 2.0 * square(wave_number * radius * half_extent / nearest_distance);
+    return (wave_number * distance_error + direction_error) / 2.0;
+}
+
+/**
+ * Builds the far-field expansion of the node for the region around the target.
+ */
+static inline void compute_far_field(const ClusterTree * const tree, const ClusterNode * const node, double wave_number,
+                                     double target_x, double target_y, FarField *far_field) {
+    const double offset_x = target_x - node->center_x;
+    const double offset_y = target_y - node->center_y;
+    const double target_distance = sqrt(square(offset_x) + square(offset_y));
+    const double direction_x = offset_x / target_distance;
+    const double direction_y = offset_y / target_distance;
+    double complex s = 0.0;
+    double complex s_x = 0.0;
+    double complex s_y = 0.0;
+    for (size_t i = node->first; i < node->first + node->count; i++) {
+        const double dx = tree->x[i] - node->center_x;
+        const double dy = tree->y[i] - node->center_y;
+        const double projection = direction_x * dx + direction_y * dy;
+        const double fresnel = (square(dx) + square(dy) - square(projection)) / (2.0 * target_distance);
+        const double phase = wave_number * (fresnel - projection);
+        const double complex term = tree->amplitude[i] * (cos(phase) + I * sin(phase));
+        s += term;
+        s_x += -I * wave_number * dx * term;
+        s_y += -I * wave_number * dy * term;
+    }
+    far_field->direction_x = direction_x;
+    far_field->direction_y = direction_y;
+    far_field->s = s;
+    far_field->s_x = s_x;
+    far_field->s_y = s_y;
+    far_field->amplitude = node->amplitude;
+}
+
+/**
+ * Evaluates the sum of the waves (1 + sin(k r)) / 2 of a cluster, weighted by amplitude, at an offset from its center.
+ */
+static inline double evaluate_far_field(const FarField * const far_field, double wave_number, double dx, double dy) {
+    const double distance_to_center = sqrt(square(dx) + square(dy));
+    const double delta_x = dx / distance_to_center - far_field->direction_x;
+    const double delta_y = dy / distance_to_center - far_field->direction_y;
+    const double complex s = far_field->s + far_field->s_x * delta_x + far_field->s_y * delta_y;
+    const double phase = wave_number * distance_to_center;
+    // The imaginary part of exp(i * phase) * s.
+    const double oscillation = sin(phase) * creal(s) + cos(phase) * cimag(s);
+    return (far_field->amplitude + oscillation) / 2.0;
+}
@@ -0,0 +1,159 @@
+// The dissipation models of the waves.
+//
+// Each model is a radial attenuation function: the factor by which a wave is
+// multiplied at a given distance from its oscillator. Adding a model only
+// requires a new DissipationModel value and its entry in ATTENUATION_FUNCTIONS.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <math.h>
+
+#include "geometry.h"
+
+/**
+ * The distance from the oscillator at which dissipation starts.
+ */
+#define DISSIPATION_START 10.0
+
+/**
+ * The distance over which the exponential model attenuates a wave by a factor of e.
+ */
+#define EXPONENTIAL_DISSIPATION_LENGTH 100.0
+
+/**
+ * The standard deviation of the Gaussian model.
+ */
+#define GAUSSIAN_DISSIPATION_DEVIATION 150.0
+
+typedef enum DissipationModel {
+    NO_DISSIPATION,
+    INVERSE_LINEAR_DISSIPATION,
+    INVERSE_SQUARE_DISSIPATION,
+    EXPONENTIAL_DISSIPATION,
+    GAUSSIAN_DISSIPATION,
+    NUMBER_OF_DISSIPATION_MODELS // Helper value
+} DissipationModel;
+
+typedef double (*AttenuationFunction)(double distance);
+
+static inline double no_attenuation(double distance) {
+    (void) distance;
+    return 1.0;
+}
+
+static inline double inverse_linear_attenuation(double distance) {
+    return DISSIPATION_START / maximum(DISSIPATION_START, distance);
+}
+
+static inline double inverse_square_attenuation(double distance) {
+    return DISSIPATION_START / square(maximum(DISSIPATION_START, distance)); // No need to ensure positiveness.
+}
+
+static inline double exponential_attenuation(double distance) {
+    return exp(-(maximum(DISSIPATION_START, distance) - DISSIPATION_START) / EXPONENTIAL_DISSIPATION_LENGTH);
+}
+
+static inline double gaussian_attenuation(double distance) {
+    const double excess = maximum(DISSIPATION_START, distance) - DISSIPATION_START;
+    return exp(-square(excess) / (2.0 * square(GAUSSIAN_DISSIPATION_DEVIATION)));
+}
+
+/**
+ * The attenuation function of each DissipationModel, indexed by the model.
+ */
+static const AttenuationFunction ATTENUATION_FUNCTIONS[NUMBER_OF_DISSIPATION_MODELS] = {
+    no_attenuation,
+    inverse_linear_attenuation,
+    inverse_square_attenuation,
+    exponential_attenuation,
+    gaussian_attenuation
+};
+
+/**
+ * Evaluates the attenuation of a DissipationModel at a distance from the oscillator.
+ */
+static inline double attenuation(DissipationModel model, double distance) {
+    return ATTENUATION_FUNCTIONS[model](distance);
+}
+
+/**
+ * Returns a rate which bounds the derivatives of the attenuation of the model at a distance beyond DISSIPATION_START.
+ *
+ * The first four derivatives satisfy |d^n attenuation / dr^n| <= attenuation * rate^n.
+ * Only the Gaussian rate grows with the distance.
+ */
+static inline double attenuation_rate(DissipationModel model, double distance) {
+    if (model == INVERSE_LINEAR_DISSIPATION) {
+        // The derivatives of 1 / r are n! / r^n times it, and n! <= 3^n.
+        return 3.0 / distance;
+    } else if (model == INVERSE_SQUARE_DISSIPATION) {
+        // The derivatives of 1 / r^2 are (n + 1)! / r^n times it, and (n + 1)! <= 4^n.
+        return 4.0 / distance;
+    } else if (model == EXPONENTIAL_DISSIPATION) {
+        return 1.0 / EXPONENTIAL_DISSIPATION_LENGTH;
+    } else if (model == GAUSSIAN_DISSIPATION) {
+        // The derivatives are Hermite polynomials of x = excess / deviation, and |He_n(x)| <= (x + sqrt(3))^n.
+        const double excess = maximum(DISSIPATION_START, distance) - DISSIPATION_START;
+        return (excess + sqrt(3.0) * GAUSSIAN_DISSIPATION_DEVIATION) / square(GAUSSIAN_DISSIPATION_DEVIATION);
+    } else {
+        return 0.0;
+    }
+}
+
+/**
+ * Beyond this distance, a cutoff radius is considered to be infinite.
+ */
+#define MAXIMUM_CUTOFF_RADIUS 1048576.0
+
+/**
+ * Returns a distance beyond which the attenuation of the model is at most the threshold.
+ *
+ * All attenuation functions are non-increasing, so the wave can be ignored
+ * beyond this distance with an error of at most the threshold times its
+ * amplitude. Returns INFINITY if the model never attenuates that much.
+ */
+static inline double cutoff_radius(DissipationModel model, double threshold) {
+    if (threshold <= 0.0) {
+        return INFINITY;
+    }
+    double low = 0.0;
+    double high = DISSIPATION_START;
+    while (attenuation(model, high) > threshold) {
+        if (high > MAXIMUM_CUTOFF_RADIUS) {
+            return INFINITY;
+        }
+        low = high;
+        high *= 2.0;
+    }
+    // Bisect until the radius is within a pixel, always keeping the attenuation at high below the threshold.
+    while (high - low > 0.5) {
+        const double middle = (low + high) / 2.0;
+        if (attenuation(model, middle) > threshold) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return high;
+}
+
+/**
+ * Returns a human-readable string for a DissipationModel value.
+ */
+static inline char *dissipation_model_to_string(DissipationModel model) {
+    if (model == NO_DISSIPATION) {
+        return "no dissipation";
+    } else if (model == INVERSE_LINEAR_DISSIPATION) {
+        return "inverse linear";
+    } else if (model == INVERSE_SQUARE_DISSIPATION) {
+        return "inverse square";
+    } else if (model == EXPONENTIAL_DISSIPATION) {
+        return "exponential";
+    } else if (model == GAUSSIAN_DISSIPATION) {
+        return "Gaussian";
+    } else {
+        return "unknown";
+    }
+}
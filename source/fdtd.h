@@ -0,0 +1,261 @@
+// A finite-difference time-domain integrator of the two-dimensional wave equation.
+//
+// The field is stepped with the explicit second-order stencil
+//
+//     next = 2 * current - previous + C^2 * laplacian(current)
+//
+// where C is the Courant number, the distance traveled by a wave in one step
+// in cells. Absorbing layers along the edges damp outgoing waves, obstacles
+// hold the field at zero and therefore reflect waves, and the outermost cells
+// are fixed at zero. Each cell has precomputed gain and decay coefficients, so
+// the update of a row is a branchless loop over vectors of floats. Rows are
+// split into bands which are updated in parallel.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread-pool.h"
+
+/**
+ * Must be less than 1 / sqrt(2) for the simulation to be stable.
+ */
+#define FDTD_DEFAULT_COURANT_NUMBER 0.5
+
+/**
+ * The default width of the absorbing layers, in cells.
+ */
+#define FDTD_DEFAULT_ABSORBING_WIDTH 32
+
+/**
+ * The default damping of the outermost cells of the absorbing layers, per step.
+ */
+#define FDTD_DEFAULT_ABSORBING_STRENGTH 0.1
+
+/**
+ * The number of floats in an FDTDVector. Rows are padded to a multiple of it.
+ */
+#define FDTD_VECTOR_LENGTH 4
+
+/**
+ * The minimum number of rows in a band updated by a single task.
+ */
+#define FDTD_MINIMUM_BAND_HEIGHT 16
+
+typedef float FDTDVector __attribute__ ((vector_size (FDTD_VECTOR_LENGTH * sizeof(float))));
+
+typedef struct FDTDSimulation {
+    int width;
+    int height;
+    size_t stride; // The number of floats in a row, including a border cell on each side and padding.
+    float *current; // height + 2 rows, including a border row on each side.
+    float *previous;
+    float *gain; // The factor of the undamped update, zero at obstacles and at the border.
+    float *decay; // The factor of the previous value.
+    unsigned char *obstacles; // height rows of width cells, without the border.
+    double courant_number;
+    int absorbing_width;
+    double absorbing_strength;
+    unsigned long step_count;
+    ThreadPool *pool; // May be NULL, in which case steps run on the calling thread.
+} FDTDSimulation;
+
+/**
+ * Returns the index of the cell at the specified column and row, not counting the border.
+ */
+static inline size_t get_fdtd_cell(const FDTDSimulation * const simulation, int x, int y) {
+    return (size_t) (y + 1) * simulation->stride + (x + 1);
+}
+
+/**
+ * Returns the damping of a cell at the specified distance from the nearest edge.
+ */
+static inline double get_fdtd_damping(const FDTDSimulation * const simulation, int edge_distance) {
+    if (edge_distance >= simulation->absorbing_width) {
+        return 0.0;
+    }
+    // A quadratic profile reflects less than an abrupt one.
+    const double depth = (double) (simulation->absorbing_width - edge_distance) / simulation->absorbing_width;
+    return simulation->absorbing_strength * depth * depth;
+}
+
+/**
+ * Recomputes the coefficients of every cell from the obstacles and the absorbing layers.
+ */
+static inline void update_fdtd_coefficients(FDTDSimulation *simulation) {
+    const size_t size = (size_t) (simulation->height + 2) * simulation->stride;
+    memset(simulation->gain, 0, size * sizeof(float));
+    memset(simulation->decay, 0, size * sizeof(float));
+    for (int y = 0; y < simulation->height; y++) {
+        const int vertical_distance = y < simulation->height - 1 - y ? y : simulation->height - 1 - y;
+        for (int x = 0; x < simulation->width; x++) {
+            if (simulation->obstacles[(size_t) y * simulation->width + x]) {
+                continue;
+            }
+            const int horizontal_distance = x < simulation->width - 1 - x ? x : simulation->width - 1 - x;
+            const int edge_distance = horizontal_distance < vertical_distance ? horizontal_distance : vertical_distance;
+            // The damped equation is (1 + s) * next = 2 * current - (1 - s) * previous + C^2 * laplacian(current).
+            const double damping = get_fdtd_damping(simulation, edge_distance);
+            const size_t cell = get_fdtd_cell(simulation, x, y);
+            simulation->gain[cell] = (float) (1.0 / (1.0 + damping));
+            simulation->decay[cell] = (float) ((1.0 - damping) / (1.0 + damping));
+        }
+    }
+}
+
+static inline void clear_fdtd_field(FDTDSimulation *simulation) {
+    const size_t size = (size_t) (simulation->height + 2) * simulation->stride;
+    memset(simulation->current, 0, size * sizeof(float));
+    memset(simulation->previous, 0, size * sizeof(float));
+    simulation->step_count = 0;
+}
+
+static inline float *allocate_fdtd_grid(size_t size) {
+    // Aligned to the vectors, so that rows start at aligned addresses.
+    float *grid = aligned_alloc(sizeof(FDTDVector), size * sizeof(float));
+    if (grid != NULL) {
+        memset(grid, 0, size * sizeof(float));
+    }
+    return grid;
+}
+
+/**
+ * Creates an FDTDSimulation at rest, without obstacles and with the default absorbing layers.
+ */
+static inline FDTDSimulation *create_fdtd_simulation(int width, int height, ThreadPool *pool) {
+    FDTDSimulation *simulation = malloc(sizeof(FDTDSimulation));
+    simulation->width = width;
+    simulation->height = height;
+    simulation->stride = (width + 2 + FDTD_VECTOR_LENGTH - 1) / FDTD_VECTOR_LENGTH * FDTD_VECTOR_LENGTH;
+    const size_t size = (size_t) (height + 2) * simulation->stride;
+    simulation->current = allocate_fdtd_grid(size);
+    simulation->previous = allocate_fdtd_grid(size);
+    simulation->gain = allocate_fdtd_grid(size);
+    simulation->decay = allocate_fdtd_grid(size);
+    simulation->obstacles = calloc((size_t) width * height, sizeof(unsigned char));
+    simulation->courant_number = FDTD_DEFAULT_COURANT_NUMBER;
+    simulation->absorbing_width = FDTD_DEFAULT_ABSORBING_WIDTH;
+    simulation->absorbing_strength = FDTD_DEFAULT_ABSORBING_STRENGTH;
+    simulation->step_count = 0;
+    simulation->pool = pool;
+    update_fdtd_coefficients(simulation);
+    return simulation;
+}
+
+static inline void delete_fdtd_simulation(FDTDSimulation *simulation) {
+    free(simulation->current);
+    free(simulation->previous);
+    free(simulation->gain);
+    free(simulation->decay);
+    free(simulation->obstacles);
+    free(simulation);
+}
+
+/**
+ * Changes the absorbing layers. A width of zero makes the edges reflect waves.
+ */
+static inline void set_fdtd_absorbing_layers(FDTDSimulation *simulation, int width, double strength) {
+    simulation->absorbing_width = width;
+    simulation->absorbing_strength = strength;
+    update_fdtd_coefficients(simulation);
+}
+
+/**
+ * Marks or unmarks a cell as an obstacle. The coefficients must be updated afterwards.
+ */
+static inline void set_fdtd_obstacle(FDTDSimulation *simulation, int x, int y, int obstacle) {
+    if (x >= 0 && x < simulation->width && y >= 0 && y < simulation->height) {
+        simulation->obstacles[(size_t) y * simulation->width + x] = obstacle ? 1 : 0;
+    }
+}
+
+static inline int is_fdtd_obstacle(const FDTDSimulation * const simulation, int x, int y) {
+    return simulation->obstacles[(size_t) y * simulation->width + x];
+}
+
+/**
+ * Adds a value to the field at a cell, as a soft source does.
+ */
+static inline void add_to_fdtd_field(FDTDSimulation *simulation, int x, int y, float value) {
+    if (x >= 0 && x < simulation->width && y >= 0 && y < simulation->height) {
+        simulation->current[get_fdtd_cell(simulation, x, y)] += value;
+    }
+}
+
+static inline float get_fdtd_value(const FDTDSimulation * const simulation, int x, int y) {
+    return simulation->current[get_fdtd_cell(simulation, x, y)];
+}
+
+static inline FDTDVector load_fdtd_vector(const float *source) {
+    FDTDVector vector;
+    memcpy(&vector, source, sizeof(FDTDVector));
+    return vector;
+}
+
+/**
+ * Steps the rows in [begin, end), writing the next values over the previous ones.
+ */
+static inline void step_fdtd_rows(FDTDSimulation *simulation, int begin, int end) {
+    const size_t stride = simulation->stride;
+    const float courant_squared = (float) (simulation->courant_number * simulation->courant_number);
+    const FDTDVector two = {2.0f, 2.0f, 2.0f, 2.0f};
+    const FDTDVector four = {4.0f, 4.0f, 4.0f, 4.0f};
+    const FDTDVector c2 = {courant_squared, courant_squared, courant_squared, courant_squared};
+    for (int y = begin; y < end; y++) {
+        const size_t row = (size_t) (y + 1) * stride;
+        const float *current = simulation->current + row;
+        const float *above = current - stride;
+        const float *below = current + stride;
+        const float *gain = simulation->gain + row;
+        const float *decay = simulation->decay + row;
+        float *next = simulation->previous + row;
+        // The border and padding cells have zero gain, so they can be computed along with the others.
+        size_t x = 1;
+        for (; x + FDTD_VECTOR_LENGTH < stride; x += FDTD_VECTOR_LENGTH) {
+            const FDTDVector center = load_fdtd_vector(current + x);
+            const FDTDVector laplacian = load_fdtd_vector(current + x - 1) + load_fdtd_vector(current + x + 1) +
+                                         load_fdtd_vector(above + x) + load_fdtd_vector(below + x) - four * center;
+            const FDTDVector result = load_fdtd_vector(gain + x) * (two * center + c2 * laplacian) -
+                                      load_fdtd_vector(decay + x) * load_fdtd_vector(next + x);
+            memcpy(next + x, &result, sizeof(FDTDVector));
+        }
+        for (; x + 1 < stride; x++) {
+            const float laplacian = current[x - 1] + current[x + 1] + above[x] + below[x] - 4.0f * current[x];
+            next[x] = gain[x] * (2.0f * current[x] + courant_squared * laplacian) - decay[x] * next[x];
+        }
+    }
+}
+
+typedef struct FDTDBands {
+    FDTDSimulation *simulation;
+    int band_height;
+} FDTDBands;
+
+static inline void step_fdtd_band(void *context, size_t index) {
+    const FDTDBands *bands = context;
+    const int begin = (int) index * bands->band_height;
+    const int end = begin + bands->band_height < bands->simulation->height ? begin + bands->band_height : bands->simulation->height;
+    step_fdtd_rows(bands->simulation, begin, end);
+}
+
+/**
+ * Advances the simulation by one step, updating bands of rows in parallel.
+ */
+static inline void step_fdtd(FDTDSimulation *simulation) {
+    const size_t thread_count = simulation->pool == NULL ? 1 : simulation->pool->thread_count;
+    // A few bands per thread balance the load without making bands too thin.
+    int band_height = (int) ((simulation->height + 4 * thread_count - 1) / (4 * thread_count));
+    if (band_height < FDTD_MINIMUM_BAND_HEIGHT) {
+        band_height = FDTD_MINIMUM_BAND_HEIGHT;
+    }
+    FDTDBands bands = {simulation, band_height};
+    const size_t band_count = (simulation->height + band_height - 1) / band_height;
+    run_parallel(simulation->pool, step_fdtd_band, &bands, band_count);
+    float *next = simulation->previous;
+    simulation->previous = simulation->current;
+    simulation->current = next;
+    simulation->step_count++;
+}
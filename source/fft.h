@@ -0,0 +1,210 @@
+// A self-contained mixed-radix fast Fourier transform.
+//
+// Sizes are factored into radices 4, 2, 3, and 5, with any other prime factor
+// handled by a generic butterfly, so every size works but sizes returned by
+// next_fft_size() are the fastest. Plans are immutable, so a plan can be
+// shared by concurrent transforms as long as each one has its own buffers.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <complex.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+
+#define FFT_MAXIMUM_FACTORS 64
+
+/**
+ * Radices up to this value use a butterfly buffer on the stack.
+ */
+#define FFT_MAXIMUM_STACK_RADIX 16
+
+typedef struct FFTPlan {
+    size_t size;
+    size_t factors[FFT_MAXIMUM_FACTORS];
+    size_t factor_count;
+    double complex *twiddles; // exp(-i * TAU * k / size), for k in [0, size).
+} FFTPlan;
+
+/**
+ * Returns the smallest size not less than the minimum whose only prime factors are 2, 3, and 5.
+ */
+static inline size_t next_fft_size(size_t minimum_size) {
+    size_t size = minimum_size > 1 ? minimum_size : 1;
+    while (1) {
+        size_t remainder = size;
+        while (remainder % 2 == 0) {
+            remainder /= 2;
+        }
+        while (remainder % 3 == 0) {
+            remainder /= 3;
+        }
+        while (remainder % 5 == 0) {
+            remainder /= 5;
+        }
+        if (remainder == 1) {
+            return size;
+        }
+        size++;
+    }
+}
+
+/**
+ * Creates a plan for transforms of the specified size.
+ */
+static inline FFTPlan *create_fft_plan(size_t size) {
+    FFTPlan *plan = malloc(sizeof(FFTPlan));
+    plan->size = size;
+    plan->factor_count = 0;
+    size_t remainder = size;
+    const size_t preferred_radices[] = {4, 2, 3, 5};
+    for (size_t i = 0; i < 4; i++) {
+        while (remainder % preferred_radices[i] == 0 && remainder > 1) {
+            plan->factors[plan->factor_count++] = preferred_radices[i];
+            remainder /= preferred_radices[i];
+        }
+    }
+    for (size_t radix = 7; remainder > 1; radix += 2) {
+        while (remainder % radix == 0) {
+            plan->factors[plan->factor_count++] = radix;
+            remainder /= radix;
+        }
+    }
+    plan->twiddles = malloc(size * sizeof(double complex));
+    for (size_t k = 0; k < size; k++) {
+        const double angle = -TAU * k / size;
+        plan->twiddles[k] = cos(angle) + I * sin(angle);
+    }
+    return plan;
+}
+
+static inline void delete_fft_plan(FFTPlan *plan) {
+    free(plan->twiddles);
+    free(plan);
+}
+
+/**
+ * Returns the twiddle factor of the index, which must be less than the size of the plan.
+ */
+static inline double complex get_twiddle(const FFTPlan * const plan, size_t index, int inverse) {
+    const double complex twiddle = plan->twiddles[index];
+    return inverse ? conj(twiddle) : twiddle;
+}
+
+/**
+ * Combines radix sub-transforms of length m, stored one after the other in output, into one of length radix * m.
+ */
+static inline void fft_butterfly(const FFTPlan * const plan, double complex *output, size_t stride, size_t radix, size_t m, int inverse) {
+    if (radix == 2) {
+        for (size_t u = 0; u < m; u++) {
+            const double complex t = output[u + m] * get_twiddle(plan, u * stride, inverse);
+            output[u + m] = output[u] - t;
+            output[u] += t;
+        }
+        return;
+    }
+    if (radix == 4) {
+        // Multiplying by -i in the forward transform and by i in the inverse.
+        const double complex rotation = inverse ? I : -I;
+        for (size_t u = 0; u < m; u++) {
+            const double complex a0 = output[u];
+            const double complex a1 = output[u + m] * get_twiddle(plan, u * stride, inverse);
+            const double complex a2 = output[u + 2 * m] * get_twiddle(plan, 2 * u * stride, inverse);
+            const double complex a3 = output[u + 3 * m] * get_twiddle(plan, 3 * u * stride, inverse);
+            const double complex s0 = a0 + a2;
+            const double complex s1 = a0 - a2;
+            const double complex s2 = a1 + a3;
+            const double complex s3 = (a1 - a3) * rotation;
+            output[u] = s0 + s2;
+            output[u + m] = s1 + s3;
+            output[u + 2 * m] = s0 - s2;
+            output[u + 3 * m] = s1 - s3;
+        }
+        return;
+    }
+    double complex stack_buffer[FFT_MAXIMUM_STACK_RADIX];
+    double complex *buffer = radix <= FFT_MAXIMUM_STACK_RADIX ? stack_buffer : malloc(radix * sizeof(double complex));
+    const size_t size = plan->size;
+    for (size_t u = 0; u < m; u++) {
+        for (size_t q = 0; q < radix; q++) {
+            buffer[q] = output[u + q * m];
+        }
+        for (size_t q = 0; q < radix; q++) {
+            const size_t k = u + q * m;
+            // The twiddle exponent only matters modulo the size of the plan.
+            const size_t step = (stride * k) % size;
+            size_t index = 0;
+            double complex sum = buffer[0];
+            for (size_t r = 1; r < radix; r++) {
+                index += step;
+                if (index >= size) {
+                    index -= size;
+                }
+                sum += buffer[r] * get_twiddle(plan, index, inverse);
+            }
+            output[k] = sum;
+        }
+    }
+    if (buffer != stack_buffer) {
+        free(buffer);
+    }
+}
+
+static inline void fft_recursive(const FFTPlan * const plan, double complex *output, const double complex *input,
+                                 size_t stride, const size_t *factors, int inverse) {
+    const size_t radix = factors[0];
+    const size_t m = plan->size / (stride * radix);
+    if (m == 1) {
+        for (size_t q = 0; q < radix; q++) {
+            output[q] = input[q * stride];
+        }
+    } else {
+        for (size_t q = 0; q < radix; q++) {
+            fft_recursive(plan, output + q * m, input + q * stride, stride * radix, factors + 1, inverse);
+        }
+    }
+    fft_butterfly(plan, output, stride, radix, m, inverse);
+}
+
+/**
+ * Computes the discrete Fourier transform of input into output, which must not overlap.
+ *
+ * The inverse transform is not normalized, so a transform followed by its inverse multiplies the data by the size.
+ */
+static inline void fft(const FFTPlan * const plan, double complex *output, const double complex *input, int inverse) {
+    if (plan->size == 1) {
+        output[0] = input[0];
+        return;
+    }
+    fft_recursive(plan, output, input, 1, plan->factors, inverse);
+}
+
+/**
+ * Computes the two-dimensional transform of a row-major matrix in place.
+ *
+ * The buffer must hold at least the maximum of the width and the height times two elements.
+ */
+static inline void fft_2d(const FFTPlan * const row_plan, const FFTPlan * const column_plan, double complex *data, double complex *buffer, int inverse) {
+    const size_t width = row_plan->size;
+    const size_t height = column_plan->size;
+    const size_t length = width > height ? width : height;
+    double complex *line = buffer;
+    double complex *transformed = buffer + length;
+    for (size_t y = 0; y < height; y++) {
+        memcpy(line, data + y * width, width * sizeof(double complex));
+        fft(row_plan, data + y * width, line, inverse);
+    }
+    for (size_t x = 0; x < width; x++) {
+        for (size_t y = 0; y < height; y++) {
+            line[y] = data[y * width + x];
+        }
+        fft(column_plan, transformed, line, inverse);
+        for (size_t y = 0; y < height; y++) {
+            data[y * width + x] = transformed[y];
+        }
+    }
+}
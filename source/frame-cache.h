@@ -0,0 +1,154 @@
+// A bounded cache of finished frames, keyed by a hash of the state they show.
+//
+// Frames are kept in a list ordered from the most to the least recently used.
+// Storing a frame which does not fit the memory budget evicts the least
+// recently used frames until it does. The cache holds a few dozen frames at
+// most, so lookups simply walk the list.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The hash of an empty state, which the state is then folded into.
+ */
+#define FRAME_HASH_SEED 14695981039346656037ull
+
+typedef struct CachedFrame {
+    uint64_t key;
+    size_t size; // The number of pixels of the frame.
+    uint32_t *pixels;
+    struct CachedFrame *previous; // The more recently used frame, or NULL.
+    struct CachedFrame *next; // The less recently used frame, or NULL.
+} CachedFrame;
+
+typedef struct FrameCache {
+    size_t budget; // The maximum number of bytes used by the pixels of the frames.
+    size_t used;
+    size_t frame_count;
+    CachedFrame *first; // The most recently used frame.
+    CachedFrame *last; // The least recently used frame.
+} FrameCache;
+
+/**
+ * Folds the bytes of the data into the hash, using FNV-1a.
+ */
+static inline uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Creates an empty FrameCache whose frames use at most budget bytes.
+ */
+static inline FrameCache *create_frame_cache(size_t budget) {
+    FrameCache *cache = malloc(sizeof(FrameCache));
+    cache->budget = budget;
+    cache->used = 0;
+    cache->frame_count = 0;
+    cache->first = NULL;
+    cache->last = NULL;
+    return cache;
+}
+
+static inline void unlink_cached_frame(FrameCache *cache, CachedFrame *frame) {
+    if (frame->previous != NULL) {
+        frame->previous->next = frame->next;
+    } else {
+        cache->first = frame->next;
+    }
+    if (frame->next != NULL) {
+        frame->next->previous = frame->previous;
+    } else {
+        cache->last = frame->previous;
+    }
+}
+
+static inline void push_cached_frame(FrameCache *cache, CachedFrame *frame) {
+    frame->previous = NULL;
+    frame->next = cache->first;
+    if (cache->first != NULL) {
+        cache->first->previous = frame;
+    } else {
+        cache->last = frame;
+    }
+    cache->first = frame;
+}
+
+/**
+ * Removes the least recently used frame. The cache must not be empty.
+ */
+static inline void evict_cached_frame(FrameCache *cache) {
+    CachedFrame *frame = cache->last;
+    unlink_cached_frame(cache, frame);
+    cache->used -= frame->size * sizeof(uint32_t);
+    cache->frame_count--;
+    free(frame->pixels);
+    free(frame);
+}
+
+static inline void clear_frame_cache(FrameCache *cache) {
+    while (cache->last != NULL) {
+        evict_cached_frame(cache);
+    }
+}
+
+static inline void delete_frame_cache(FrameCache *cache) {
+    clear_frame_cache(cache);
+    free(cache);
+}
+
+/**
+ * Returns the pixels of the frame with the key and marks it as the most recently used, or returns NULL if there is none.
+ *
+ * The pixels are only valid until the next frame is stored.
+ */
+static inline const uint32_t *lookup_frame(FrameCache *cache, uint64_t key, size_t size) {
+    for (CachedFrame *frame = cache->first; frame != NULL; frame = frame->next) {
+        if (frame->key == key && frame->size == size) {
+            unlink_cached_frame(cache, frame);
+            push_cached_frame(cache, frame);
+            return frame->pixels;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Stores a copy of the pixels of a frame with the key, evicting the least recently used frames as needed.
+ *
+ * Frames larger than the budget are not stored. Returns 0 if the frame is in the cache afterwards.
+ */
+static inline int store_frame(FrameCache *cache, uint64_t key, const uint32_t *pixels, size_t size) {
+    const size_t bytes = size * sizeof(uint32_t);
+    if (lookup_frame(cache, key, size) != NULL) {
+        return 0;
+    }
+    if (bytes > cache->budget) {
+        return 1;
+    }
+    while (cache->used + bytes > cache->budget) {
+        evict_cached_frame(cache);
+    }
+    CachedFrame *frame = malloc(sizeof(CachedFrame));
+    frame->pixels = malloc(bytes);
+    if (frame->pixels == NULL) {
+        free(frame);
+        return 1;
+    }
+    memcpy(frame->pixels, pixels, bytes);
+    frame->key = key;
+    frame->size = size;
+    push_cached_frame(cache, frame);
+    cache->used += bytes;
+    cache->frame_count++;
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Generates the tables of the cached geometry at build time.
+//
+// The first GENERATED_TABLE_COUNT tables of each kind which cover the default
+// window are written as constant arrays to the C source file named by the only
+// argument, so that the library starts without evaluating them and every process
+// shares them read-only.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "geometry-tables.h"
+
+/**
+ * Writes a table as the initializer of one of the rows of an array.
+ *
+ * Hexadecimal floating-point literals preserve every bit of the values.
+ */
+int write_table(FILE *file, const double *table, const size_t size) {
+    if (fprintf(file, "{\n") < 0) {
+        return 1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (fprintf(file, "%a,\n", table[i]) < 0) {
+            return 1;
+        }
+    }
+    return fprintf(file, "},\n") < 0;
+}
+
+/**
+ * Writes the tables as a constant two-dimensional array with the name.
+ */
+int write_tables(FILE *file, const char *name, double * const tables[GENERATED_TABLE_COUNT], const size_t size) {
+    if (fprintf(file, "\nconst double %s[%d][%zu] = {\n", name, GENERATED_TABLE_COUNT, size) < 0) {
+        return 1;
+    }
+    for (int i = 0; i < GENERATED_TABLE_COUNT; i++) {
+        if (write_table(file, tables[i], size)) {
+            return 1;
+        }
+    }
+    return fprintf(file, "};\n") < 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("Usage: %s OUTPUT\n", argv[0]);
+        return 1;
+    }
+    double *offset_tables[GENERATED_TABLE_COUNT];
+    double *radial_tables[GENERATED_TABLE_COUNT];
+    for (int i = 0; i < GENERATED_TABLE_COUNT; i++) {
+        offset_tables[i] = malloc(GENERATED_OFFSET_TABLE_SIZE * sizeof(double));
+        radial_tables[i] = malloc(GENERATED_RADIAL_TABLE_SIZE * sizeof(double));
+        if (offset_tables[i] == NULL || radial_tables[i] == NULL) {
+            printf("Could not allocate the tables\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < GENERATED_TABLE_COUNT; i++) {
+        for (int y = 0; y <= GENERATED_TABLES_MAXIMUM; y++) {
+            for (int x = 0; x <= GENERATED_TABLES_MAXIMUM; x++) {
+                offset_tables[i][y * (GENERATED_TABLES_MAXIMUM + 1) + x] = evaluate_geometry_table(i, distance_to_origin(x, y));
+            }
+        }
+        for (int j = 0; j < GENERATED_RADIAL_TABLE_SIZE; j++) {
+            radial_tables[i][j] = evaluate_geometry_table(i, (double) j / RADIAL_TABLE_RESOLUTION);
+        }
+    }
+
+    FILE *file = fopen(argv[1], "w");
+    if (file == NULL) {
+        printf("Could not open %s\n", argv[1]);
+        return 1;
+    }
+    int failed = fprintf(file, "// Generated by generate-tables. Do not edit.\n") < 0;
+    failed = failed || write_tables(file, "GENERATED_OFFSET_TABLES", offset_tables, GENERATED_OFFSET_TABLE_SIZE);
+    failed = failed || write_tables(file, "GENERATED_RADIAL_TABLES", radial_tables, GENERATED_RADIAL_TABLE_SIZE);
+    failed = fclose(file) != 0 || failed;
+    if (failed) {
+        printf("Could not write %s\n", argv[1]);
+        remove(argv[1]);
+        return 1;
+    }
+    for (int i = 0; i < GENERATED_TABLE_COUNT; i++) {
+        free(offset_tables[i]);
+        free(radial_tables[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Persistent files of the tables of the cached geometry.
+//
+// A file is a GeometryCacheHeader followed by the two-dimensional tables and
+// then by the radial tables, in the order of geometry-tables.h. Files are mapped
+// read-only, so processes which use the same file share its pages through the
+// page cache. They are written to a temporary file which is then renamed over
+// the final one, so a file is either complete or absent.
+//
+// The version must be incremented whenever the layout or the evaluation of the
+// tables changes.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "geometry-tables.h"
+
+#define GEOMETRY_CACHE_FILE_MAGIC "WAVESGEO"
+
+#define GEOMETRY_CACHE_FILE_VERSION 1
+
+typedef struct GeometryCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t table_count;
+    double wavelength;
+    int32_t radial_table_resolution;
+    int32_t maximum; // The offset covered by the tables.
+    int32_t offset_table_maximum; // The biggest value N such that (n, n) is in the two-dimensional tables.
+    int32_t radial_table_size;
+    uint64_t checksum; // Of everything after the header.
+} GeometryCacheHeader;
+
+/**
+ * Returns a GeometryCacheHeader, without a checksum, for tables of the current version with the dimensions.
+ */
+static inline GeometryCacheHeader make_geometry_cache_header(const int maximum, const int offset_table_maximum, const int radial_table_size) {
+    GeometryCacheHeader header;
+    memset(&header, 0, sizeof(GeometryCacheHeader));
+    memcpy(header.magic, GEOMETRY_CACHE_FILE_MAGIC, sizeof(header.magic));
+    header.version = GEOMETRY_CACHE_FILE_VERSION;
+    header.table_count = GEOMETRY_TABLE_COUNT;
+    header.wavelength = DEFAULT_WAVELENGTH;
+    header.radial_table_resolution = RADIAL_TABLE_RESOLUTION;
+    header.maximum = maximum;
+    header.offset_table_maximum = offset_table_maximum;
+    header.radial_table_size = radial_table_size;
+    return header;
+}
+
+static inline size_t get_offset_table_size(const GeometryCacheHeader * const header) {
+    return (size_t) (header->offset_table_maximum + 1) * (header->offset_table_maximum + 1);
+}
+
+/**
+ * Returns the number of bytes of a file with the header.
+ */
+static inline size_t get_geometry_cache_file_size(const GeometryCacheHeader * const header) {
+    const size_t table_size = get_offset_table_size(header) + header->radial_table_size;
+    return sizeof(GeometryCacheHeader) + header->table_count * table_size * sizeof(double);
+}
+
+/**
+ * Folds the values of a table into the checksum, a whole value at a time, using FNV-1a.
+ */
+static inline uint64_t checksum_table(uint64_t checksum, const double *table, const size_t size) {
+    const uint64_t *words = (const uint64_t *) table;
+    for (size_t i = 0; i < size; i++) {
+        checksum ^= words[i];
+        checksum *= 1099511628211ull;
+    }
+    return checksum;
+}
+
+/**
+ * Returns the checksum of the tables described by the header.
+ */
+static inline uint64_t checksum_geometry_tables(const GeometryCacheHeader * const header, const double * const offset_tables[],
+                                                const double * const radial_tables[]) {
+    uint64_t checksum = 14695981039346656037ull;
+    for (uint32_t i = 0; i < header->table_count; i++) {
+        checksum = checksum_table(checksum, offset_tables[i], get_offset_table_size(header));
+    }
+    for (uint32_t i = 0; i < header->table_count; i++) {
+        checksum = checksum_table(checksum, radial_tables[i], header->radial_table_size);
+    }
+    return checksum;
+}
+
+/**
+ * Writes the tables with their header to the path, replacing the file atomically.
+ *
+ * Returns 0 if the file was written.
+ */
+static inline int write_geometry_cache_file(const char *path, GeometryCacheHeader header, const double * const offset_tables[],
+                                            const double * const radial_tables[]) {
+    header.checksum = checksum_geometry_tables(&header, offset_tables, radial_tables);
+    char temporary_path[4096];
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.%ld.tmp", path, (long) getpid()) >= (int) sizeof(temporary_path)) {
+        return 1;
+    }
+    FILE *file = fopen(temporary_path, "wb");
+    if (file == NULL) {
+        return 1;
+    }
+    int failed = fwrite(&header, sizeof(GeometryCacheHeader), 1, file) != 1;
+    for (uint32_t i = 0; i < header.table_count && !failed; i++) {
+        failed = fwrite(offset_tables[i], sizeof(double), get_offset_table_size(&header), file) != get_offset_table_size(&header);
+    }
+    for (uint32_t i = 0; i < header.table_count && !failed; i++) {
+        failed = fwrite(radial_tables[i], sizeof(double), header.radial_table_size, file) != (size_t) header.radial_table_size;
+    }
+    // The data must reach the disk before the rename does, or a crash could leave a complete name over partial data.
+    failed = failed || fflush(file) != 0 || fsync(fileno(file)) != 0;
+    failed = fclose(file) != 0 || failed;
+    if (failed || rename(temporary_path, path) != 0) {
+        remove(temporary_path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Maps a file of tables which matches the expected header, except for its checksum, which is verified.
+ *
+ * The tables of the mapping are pointed to by offset_tables and radial_tables.
+ * Returns the mapping, to be released with munmap, or NULL if there is no such file.
+ */
+static inline void *map_geometry_cache_file(const char *path, const GeometryCacheHeader * const expected, size_t *mapping_size,
+                                            const double *offset_tables[], const double *radial_tables[]) {
+    const int descriptor = open(path, O_RDONLY);
+    if (descriptor == -1) {
+        return NULL;
+    }
+    struct stat status;
+    const size_t size = get_geometry_cache_file_size(expected);
+    if (fstat(descriptor, &status) != 0 || (size_t) status.st_size != size) {
+        close(descriptor);
+        return NULL;
+    }
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    const GeometryCacheHeader *header = mapping;
+    GeometryCacheHeader unchecked = *header;
+    unchecked.checksum = 0;
+    if (memcmp(&unchecked, expected, sizeof(GeometryCacheHeader)) != 0) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    const double *data = (const double *) (header + 1);
+    for (uint32_t i = 0; i < header->table_count; i++) {
+        offset_tables[i] = data + i * get_offset_table_size(header);
+    }
+    data += header->table_count * get_offset_table_size(header);
+    for (uint32_t i = 0; i < header->table_count; i++) {
+        radial_tables[i] = data + (size_t) i * header->radial_table_size;
+    }
+    if (checksum_geometry_tables(header, offset_tables, radial_tables) != header->checksum) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    *mapping_size = size;
+    return mapping;
+}
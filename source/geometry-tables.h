@@ -0,0 +1,104 @@
+// The evaluation of the tables of the cached geometry.
+//
+// The tables only depend on the default wavelength and on the dissipation
+// models, so they are evaluated by the same functions whether they are generated
+// at build time by generate-tables or grown at runtime by the cached geometry.
+//
+// Each kind of table comes as GEOMETRY_TABLE_COUNT tables: the sine of the phase
+// of the default wavelength followed by the attenuation of each dissipation model.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+
+#include "constants.h"
+#include "dissipation.h"
+#include "geometry.h"
+
+#define GEOMETRY_TABLE_COUNT (1 + NUMBER_OF_DISSIPATION_MODELS)
+
+/**
+ * The index of the table of the sine of the phase among the tables of a kind.
+ */
+#define SINE_TABLE 0
+
+/**
+ * The index of the table of the attenuation of a dissipation model among the tables of a kind.
+ */
+#define ATTENUATION_TABLE(model) (1 + (model))
+
+/**
+ * The number of samples per pixel of the radial tables.
+ */
+#define RADIAL_TABLE_RESOLUTION 16
+
+/**
+ * The number of tables of each kind generated at build time, which are the first ones.
+ *
+ * Only the sine of the phase is generated, as the default window reads nothing
+ * else until a dissipation model is chosen. The attenuation tables of the same
+ * size are filled on first use instead.
+ */
+#define GENERATED_TABLE_COUNT 1
+
+/**
+ * The offset covered by the tables generated at build time, which is enough for the default window.
+ */
+#define GENERATED_TABLES_MAXIMUM 512
+
+/**
+ * The number of samples of the radial tables which cover the offsets up to the maximum along each axis.
+ *
+ * They cover the diagonal, with one more sample to interpolate towards.
+ */
+#define RADIAL_TABLE_SIZE(maximum) ((maximum) * 3 / 2 * RADIAL_TABLE_RESOLUTION + 2)
+
+#define GENERATED_OFFSET_TABLE_SIZE ((GENERATED_TABLES_MAXIMUM + 1) * (GENERATED_TABLES_MAXIMUM + 1))
+
+#define GENERATED_RADIAL_TABLE_SIZE RADIAL_TABLE_SIZE(GENERATED_TABLES_MAXIMUM)
+
+static inline double distance_to_origin(int x, int y) {
+    return sqrt(square(x) + square(y));
+}
+
+/**
+ * Evaluates one of the tables of a kind at a distance.
+ */
+static inline double evaluate_geometry_table(const int table, const double distance) {
+    if (table == SINE_TABLE) {
+        return sin(distance * TAU / DEFAULT_WAVELENGTH);
+    }
+    return attenuation((DissipationModel) (table - ATTENUATION_TABLE(0)), distance);
+}
+
+/**
+ * Evaluates the columns from begin onwards of a row of two-dimensional tables which cover the offsets up to the maximum.
+ *
+ * Only the tables from first_table onwards are written.
+ */
+static inline void fill_offset_tables(double * const tables[GEOMETRY_TABLE_COUNT], const int first_table, const int maximum,
+                                      const int y, const int begin) {
+    for (int x = begin; x <= maximum; x++) {
+        const size_t index = (size_t) y * (maximum + 1) + x;
+        const double distance = distance_to_origin(x, y);
+        for (int table = first_table; table < GEOMETRY_TABLE_COUNT; table++) {
+            tables[table][index] = evaluate_geometry_table(table, distance);
+        }
+    }
+}
+
+/**
+ * Evaluates the samples [begin, end) of radial tables, only writing the tables from first_table onwards.
+ */
+static inline void fill_radial_tables(double * const tables[GEOMETRY_TABLE_COUNT], const int first_table, const int begin,
+                                      const int end) {
+    for (int i = begin; i < end; i++) {
+        const double radius = (double) i / RADIAL_TABLE_RESOLUTION;
+        for (int table = first_table; table < GEOMETRY_TABLE_COUNT; table++) {
+            tables[table][i] = evaluate_geometry_table(table, radius);
+        }
+    }
+}
@@ -0,0 +1,281 @@
+// Image files written a row at a time, so that images need not fit in memory.
+//
+// Pixels are 0xAARRGGBB values, as drawn by the demo, and alpha is dropped.
+// PPM files are binary (P6). PNG files are not compressed: their pixels are
+// stored in deflate blocks without compression, so that writing them is about
+// as fast as writing a PPM while any viewer can open them.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The largest block of a deflate stream which is stored without compression.
+ */
+#define STORED_BLOCK_SIZE 65535
+
+typedef enum ImageFormat {
+    PPM_IMAGE, PNG_IMAGE
+} ImageFormat;
+
+typedef struct ImageWriter {
+    FILE *file;
+    ImageFormat format;
+    int width;
+    int height;
+    int rows_written;
+    size_t blocks_written; // The number of stored blocks of a PNG written so far.
+    int failed; // Whether or not a write failed, after which nothing else is written.
+    uint32_t crc_table[256];
+    uint32_t adler; // The Adler-32 of the pixel data of a PNG written so far.
+    unsigned char *row; // The bytes of a row, as written to the file or to the stored blocks.
+    unsigned char *block; // The pending stored block of a PNG.
+    size_t block_size;
+} ImageWriter;
+
+/**
+ * Returns the ImageFormat of a path from its extension, or 1 if it has none of them.
+ */
+static inline int get_image_format(const char *path, ImageFormat *format) {
+    const char *extension = strrchr(path, '.');
+    if (extension == NULL) {
+        return 1;
+    }
+    if (strcmp(extension, ".ppm") == 0 || strcmp(extension, ".PPM") == 0) {
+        *format = PPM_IMAGE;
+    } else if (strcmp(extension, ".png") == 0 || strcmp(extension, ".PNG") == 0) {
+        *format = PNG_IMAGE;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+static inline void make_crc32_table(uint32_t table[256]) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+}
+
+/**
+ * Returns the CRC-32 of data which follows data whose CRC-32 is crc, which is 0 for no preceding data.
+ */
+static inline uint32_t update_crc32(const uint32_t table[256], uint32_t crc, const unsigned char *data, size_t size) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * Returns the Adler-32 of data which follows data whose Adler-32 is adler, which is 1 for no preceding data.
+ */
+static inline uint32_t update_adler32(uint32_t adler, const unsigned char *data, size_t size) {
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        // The sums cannot overflow within 5552 bytes, so they are only reduced between such runs.
+        const size_t run = size < 5552 ? size : 5552;
+        for (size_t i = 0; i < run; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        size -= run;
+    }
+    return b << 16 | a;
+}
+
+static inline void put_big_endian(unsigned char *bytes, uint32_t value) {
+    bytes[0] = (unsigned char) (value >> 24);
+    bytes[1] = (unsigned char) (value >> 16);
+    bytes[2] = (unsigned char) (value >> 8);
+    bytes[3] = (unsigned char) value;
+}
+
+static inline void write_image_bytes(ImageWriter *writer, const void *bytes, size_t size) {
+    if (!writer->failed && size > 0 && fwrite(bytes, 1, size, writer->file) != size) {
+        writer->failed = 1;
+    }
+}
+
+/**
+ * Writes a PNG chunk whose data is the concatenation of a head and a body, either of which may be empty.
+ */
+static inline void write_png_chunk(ImageWriter *writer, const char type[4], const unsigned char *head, size_t head_size,
+                                   const unsigned char *body, size_t body_size) {
+    unsigned char prefix[8];
+    put_big_endian(prefix, (uint32_t) (head_size + body_size));
+    memcpy(prefix + 4, type, 4);
+    uint32_t crc = update_crc32(writer->crc_table, 0, prefix + 4, 4);
+    crc = update_crc32(writer->crc_table, crc, head, head_size);
+    crc = update_crc32(writer->crc_table, crc, body, body_size);
+    unsigned char suffix[4];
+    put_big_endian(suffix, crc);
+    write_image_bytes(writer, prefix, sizeof(prefix));
+    write_image_bytes(writer, head, head_size);
+    write_image_bytes(writer, body, body_size);
+    write_image_bytes(writer, suffix, sizeof(suffix));
+}
+
+/**
+ * Writes the pending stored block of a PNG as an IDAT chunk.
+ *
+ * The first block is preceded by the header of the zlib stream and the final one is followed by its checksum.
+ */
+static inline void flush_stored_block(ImageWriter *writer, const int final) {
+    unsigned char head[2 + 5];
+    size_t head_size = 0;
+    if (writer->blocks_written == 0) {
+        // A zlib stream with a 32 KiB window and no preset dictionary, whose header is a multiple of 31.
+        head[head_size++] = 0x78;
+        head[head_size++] = 0x01;
+    }
+    head[head_size++] = (unsigned char) final; // Not compressed, so the type bits are zero.
+    head[head_size++] = (unsigned char) writer->block_size;
+    head[head_size++] = (unsigned char) (writer->block_size >> 8);
+    head[head_size++] = (unsigned char) ~writer->block_size;
+    head[head_size++] = (unsigned char) (~writer->block_size >> 8);
+    writer->adler = update_adler32(writer->adler, writer->block, writer->block_size);
+    if (final) {
+        put_big_endian(writer->block + writer->block_size, writer->adler);
+    }
+    write_png_chunk(writer, "IDAT", head, head_size, writer->block, writer->block_size + (final ? 4 : 0));
+    writer->block_size = 0;
+    writer->blocks_written++;
+}
+
+/**
+ * Starts an image of the specified dimensions in the file, which must be open for binary writing.
+ *
+ * Returns NULL if the buffers could not be allocated.
+ */
+static inline ImageWriter *create_image_writer(FILE *file, ImageFormat format, const int width, const int height) {
+    ImageWriter *writer = malloc(sizeof(ImageWriter));
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->file = file;
+    writer->format = format;
+    writer->width = width;
+    writer->height = height;
+    writer->rows_written = 0;
+    writer->blocks_written = 0;
+    writer->failed = 0;
+    make_crc32_table(writer->crc_table);
+    writer->adler = 1;
+    writer->row = malloc(1 + 3 * (size_t) width);
+    writer->block = format == PNG_IMAGE ? malloc(STORED_BLOCK_SIZE + 4) : NULL;
+    writer->block_size = 0;
+    if (writer->row == NULL || (format == PNG_IMAGE && writer->block == NULL)) {
+        free(writer->row);
+        free(writer->block);
+        free(writer);
+        return NULL;
+    }
+    if (format == PPM_IMAGE) {
+        writer->failed = fprintf(file, "P6\n%d %d\n255\n", width, height) < 0;
+    } else {
+        const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        write_image_bytes(writer, signature, sizeof(signature));
+        unsigned char header[13];
+        put_big_endian(header, (uint32_t) width);
+        put_big_endian(header + 4, (uint32_t) height);
+        header[8] = 8; // Bits per sample.
+        header[9] = 2; // Truecolor.
+        header[10] = 0; // Deflate.
+        header[11] = 0; // Adaptive filtering, although every row is unfiltered.
+        header[12] = 0; // Not interlaced.
+        write_png_chunk(writer, "IHDR", header, sizeof(header), NULL, 0);
+    }
+    return writer;
+}
+
+/**
+ * Writes the next row of the image, which has width pixels.
+ */
+static inline void write_image_row(ImageWriter *writer, const uint32_t *pixels) {
+    unsigned char *bytes = writer->row;
+    size_t size = 0;
+    if (writer->format == PNG_IMAGE) {
+        bytes[size++] = 0; // No filter.
+    }
+    for (int x = 0; x < writer->width; x++) {
+        bytes[size++] = (unsigned char) (pixels[x] >> 16);
+        bytes[size++] = (unsigned char) (pixels[x] >> 8);
+        bytes[size++] = (unsigned char) pixels[x];
+    }
+    if (writer->format == PPM_IMAGE) {
+        write_image_bytes(writer, bytes, size);
+    } else {
+        while (size > 0) {
+            const size_t free_space = STORED_BLOCK_SIZE - writer->block_size;
+            const size_t copied = size < free_space ? size : free_space;
+            memcpy(writer->block + writer->block_size, bytes, copied);
+            writer->block_size += copied;
+            bytes += copied;
+            size -= copied;
+            if (writer->block_size == STORED_BLOCK_SIZE) {
+                flush_stored_block(writer, 0);
+            }
+        }
+    }
+    writer->rows_written++;
+}
+
+/**
+ * Finishes the image and frees the ImageWriter, but does not close its file.
+ *
+ * Returns 0 if every row was written successfully.
+ */
+static inline int finish_image_writer(ImageWriter *writer) {
+    int failed = writer->rows_written != writer->height;
+    if (!failed && writer->format == PNG_IMAGE) {
+        flush_stored_block(writer, 1);
+        write_png_chunk(writer, "IEND", NULL, 0, NULL, 0);
+    }
+    failed = failed || writer->failed || fflush(writer->file) != 0;
+    free(writer->row);
+    free(writer->block);
+    free(writer);
+    return failed;
+}
+
+/**
+ * Writes an image to the path, in the format of its extension.
+ *
+ * Returns 0 if the image was written.
+ */
+static inline int write_image_file(const char *path, const uint32_t *pixels, const int width, const int height) {
+    ImageFormat format;
+    if (get_image_format(path, &format)) {
+        return 1;
+    }
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return 1;
+    }
+    ImageWriter *writer = create_image_writer(file, format, width, height);
+    if (writer == NULL) {
+        fclose(file);
+        return 1;
+    }
+    for (int y = 0; y < height; y++) {
+        write_image_row(writer, pixels + (size_t) y * width);
+    }
+    int failed = finish_image_writer(writer);
+    failed = fclose(file) != 0 || failed;
+    return failed;
+}
@@ -7,14 +7,14 @@
 #include <stdio.h>
 #include <string.h>
 
-int validate_tags(char **tags, size_t tag_count) {
+static inline int validate_tags(char **tags, size_t tag_count) {
     return 1;
 }
 
 /**
  * Merge an array of tags into a single string.
  */
-char *merge_tags(char **tags, size_t tag_count) {
+static inline char *merge_tags(char **tags, size_t tag_count) {
     if (tags == NULL) {
         return "";
     }
@@ -49,7 +49,7 @@ char *merge_tags(char **tags, size_t tag_count) {
  *
  * This function returns 0 if the write succeeded.
  */
-int log_message(short level, char *message, char **tags, size_t tag_count) {
+static inline int log_message(short level, char *message, char **tags, size_t tag_count) {
     FILE *log_file = fopen("log.txt", "a");
     if (log_file == NULL) {
         printf("Could not open the log file!\n");
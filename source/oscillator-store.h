@@ -0,0 +1,116 @@
+// A growable structure-of-arrays store of oscillators.
+//
+// Oscillators are densely packed: the oscillator at index i is described by
+// center_x[i], center_y[i], amplitude[i], and wavelength[i], for every i less
+// than count. Removal swaps the last oscillator into the removed slot, so
+// indices are not stable across removals.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <stdlib.h>
+
+/**
+ * The capacity of an empty OscillatorStore after its first insertion.
+ */
+#define OSCILLATOR_STORE_INITIAL_CAPACITY 16
+
+typedef struct OscillatorStore {
+    size_t count;
+    size_t capacity;
+    double *center_x; // Centers are fractional, so that Oscillators can move smoothly.
+    double *center_y;
+    double *amplitude;
+    double *wavelength;
+} OscillatorStore;
+
+/**
+ * Creates an empty OscillatorStore.
+ */
+static inline OscillatorStore *create_oscillator_store() {
+    OscillatorStore *store = malloc(sizeof(OscillatorStore));
+    store->count = 0;
+    store->capacity = 0;
+    store->center_x = NULL;
+    store->center_y = NULL;
+    store->amplitude = NULL;
+    store->wavelength = NULL;
+    return store;
+}
+
+static inline void delete_oscillator_store(OscillatorStore *store) {
+    free(store->center_x);
+    free(store->center_y);
+    free(store->amplitude);
+    free(store->wavelength);
+    free(store);
+}
+
+/**
+ * Ensures that the store can hold at least the specified number of oscillators.
+ *
+ * Returns 0 if the memory could be allocated.
+ */
+static inline int reserve_oscillators(OscillatorStore *store, size_t capacity) {
+    if (capacity <= store->capacity) {
+        return 0;
+    }
+    double *center_x = realloc(store->center_x, capacity * sizeof(double));
+    if (center_x != NULL) {
+        store->center_x = center_x;
+    }
+    double *center_y = realloc(store->center_y, capacity * sizeof(double));
+    if (center_y != NULL) {
+        store->center_y = center_y;
+    }
+    double *amplitude = realloc(store->amplitude, capacity * sizeof(double));
+    if (amplitude != NULL) {
+        store->amplitude = amplitude;
+    }
+    double *wavelength = realloc(store->wavelength, capacity * sizeof(double));
+    if (wavelength != NULL) {
+        store->wavelength = wavelength;
+    }
+    if (center_x == NULL || center_y == NULL || amplitude == NULL || wavelength == NULL) {
+        return 1;
+    }
+    store->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Appends an oscillator to the store.
+ *
+ * Returns the index of the new oscillator, or the count of the store if it could not be added.
+ */
+static inline size_t add_oscillator(OscillatorStore *store, double x, double y, double amplitude, double wavelength) {
+    if (store->count == store->capacity) {
+        size_t capacity = store->capacity * 2;
+        if (capacity == 0) {
+            capacity = OSCILLATOR_STORE_INITIAL_CAPACITY;
+        }
+        if (reserve_oscillators(store, capacity)) {
+            return store->count;
+        }
+    }
+    const size_t index = store->count;
+    store->center_x[index] = x;
+    store->center_y[index] = y;
+    store->amplitude[index] = amplitude;
+    store->wavelength[index] = wavelength;
+    store->count++;
+    return index;
+}
+
+/**
+ * Removes the oscillator at the index by moving the last oscillator into its place.
+ */
+static inline void remove_oscillator(OscillatorStore *store, size_t index) {
+    const size_t last = store->count - 1;
+    store->center_x[index] = store->center_x[last];
+    store->center_y[index] = store->center_y[last];
+    store->amplitude[index] = store->amplitude[last];
+    store->wavelength[index] = store->wavelength[last];
+    store->count--;
+}
@@ -0,0 +1,333 @@
+// Scenes, the text files which describe what the renderer draws.
+//
+// A scene has one directive per line, and everything after a # is a comment:
+//
+//     size WIDTH HEIGHT
+//     dissipation none | inverse-linear | inverse-square | exponential | gaussian
+//     oscillator X Y AMPLITUDE WAVELENGTH
+//
+// Positions are in pixels relative to the center of the image, with y growing
+// downwards. The dissipation model applies to every oscillator of the scene.
+//
+// A scene template is a scene in which ${NAME} stands for the value of a
+// parameter, which is swept over a range to make a variant of the scene for each
+// combination of the values of the parameters.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dissipation.h"
+#include "oscillator-store.h"
+
+/**
+ * The longest line a scene may have, including its terminator.
+ */
+#define SCENE_LINE_SIZE 1024
+
+/**
+ * The longest name a parameter of a scene template may have, including its terminator.
+ */
+#define SCENE_PARAMETER_NAME_SIZE 32
+
+/**
+ * The most values a parameter of a scene template may take.
+ */
+#define MAXIMUM_SCENE_PARAMETER_VALUES 100000
+
+/**
+ * The names of the dissipation models in scenes, in the order of DissipationModel.
+ */
+static const char * const SCENE_DISSIPATION_NAMES[NUMBER_OF_DISSIPATION_MODELS] = {
+    "none", "inverse-linear", "inverse-square", "exponential", "gaussian"
+};
+
+typedef struct Scene {
+    int width; // Zero if the scene does not specify its size.
+    int height;
+    DissipationModel dissipation_model;
+    OscillatorStore *oscillators;
+} Scene;
+
+/**
+ * A parameter of a scene template, which takes the values first, first + step, and so on up to last.
+ */
+typedef struct SceneParameter {
+    char name[SCENE_PARAMETER_NAME_SIZE];
+    double first;
+    double last;
+    double step;
+    size_t count; // The number of values it takes.
+} SceneParameter;
+
+/**
+ * Creates an empty Scene without a size and without dissipation.
+ */
+static inline Scene *create_scene() {
+    Scene *scene = malloc(sizeof(Scene));
+    scene->width = 0;
+    scene->height = 0;
+    scene->dissipation_model = NO_DISSIPATION;
+    scene->oscillators = create_oscillator_store();
+    return scene;
+}
+
+static inline void delete_scene(Scene *scene) {
+    delete_oscillator_store(scene->oscillators);
+    free(scene);
+}
+
+/**
+ * Parses a finite number which must be followed by whitespace or by the end of the string.
+ *
+ * Returns 0 if the number was parsed, and advances the cursor past it.
+ */
+static inline int parse_scene_number(char **cursor, double *number) {
+    char *end;
+    *number = strtod(*cursor, &end);
+    if (end == *cursor || (*end != '\0' && *end != ' ' && *end != '\t') || !isfinite(*number)) {
+        return 1;
+    }
+    *cursor = end;
+    return 0;
+}
+
+/**
+ * Applies a line of a scene to it, which is modified in place.
+ *
+ * Returns NULL if the line was valid, and otherwise a description of the error.
+ */
+static inline const char *parse_scene_line(Scene *scene, char *line) {
+    line[strcspn(line, "#\r\n")] = '\0';
+    char *cursor = line + strspn(line, " \t");
+    if (*cursor == '\0') {
+        return NULL;
+    }
+    const size_t keyword_length = strcspn(cursor, " \t");
+    char *keyword = cursor;
+    cursor += keyword_length;
+    cursor += strspn(cursor, " \t");
+    keyword[keyword_length] = '\0';
+    double numbers[4];
+    size_t count = 0;
+    if (strcmp(keyword, "dissipation") == 0) {
+        const size_t name_length = strcspn(cursor, " \t");
+        if (cursor[name_length + strspn(cursor + name_length, " \t")] != '\0') {
+            return "dissipation takes a single model";
+        }
+        cursor[name_length] = '\0';
+        for (int model = 0; model < NUMBER_OF_DISSIPATION_MODELS; model++) {
+            if (strcmp(cursor, SCENE_DISSIPATION_NAMES[model]) == 0) {
+                scene->dissipation_model = (DissipationModel) model;
+                return NULL;
+            }
+        }
+        return "unknown dissipation model";
+    }
+    while (*cursor != '\0') {
+        if (count == 4) {
+            return "too many arguments";
+        }
+        if (parse_scene_number(&cursor, &numbers[count])) {
+            return "arguments must be numbers";
+        }
+        count++;
+        cursor += strspn(cursor, " \t");
+    }
+    if (strcmp(keyword, "size") == 0) {
+        if (count != 2) {
+            return "size takes a width and a height";
+        }
+        for (int i = 0; i < 2; i++) {
+            if (numbers[i] < 1 || numbers[i] > UINT16_MAX || numbers[i] != floor(numbers[i])) {
+                return "size must be a whole number of pixels from 1 to 65535";
+            }
+        }
+        scene->width = (int) numbers[0];
+        scene->height = (int) numbers[1];
+        return NULL;
+    }
+    if (strcmp(keyword, "oscillator") == 0) {
+        if (count != 4) {
+            return "oscillator takes a position, an amplitude, and a wavelength";
+        }
+        if (numbers[2] < 0.0) {
+            return "amplitude must not be negative";
+        }
+        if (!(numbers[3] > 0.0)) {
+            return "wavelength must be positive";
+        }
+        const size_t index = add_oscillator(scene->oscillators, numbers[0], numbers[1], numbers[2], numbers[3]);
+        if (index == scene->oscillators->count) {
+            return "could not allocate the oscillator";
+        }
+        return NULL;
+    }
+    return "unknown directive";
+}
+
+/**
+ * Reads a Scene from a file, reporting errors with the name of the file and the number of the line.
+ *
+ * Returns NULL if the scene is invalid.
+ */
+static inline Scene *read_scene(FILE *file, const char *name) {
+    Scene *scene = create_scene();
+    char line[SCENE_LINE_SIZE];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        const char *error = strchr(line, '\n') == NULL && !feof(file) ? "line is too long" : parse_scene_line(scene, line);
+        if (error != NULL) {
+            printf("%s:%d: %s\n", name, line_number, error);
+            delete_scene(scene);
+            return NULL;
+        }
+    }
+    if (ferror(file)) {
+        printf("%s: could not be read\n", name);
+        delete_scene(scene);
+        return NULL;
+    }
+    return scene;
+}
+
+/**
+ * Reads the Scene at the path, or returns NULL if it could not be read.
+ */
+static inline Scene *load_scene(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Could not open %s\n", path);
+        return NULL;
+    }
+    Scene *scene = read_scene(file, path);
+    fclose(file);
+    return scene;
+}
+
+/**
+ * Parses a parameter of a scene template of the form NAME=FIRST:LAST:STEP, or NAME=VALUE for a single value.
+ *
+ * Names are made of letters, digits, and underscores. Returns 0 if the parameter was valid.
+ */
+static inline int parse_scene_parameter(const char *argument, SceneParameter *parameter) {
+    const size_t name_length = strcspn(argument, "=");
+    if (name_length == 0 || name_length >= SCENE_PARAMETER_NAME_SIZE || argument[name_length] != '=') {
+        return 1;
+    }
+    for (size_t i = 0; i < name_length; i++) {
+        if (!(isalnum((unsigned char) argument[i]) || argument[i] == '_')) {
+            return 1;
+        }
+    }
+    memcpy(parameter->name, argument, name_length);
+    parameter->name[name_length] = '\0';
+    double numbers[3];
+    size_t count = 0;
+    const char *cursor = argument + name_length;
+    do {
+        char *end;
+        numbers[count] = strtod(cursor + 1, &end);
+        if (end == cursor + 1 || !isfinite(numbers[count])) {
+            return 1;
+        }
+        count++;
+        cursor = end;
+    } while (*cursor == ':' && count < 3);
+    if (*cursor != '\0' || count == 2) {
+        return 1;
+    }
+    parameter->first = numbers[0];
+    parameter->last = count == 3 ? numbers[1] : numbers[0];
+    parameter->step = count == 3 ? numbers[2] : 1.0;
+    if (parameter->step == 0.0 || (parameter->last - parameter->first) / parameter->step < 0.0) {
+        return 1;
+    }
+    // The last value is kept when rounding errors leave it slightly beyond the range.
+    const double steps = floor((parameter->last - parameter->first) / parameter->step + 1e-9);
+    if (!(steps < MAXIMUM_SCENE_PARAMETER_VALUES)) {
+        return 1;
+    }
+    parameter->count = (size_t) steps + 1;
+    return 0;
+}
+
+/**
+ * Returns the number of variants of a scene template, one per combination of the values of its parameters.
+ */
+static inline size_t count_scene_variants(const SceneParameter *parameters, const size_t parameter_count) {
+    size_t count = 1;
+    for (size_t i = 0; i < parameter_count; i++) {
+        count *= parameters[i].count;
+    }
+    return count;
+}
+
+/**
+ * Writes the values of the parameters in a variant of a scene template, in which the last parameter changes fastest.
+ */
+static inline void get_scene_variant(const SceneParameter *parameters, const size_t parameter_count, size_t variant,
+                                     double *values) {
+    for (size_t i = parameter_count; i > 0; i--) {
+        const SceneParameter *parameter = &parameters[i - 1];
+        values[i - 1] = parameter->first + (double) (variant % parameter->count) * parameter->step;
+        variant /= parameter->count;
+    }
+}
+
+/**
+ * Replaces each ${NAME} in the scene template by the value of the parameter with that name.
+ *
+ * Returns the new text, which the caller frees, or NULL if a parameter is missing or the memory could not be allocated.
+ */
+static inline char *expand_scene_template(const char *template, const SceneParameter *parameters,
+                                          const size_t parameter_count, const double *values) {
+    size_t capacity = strlen(template) + 1;
+    size_t size = 0;
+    char *text = malloc(capacity);
+    while (text != NULL && *template != '\0') {
+        const char *replacement = template;
+        size_t replacement_length = 1;
+        char value[32];
+        if (template[0] == '$' && template[1] == '{') {
+            const size_t name_length = strcspn(template + 2, "}");
+            size_t i = 0;
+            while (i < parameter_count && (strlen(parameters[i].name) != name_length ||
+                                           strncmp(parameters[i].name, template + 2, name_length) != 0)) {
+                i++;
+            }
+            if (i == parameter_count || template[2 + name_length] != '}') {
+                free(text);
+                return NULL;
+            }
+            // Seventeen significant digits read back as the same double.
+            replacement_length = (size_t) snprintf(value, sizeof(value), "%.17g", values[i]);
+            replacement = value;
+            template += name_length + 2;
+        }
+        if (size + replacement_length + 1 > capacity) {
+            capacity = 2 * capacity + replacement_length;
+            char *grown = realloc(text, capacity);
+            if (grown == NULL) {
+                free(text);
+                return NULL;
+            }
+            text = grown;
+        }
+        memcpy(text + size, replacement, replacement_length);
+        size += replacement_length;
+        template++;
+    }
+    if (text != NULL) {
+        text[size] = '\0';
+    }
+    return text;
+}
@@ -0,0 +1,161 @@
+// A uniform grid which maps square tiles of the plane to the oscillators that can affect them.
+//
+// Each oscillator affects a disk around its center, which may be unbounded.
+// The index stores, for every tile, the oscillators whose disks intersect it,
+// packed in a single array in the compressed sparse row format.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "geometry.h"
+
+/**
+ * The side of the tiles of the SpatialIndex, in pixels.
+ */
+#define SPATIAL_INDEX_TILE_SIZE 32
+
+typedef struct SpatialIndex {
+    int left; // The horizontal coordinate of the first column of pixels.
+    int top; // The vertical coordinate of the first row of pixels.
+    int width;
+    int height;
+    int tile_size;
+    int columns;
+    int rows;
+    size_t *offsets; // The entries of tile t are entries[offsets[t]] to entries[offsets[t + 1] - 1].
+    size_t *entries;
+    size_t entry_capacity;
+} SpatialIndex;
+
+/**
+ * Creates an empty SpatialIndex covering the rectangle of pixels with the specified top left corner and dimensions.
+ */
+static inline SpatialIndex *create_spatial_index(int left, int top, int width, int height, int tile_size) {
+    SpatialIndex *index = malloc(sizeof(SpatialIndex));
+    index->left = left;
+    index->top = top;
+    index->width = width;
+    index->height = height;
+    index->tile_size = tile_size;
+    index->columns = (width + tile_size - 1) / tile_size;
+    index->rows = (height + tile_size - 1) / tile_size;
+    index->offsets = calloc((size_t) index->columns * index->rows + 1, sizeof(size_t));
+    index->entries = NULL;
+    index->entry_capacity = 0;
+    return index;
+}
+
+static inline void delete_spatial_index(SpatialIndex *index) {
+    free(index->offsets);
+    free(index->entries);
+    free(index);
+}
+
+static inline size_t get_tile_count(const SpatialIndex * const index) {
+    return (size_t) index->columns * index->rows;
+}
+
+/**
+ * Returns whether or not the disk intersects the tile at the specified column and row.
+ */
+static inline int disk_intersects_tile(const SpatialIndex * const index, int column, int row, double x, double y, double radius) {
+    if (isinf(radius)) {
+        return 1;
+    }
+    const double tile_left = index->left + column * index->tile_size;
+    const double tile_top = index->top + row * index->tile_size;
+    // Pixels are sampled at integer coordinates, so the last pixel of the tile is one before the next tile.
+    const double tile_right = minimum(tile_left + index->tile_size, index->left + index->width) - 1;
+    const double tile_bottom = minimum(tile_top + index->tile_size, index->top + index->height) - 1;
+    const double dx = maximum(maximum(tile_left - x, 0.0), x - tile_right);
+    const double dy = maximum(maximum(tile_top - y, 0.0), y - tile_bottom);
+    return square(dx) + square(dy) <= square(radius);
+}
+
+/**
+ * Computes the range of tiles in one dimension which may intersect a disk.
+ */
+static inline void get_tile_range(int first, int tile_size, int tiles, double center, double radius, int *begin, int *end) {
+    if (isinf(radius)) {
+        *begin = 0;
+        *end = tiles;
+        return;
+    }
+    const double low = floor((center - radius - first) / tile_size);
+    const double high = floor((center + radius - first) / tile_size) + 1;
+    *begin = (int) maximum(low, 0);
+    *end = (int) minimum(high, tiles);
+    if (*end < *begin) {
+        *end = *begin;
+    }
+}
+
+/**
+ * Visits every tile whose rectangle intersects the disk, calling the visitor with the tile number.
+ */
+static inline void for_each_intersected_tile(SpatialIndex *index, double x, double y, double radius, size_t id,
+                                             void (*visitor)(SpatialIndex *, size_t, size_t)) {
+    int column_begin, column_end, row_begin, row_end;
+    get_tile_range(index->left, index->tile_size, index->columns, x, radius, &column_begin, &column_end);
+    get_tile_range(index->top, index->tile_size, index->rows, y, radius, &row_begin, &row_end);
+    for (int row = row_begin; row < row_end; row++) {
+        for (int column = column_begin; column < column_end; column++) {
+            if (disk_intersects_tile(index, column, row, x, y, radius)) {
+                visitor(index, (size_t) row * index->columns + column, id);
+            }
+        }
+    }
+}
+
+static inline void count_tile_entry(SpatialIndex *index, size_t tile, size_t id) {
+    (void) id;
+    index->offsets[tile + 1]++;
+}
+
+static inline void insert_tile_entry(SpatialIndex *index, size_t tile, size_t id) {
+    // During insertion, offsets[tile + 1] is the next free position of the tile.
+    index->entries[index->offsets[tile + 1]++] = id;
+}
+
+/**
+ * Rebuilds the SpatialIndex from the disks of count oscillators.
+ *
+ * The oscillators are identified by their position in the arrays, and the
+ * entries of each tile are sorted in increasing order.
+ *
+ * Returns 0 if the memory could be allocated.
+ */
+static inline int build_spatial_index(SpatialIndex *index, const double *x, const double *y, const double *radius, size_t count) {
+    const size_t tile_count = get_tile_count(index);
+    for (size_t tile = 0; tile <= tile_count; tile++) {
+        index->offsets[tile] = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        for_each_intersected_tile(index, x[i], y[i], radius[i], i, count_tile_entry);
+    }
+    for (size_t tile = 0; tile < tile_count; tile++) {
+        index->offsets[tile + 1] += index->offsets[tile];
+    }
+    const size_t entry_count = index->offsets[tile_count];
+    if (entry_count > index->entry_capacity) {
+        size_t *entries = realloc(index->entries, entry_count * sizeof(size_t));
+        if (entries == NULL) {
+            return 1;
+        }
+        index->entries = entries;
+        index->entry_capacity = entry_count;
+    }
+    // Shift the offsets by one tile so that offsets[tile + 1] starts at the first position of the tile.
+    for (size_t tile = tile_count; tile > 0; tile--) {
+        index->offsets[tile] = index->offsets[tile - 1];
+    }
+    index->offsets[0] = 0;
+    for (size_t i = 0; i < count; i++) {
+        for_each_intersected_tile(index, x[i], y[i], radius[i], i, insert_tile_entry);
+    }
+    return 0;
+}
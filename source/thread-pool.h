@@ -0,0 +1,135 @@
+// A fixed pool of worker threads for fork-join parallel loops.
+//
+// run_parallel() hands out the indices of a loop to the workers and to the
+// calling thread, and returns once all of them have been processed. Only one
+// loop runs on a pool at a time.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef void (*ParallelTask)(void *context, size_t index);
+
+typedef struct ThreadPool {
+    size_t thread_count; // The number of threads running tasks, including the one calling run_parallel().
+    pthread_t *workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_available;
+    pthread_cond_t work_done;
+    ParallelTask task;
+    void *context;
+    size_t task_count;
+    size_t next_task;
+    size_t completed_tasks;
+    int stopping;
+} ThreadPool;
+
+/**
+ * Returns the number of processors online, which is at least one.
+ */
+static inline size_t get_processor_count() {
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+}
+
+/**
+ * Runs tasks until there are none left. Must be called with the mutex locked.
+ */
+static inline void run_pending_tasks(ThreadPool *pool) {
+    while (pool->next_task < pool->task_count) {
+        const size_t index = pool->next_task++;
+        pthread_mutex_unlock(&pool->mutex);
+        pool->task(pool->context, index);
+        pthread_mutex_lock(&pool->mutex);
+        if (++pool->completed_tasks == pool->task_count) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+}
+
+static inline void *run_worker(void *argument) {
+    ThreadPool *pool = argument;
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->stopping) {
+        run_pending_tasks(pool);
+        if (!pool->stopping) {
+            pthread_cond_wait(&pool->work_available, &pool->mutex);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/**
+ * Creates a ThreadPool with the specified number of threads, or one per processor if it is zero.
+ *
+ * The thread calling run_parallel() counts as one of the threads.
+ */
+static inline ThreadPool *create_thread_pool(size_t thread_count) {
+    ThreadPool *pool = malloc(sizeof(ThreadPool));
+    pool->thread_count = thread_count > 0 ? thread_count : get_processor_count();
+    pool->workers = malloc(pool->thread_count * sizeof(pthread_t));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    pool->task = NULL;
+    pool->context = NULL;
+    pool->task_count = 0;
+    pool->next_task = 0;
+    pool->completed_tasks = 0;
+    pool->stopping = 0;
+    for (size_t i = 1; i < pool->thread_count; i++) {
+        if (pthread_create(&pool->workers[i], NULL, run_worker, pool)) {
+            // Run with the threads that could be created.
+            pool->thread_count = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+static inline void delete_thread_pool(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->mutex);
+    for (size_t i = 1; i < pool->thread_count; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool->workers);
+    free(pool);
+}
+
+/**
+ * Calls the task with every index in [0, task_count), in parallel, and waits for all calls to return.
+ */
+static inline void run_parallel(ThreadPool *pool, ParallelTask task, void *context, size_t task_count) {
+    if (task_count == 0) {
+        return;
+    }
+    if (pool == NULL || pool->thread_count == 1 || task_count == 1) {
+        for (size_t i = 0; i < task_count; i++) {
+            task(context, i);
+        }
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->context = context;
+    pool->task_count = task_count;
+    pool->next_task = 0;
+    pool->completed_tasks = 0;
+    pthread_cond_broadcast(&pool->work_available);
+    run_pending_tasks(pool);
+    while (pool->completed_tasks < pool->task_count) {
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
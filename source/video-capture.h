@@ -0,0 +1,234 @@
+// Recording of presented frames, written to disk by a background thread.
+//
+// The frames are copied into a ring of buffers allocated when the recording
+// starts, and a writer thread empties the ring into a YUV4MPEG2 stream or into
+// numbered PPM files. The thread which presents frames never waits for the
+// disk: it only holds the lock of the ring to claim or release a buffer, and
+// when every buffer is still waiting to be written the frame is dropped and
+// counted instead.
+//
+// Written by Bernardo Sulzbach in 2016 and licensed under the BSD 2-Clause.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image-file.h"
+
+/**
+ * The most memory the ring of a recording may take, in bytes.
+ */
+#define VIDEO_CAPTURE_BUDGET (256 * 1024 * 1024)
+
+/**
+ * The fewest and the most frames the ring of a recording holds, whatever their size.
+ */
+#define MINIMUM_VIDEO_CAPTURE_SLOTS 2
+#define MAXIMUM_VIDEO_CAPTURE_SLOTS 64
+
+typedef enum VideoFormat {
+    Y4M_VIDEO, // A single YUV4MPEG2 stream without chroma subsampling.
+    NUMBERED_FRAMES // A PPM file per frame, numbered after the path.
+} VideoFormat;
+
+typedef struct VideoCapture {
+    VideoFormat format;
+    int width;
+    int height;
+    char *path; // The stream, or the prefix of the numbered frames.
+    FILE *file; // The stream, or NULL for numbered frames.
+    uint32_t **slots; // The ring of frames, as 0xAARRGGBB pixels.
+    size_t slot_count;
+    size_t first_pending; // The oldest frame which was not written yet.
+    size_t pending_count;
+    int claimed; // Whether or not the slot after the pending ones is being filled.
+    unsigned char *bytes; // A frame converted by the writer.
+    uint64_t captured_count;
+    uint64_t written_count;
+    uint64_t dropped_count; // Frames dropped because the ring was full, or after a write failed.
+    int failed; // Whether or not a write failed, after which frames are dropped.
+    int stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t frame_ready;
+    pthread_t writer;
+} VideoCapture;
+
+/**
+ * Returns the VideoFormat of a path: streams end with .y4m and anything else is a prefix of numbered frames.
+ */
+static inline VideoFormat get_video_format(const char *path) {
+    const char *extension = strrchr(path, '.');
+    return extension != NULL && strcmp(extension, ".y4m") == 0 ? Y4M_VIDEO : NUMBERED_FRAMES;
+}
+
+/**
+ * Converts a frame to the planes of a Y4M frame, with the limited range of BT.601.
+ */
+static inline void convert_frame_to_yuv(const uint32_t *pixels, const size_t size, unsigned char *bytes) {
+    for (size_t i = 0; i < size; i++) {
+        const int r = (pixels[i] >> 16) & 0xFF;
+        const int g = (pixels[i] >> 8) & 0xFF;
+        const int b = pixels[i] & 0xFF;
+        bytes[i] = (unsigned char) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        bytes[size + i] = (unsigned char) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        bytes[2 * size + i] = (unsigned char) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+/**
+ * Writes a frame of the VideoCapture, which only the writer does.
+ *
+ * Returns 0 if it was written.
+ */
+static inline int write_video_frame(VideoCapture *capture, const uint32_t *pixels) {
+    if (capture->format == NUMBERED_FRAMES) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s-%06llu.ppm", capture->path, (unsigned long long) capture->written_count);
+        return write_image_file(path, pixels, capture->width, capture->height);
+    }
+    const size_t size = (size_t) capture->width * capture->height;
+    convert_frame_to_yuv(pixels, size, capture->bytes);
+    return fputs("FRAME\n", capture->file) < 0 || fwrite(capture->bytes, 1, 3 * size, capture->file) != 3 * size;
+}
+
+static inline void *run_video_writer(void *argument) {
+    VideoCapture *capture = argument;
+    pthread_mutex_lock(&capture->mutex);
+    while (1) {
+        while (capture->pending_count == 0 && !capture->stopping) {
+            pthread_cond_wait(&capture->frame_ready, &capture->mutex);
+        }
+        if (capture->pending_count == 0) {
+            break;
+        }
+        // The oldest frame stays pending while it is written, so the presenting thread does not reuse its slot.
+        const uint32_t *pixels = capture->slots[capture->first_pending];
+        const int failed = capture->failed;
+        pthread_mutex_unlock(&capture->mutex);
+        const int write_failed = !failed && write_video_frame(capture, pixels);
+        pthread_mutex_lock(&capture->mutex);
+        if (failed || write_failed) {
+            capture->failed = 1;
+            capture->dropped_count++;
+        } else {
+            capture->written_count++;
+        }
+        capture->first_pending = (capture->first_pending + 1) % capture->slot_count;
+        capture->pending_count--;
+    }
+    pthread_mutex_unlock(&capture->mutex);
+    return NULL;
+}
+
+/**
+ * Claims the buffer of the next frame, which the caller fills and then passes to end_video_frame.
+ *
+ * Returns NULL, counting the frame as dropped, if every buffer is waiting to be written.
+ */
+static inline uint32_t *begin_video_frame(VideoCapture *capture) {
+    uint32_t *pixels = NULL;
+    pthread_mutex_lock(&capture->mutex);
+    capture->captured_count++;
+    if (capture->pending_count < capture->slot_count && !capture->claimed) {
+        pixels = capture->slots[(capture->first_pending + capture->pending_count) % capture->slot_count];
+        capture->claimed = 1;
+    } else {
+        capture->dropped_count++;
+    }
+    pthread_mutex_unlock(&capture->mutex);
+    return pixels;
+}
+
+/**
+ * Hands the frame claimed by begin_video_frame to the writer.
+ */
+static inline void end_video_frame(VideoCapture *capture) {
+    pthread_mutex_lock(&capture->mutex);
+    capture->claimed = 0;
+    capture->pending_count++;
+    pthread_cond_signal(&capture->frame_ready);
+    pthread_mutex_unlock(&capture->mutex);
+}
+
+/**
+ * Waits for the pending frames to be written and stops the writer, after which the counts of the frames are final.
+ *
+ * Returns 0 if every frame which was not dropped was written.
+ */
+static inline int stop_video_capture(VideoCapture *capture) {
+    pthread_mutex_lock(&capture->mutex);
+    capture->stopping = 1;
+    pthread_cond_signal(&capture->frame_ready);
+    pthread_mutex_unlock(&capture->mutex);
+    pthread_join(capture->writer, NULL);
+    int failed = capture->failed;
+    if (capture->file != NULL) {
+        failed = fclose(capture->file) != 0 || failed;
+        capture->file = NULL;
+    }
+    return failed;
+}
+
+/**
+ * Frees a VideoCapture which was stopped, or whose writer was never started.
+ */
+static inline void delete_video_capture(VideoCapture *capture) {
+    pthread_mutex_destroy(&capture->mutex);
+    pthread_cond_destroy(&capture->frame_ready);
+    for (size_t i = 0; capture->slots != NULL && i < capture->slot_count; i++) {
+        free(capture->slots[i]);
+    }
+    free(capture->slots);
+    free(capture->bytes);
+    free(capture->path);
+    free(capture);
+}
+
+/**
+ * Starts recording frames of the specified dimensions to the path, at the frame rate if it is a Y4M stream.
+ *
+ * Returns NULL if the file or the buffers could not be created.
+ */
+static inline VideoCapture *create_video_capture(const char *path, const int width, const int height, const int frame_rate) {
+    VideoCapture *capture = calloc(1, sizeof(VideoCapture));
+    if (capture == NULL) {
+        return NULL;
+    }
+    const size_t size = (size_t) width * height;
+    capture->format = get_video_format(path);
+    capture->width = width;
+    capture->height = height;
+    capture->path = strdup(path);
+    capture->slot_count = VIDEO_CAPTURE_BUDGET / (size * sizeof(uint32_t));
+    if (capture->slot_count < MINIMUM_VIDEO_CAPTURE_SLOTS) {
+        capture->slot_count = MINIMUM_VIDEO_CAPTURE_SLOTS;
+    } else if (capture->slot_count > MAXIMUM_VIDEO_CAPTURE_SLOTS) {
+        capture->slot_count = MAXIMUM_VIDEO_CAPTURE_SLOTS;
+    }
+    capture->slots = calloc(capture->slot_count, sizeof(uint32_t *));
+    int failed = capture->path == NULL || capture->slots == NULL;
+    for (size_t i = 0; i < capture->slot_count && !failed; i++) {
+        capture->slots[i] = malloc(size * sizeof(uint32_t));
+        failed = capture->slots[i] == NULL;
+    }
+    if (!failed && capture->format == Y4M_VIDEO) {
+        capture->bytes = malloc(3 * size);
+        capture->file = fopen(path, "wb");
+        failed = capture->bytes == NULL || capture->file == NULL ||
+                 fprintf(capture->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, frame_rate) < 0;
+    }
+    pthread_mutex_init(&capture->mutex, NULL);
+    pthread_cond_init(&capture->frame_ready, NULL);
+    if (!failed && pthread_create(&capture->writer, NULL, run_video_writer, capture) == 0) {
+        return capture;
+    }
+    if (capture->file != NULL) {
+        fclose(capture->file);
+    }
+    delete_video_capture(capture);
+    return NULL;
+}